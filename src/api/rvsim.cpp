@@ -0,0 +1,136 @@
+#include "rvsim.h"
+#include <cstring>
+#include <exception>
+#include <new>
+#include "simulator.h"
+
+struct rvsim {
+  Simulator sim;
+};
+
+namespace {
+
+// run func, nothing escapes to the C caller: an exception is ret
+template <typename Ret, typename Func>
+Ret Guard(Ret ret, Func func) {
+  try {
+    return func();
+  }
+  catch (...) {
+    return ret;
+  }
+}
+
+}
+
+int rvsim_api_version(void) {
+  return RVSIM_API_VERSION;
+}
+
+rvsim *rvsim_create(void) {
+  return new(std::nothrow) rvsim;
+}
+
+void rvsim_destroy(rvsim *sim) {
+  delete sim;
+}
+
+int rvsim_set_option(rvsim *sim, const char *name, const char *value) {
+  if (sim == nullptr || name == nullptr || value == nullptr) return -1;
+  return Guard(-1, [&]() {return sim->sim.SetOption(name, value) ? 0 : -1;});
+}
+
+void rvsim_reset(rvsim *sim) {
+  if (sim == nullptr) return;
+  Guard(0, [&]() {
+    sim->sim.Reset();
+    return 0;
+  });
+}
+
+int rvsim_load_hex(rvsim *sim, const char *data, size_t size) {
+  if (sim == nullptr || data == nullptr) return -1;
+  return Guard(-1, [&]() {return sim->sim.LoadHex(data, size) ? 0 : -1;});
+}
+
+int rvsim_load_hex_file(rvsim *sim, const char *path) {
+  if (sim == nullptr || path == nullptr) return -1;
+  return Guard(-1, [&]() {return sim->sim.LoadHexFile(path) ? 0 : -1;});
+}
+
+int rvsim_load_binary(rvsim *sim, uint32_t addr, const void *data, size_t size, uint32_t entry) {
+  if (sim == nullptr || (data == nullptr && size > 0)) return -1;
+  return Guard(-1, [&]() {return sim->sim.LoadBinary(addr, data, size, entry) ? 0 : -1;});
+}
+
+void rvsim_enable_cosim(rvsim *sim) {
+  if (sim == nullptr) return;
+  Guard(0, [&]() {
+    sim->sim.EnableCosim();
+    return 0;
+  });
+}
+
+int rvsim_step(rvsim *sim, long long cycles) {
+  if (sim == nullptr) return -1;
+  return Guard(-1, [&]() {
+    bool finished = sim->sim.Step(cycles);
+    if (sim->sim.Failed()) return -1;
+    return finished ? 1 : 0;
+  });
+}
+
+int rvsim_run(rvsim *sim) {
+  if (sim == nullptr) return -1;
+  return Guard(-1, [&]() {return sim->sim.Run();});
+}
+
+const char *rvsim_error(rvsim *sim) {
+  if (sim == nullptr) return "";
+  return Guard("", [&]() {return sim->sim.Error().c_str();});
+}
+
+int rvsim_read_reg(rvsim *sim, int num, uint32_t *value) {
+  if (sim == nullptr || value == nullptr || num < 0 || num >= 32) return -1;
+  *value = sim->sim.ReadRegister(num);
+  return 0;
+}
+
+int rvsim_write_reg(rvsim *sim, int num, uint32_t value) {
+  if (sim == nullptr || num < 0 || num >= 32) return -1;
+  return Guard(-1, [&]() {
+    sim->sim.WriteRegister(num, value);
+    return 0;
+  });
+}
+
+int rvsim_read_mem(rvsim *sim, uint32_t addr, void *data, size_t size) {
+  if (sim == nullptr || (data == nullptr && size > 0)) return -1;
+  return Guard(-1, [&]() {return sim->sim.ReadMemory(addr, data, size) ? 0 : -1;});
+}
+
+int rvsim_write_mem(rvsim *sim, uint32_t addr, const void *data, size_t size) {
+  if (sim == nullptr || (data == nullptr && size > 0)) return -1;
+  return Guard(-1, [&]() {return sim->sim.WriteMemory(addr, data, size) ? 0 : -1;});
+}
+
+long long rvsim_cycles(rvsim *sim) {
+  return (sim == nullptr) ? 0 : sim->sim.Cycles();
+}
+
+long long rvsim_instructions(rvsim *sim) {
+  return (sim == nullptr) ? 0 : sim->sim.Instructions();
+}
+
+size_t rvsim_stats_json(rvsim *sim, char *buf, size_t size) {
+  if (sim == nullptr) return 0;
+  return Guard(size_t(0), [&]() {
+    std::string json = sim->sim.Stats();
+    if (buf != nullptr && size > 0) {
+      size_t len = (json.size() < size) ? json.size() : size - 1;
+      std::memcpy(buf, json.data(), len);
+      buf[len] = '\0';
+    }
+    return json.size();
+  });
+}
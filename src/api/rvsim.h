@@ -0,0 +1,79 @@
+
+#ifndef RISCV_SIMULATOR_RVSIM_H
+#define RISCV_SIMULATOR_RVSIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C API of the simulator(a thin wrapper of Simulator in simulator.h), link with libriscvsim
+ * a rvsim is one simulated machine, different rvsims can be used from different threads
+ * functions returning int: 0 on success, -1 on error(bad argument, unknown option, ...) unless said otherwise
+ * no function throws, no function writes to stdout
+ */
+
+#define RVSIM_API_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct rvsim rvsim;
+
+// RVSIM_API_VERSION of the library
+int rvsim_api_version(void);
+
+rvsim *rvsim_create(void);
+
+void rvsim_destroy(rvsim *sim);
+
+// see Simulator::SetOption, call before the program starts
+int rvsim_set_option(rvsim *sim, const char *name, const char *value);
+
+// unload the program, the options are kept, the rvsim can run another program
+void rvsim_reset(rvsim *sim);
+
+// program in hex text, the entry is its first address, -1 for a malformed image(rvsim_reset before loading again)
+int rvsim_load_hex(rvsim *sim, const char *data, size_t size);
+
+int rvsim_load_hex_file(rvsim *sim, const char *path);
+
+// raw bytes at addr, the program starts at entry
+int rvsim_load_binary(rvsim *sim, uint32_t addr, const void *data, size_t size, uint32_t entry);
+
+// check every committed instruction against the reference model
+void rvsim_enable_cosim(rvsim *sim);
+
+// run at most cycles cycles, return 1 if the program is finished, 0 if not, -1 if it failed
+int rvsim_step(rvsim *sim, long long cycles);
+
+// run until the program is finished, return the exit code(0 ~ 255), -1 if it failed
+int rvsim_run(rvsim *sim);
+
+// why the program failed(empty if it didn't), valid until the next call on sim
+const char *rvsim_error(rvsim *sim);
+
+// committed register x[num], registers and memory can be accessed between steps
+int rvsim_read_reg(rvsim *sim, int num, uint32_t *value);
+
+int rvsim_write_reg(rvsim *sim, int num, uint32_t value);
+
+int rvsim_read_mem(rvsim *sim, uint32_t addr, void *data, size_t size);
+
+int rvsim_write_mem(rvsim *sim, uint32_t addr, const void *data, size_t size);
+
+long long rvsim_cycles(rvsim *sim);
+
+long long rvsim_instructions(rvsim *sim);
+
+/*
+ * statistics in json, written to buf like snprintf(at most size bytes, terminated by '\0' if size > 0)
+ * return the length of the whole json(without '\0'), call again with a larger buf if it is >= size
+ */
+size_t rvsim_stats_json(rvsim *sim, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //RISCV_SIMULATOR_RVSIM_H
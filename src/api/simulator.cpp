@@ -0,0 +1,261 @@
+#include "simulator.h"
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include "../main/cpu.h"
+
+struct Simulator::Impl {
+  CPU<TracePolicy> cpu;
+  SymbolTable symbols;
+  // given to cpu again after a reset
+  struct Options {
+    BusPolicy bus_policy = BusPolicy::OldestFirst;
+    bool fusion = true, value_prediction = false;
+    unsigned prefetch = 0;
+    int prefetch_degree = 2, prefetch_distance = 1;
+    int lsb_latency = LSB_LATENCY;
+    std::string sandbox, input;
+    std::string samples; // interval samples(see IntervalSampler)
+    long long sample_interval = 10000;
+    bool sample_by_instructions = false;
+  } options;
+  bool failed = false;
+  std::string error;
+
+  void Apply() {
+    cpu.SetSymbols(&symbols);
+    cpu.SetBusPolicy(options.bus_policy);
+    cpu.SetFusion(options.fusion);
+    cpu.SetValuePrediction(options.value_prediction);
+    cpu.SetPrefetch(options.prefetch, options.prefetch_degree, options.prefetch_distance);
+    cpu.SetLsbLatency(options.lsb_latency);
+    cpu.SetSandbox(options.sandbox);
+    cpu.SetSampling(options.samples, options.sample_interval, options.sample_by_instructions);
+  }
+
+  // run func, a std::exception from the simulation finishes the program as failed
+  template <typename Func>
+  void Guard(Func func) {
+    try {
+      func();
+    }
+    catch (const std::exception &e) {
+      failed = true;
+      error = e.what();
+    }
+  }
+};
+
+namespace {
+
+bool InMemory(uint32_t addr, size_t size) {
+  return size <= size_t(MEMSIZE) && addr <= uint32_t(MEMSIZE) - size;
+}
+
+// kinds of prefetchers in a comma separated list, bit i is PrefetchKind(i), return false if a kind is unknown
+bool ParsePrefetch(const std::string &list, unsigned &ret) {
+  ret = 0;
+  size_t begin = 0;
+  while (begin <= list.size()) {
+    size_t end = list.find(',', begin);
+    if (end == std::string::npos) end = list.size();
+    std::string kind = list.substr(begin, end - begin);
+    if (kind == "next-line") ret |= 1u << int(PrefetchKind::NextLine);
+    else if (kind == "stride") ret |= 1u << int(PrefetchKind::Stride);
+    else if (kind == "stream") ret |= 1u << int(PrefetchKind::Stream);
+    else if (kind == "all") ret |= (1u << int(PrefetchKind::NUM)) - 1;
+    else if (kind != "none") return false;
+    begin = end + 1;
+  }
+  return true;
+}
+
+bool ParseSwitch(const std::string &value, bool &ret) {
+  if (value == "on") ret = true;
+  else if (value == "off") ret = false;
+  else return false;
+  return true;
+}
+
+}
+
+Simulator::Simulator() : impl(new Impl) {
+  impl->Apply();
+}
+
+Simulator::~Simulator() = default;
+
+bool Simulator::SetOption(const std::string &name, const std::string &value) {
+  if (name == "bus-policy") {
+    if (value == "oldest") impl->options.bus_policy = BusPolicy::OldestFirst;
+    else if (value == "loads") impl->options.bus_policy = BusPolicy::LoadsFirst;
+    else return false;
+  }
+  else if (name == "fusion") {
+    if (!ParseSwitch(value, impl->options.fusion)) return false;
+  }
+  else if (name == "value-prediction") {
+    if (!ParseSwitch(value, impl->options.value_prediction)) return false;
+  }
+  else if (name == "prefetch") {
+    if (!ParsePrefetch(value, impl->options.prefetch)) return false;
+  }
+  else if (name == "prefetch-degree") impl->options.prefetch_degree = std::atoi(value.c_str());
+  else if (name == "prefetch-distance") impl->options.prefetch_distance = std::atoi(value.c_str());
+  else if (name == "sandbox") impl->options.sandbox = value;
+  else if (name == "input") {
+    if (!impl->cpu.SetInput(value)) return false;
+    impl->options.input = value;
+  }
+  else if (name == "samples") {
+    if (!impl->cpu.SetSampling(value, impl->options.sample_interval, impl->options.sample_by_instructions)) return false;
+    impl->options.samples = value;
+  }
+  else if (name == "sample-interval") {
+    long long interval = std::atoll(value.c_str());
+    if (interval < 1) return false;
+    impl->options.sample_interval = interval;
+  }
+  else if (name == "sample-by") {
+    if (value == "cycles") impl->options.sample_by_instructions = false;
+    else if (value == "instructions") impl->options.sample_by_instructions = true;
+    else return false;
+  }
+  else if (name == "lsb-latency") {
+    impl->options.lsb_latency = std::atoi(value.c_str());
+    if (impl->options.lsb_latency < 1) return false;
+  }
+  else return false;
+  // in the middle of a program: the instructions in flight finish with the old options
+  impl->Guard([&]() {impl->cpu.Drain();});
+  impl->Apply();
+  return true;
+}
+
+void Simulator::Reset(bool keep_options) {
+  impl->cpu.Reset();
+  if (!keep_options) {
+    if (!impl->options.input.empty()) impl->cpu.SetInput("");
+    impl->options = Impl::Options();
+  }
+  impl->Apply();
+  impl->failed = false;
+  impl->error.clear();
+}
+
+bool Simulator::LoadHex(const char *data, size_t size) {
+  std::istringstream is(std::string(data, size));
+  return impl->cpu.Init(is);
+}
+
+bool Simulator::LoadHexFile(const std::string &path) {
+  std::ifstream is(path);
+  if (!is) return false;
+  return impl->cpu.Init(is);
+}
+
+bool Simulator::LoadBinary(uint32_t addr, const void *data, size_t size, uint32_t entry) {
+  if (!InMemory(addr, size) || entry >= uint32_t(MEMSIZE)) return false;
+  impl->cpu.WriteMemory(int(addr), static_cast<const u8 *>(data), int(size));
+  impl->cpu.SetPc(int(entry));
+  impl->cpu.SetBreak(int(addr + size));
+  return true;
+}
+
+void Simulator::EnableCosim() {
+  impl->cpu.EnableCosim();
+}
+
+bool Simulator::LoadSymbols(const std::string &elf) {
+  return impl->symbols.LoadElf(elf.c_str());
+}
+
+bool Simulator::Step(long long cycles) {
+  impl->Guard([&]() {
+    for (long long i = 0; i < cycles && !impl->cpu.Step(); ++i) {}
+  });
+  return Finished();
+}
+
+int Simulator::Run() {
+  impl->Guard([&]() {impl->cpu.run();});
+  return Failed() ? -1 : ReturnValue();
+}
+
+bool Simulator::Finished() const {
+  return impl->failed || impl->cpu.Finished();
+}
+
+bool Simulator::Failed() const {
+  return impl->failed || impl->cpu.CosimFailed();
+}
+
+const std::string &Simulator::Error() const {
+  if (impl->error.empty() && impl->cpu.CosimFailed()) impl->error = "cosim divergence";
+  return impl->error;
+}
+
+int Simulator::ReturnValue() const {
+  return impl->cpu.ReturnValue();
+}
+
+uint32_t Simulator::ReadRegister(int num) const {
+  if (num < 0 || num >= REGNUM) return 0;
+  return uint32_t(impl->cpu.ReadRegister(num));
+}
+
+void Simulator::WriteRegister(int num, uint32_t value) {
+  if (num < 0 || num >= REGNUM) return;
+  impl->Guard([&]() {impl->cpu.WriteRegister(num, int(value));});
+}
+
+bool Simulator::ReadMemory(uint32_t addr, void *data, size_t size) {
+  if (!InMemory(addr, size)) return false;
+  impl->Guard([&]() {impl->cpu.ReadMemory(int(addr), static_cast<u8 *>(data), int(size));});
+  return true;
+}
+
+bool Simulator::WriteMemory(uint32_t addr, const void *data, size_t size) {
+  if (!InMemory(addr, size)) return false;
+  impl->Guard([&]() {impl->cpu.WriteMemory(int(addr), static_cast<const u8 *>(data), int(size));});
+  return true;
+}
+
+bool Simulator::RunToPc(uint32_t pc, long long max_cycles) {
+  impl->Guard([&]() {
+    for (long long i = 0; i < max_cycles && !impl->cpu.Finished() && impl->cpu.HeadPc() != int(pc); ++i) impl->cpu.Step();
+  });
+  return !Finished() && impl->cpu.HeadPc() == int(pc);
+}
+
+bool Simulator::Drain() {
+  impl->Guard([&]() {impl->cpu.Drain();});
+  return !Finished();
+}
+
+void Simulator::FlushOutput() {
+  impl->cpu.FlushOutput();
+}
+
+long long Simulator::Cycles() const {
+  return impl->cpu.Cycles();
+}
+
+long long Simulator::Instructions() const {
+  return impl->cpu.Instructions();
+}
+
+void Simulator::PrintStats(std::ostream &os) const {
+  impl->cpu.PrintStats(os);
+}
+
+std::string Simulator::Stats() const {
+  std::ostringstream os;
+  PrintStats(os);
+  return os.str();
+}
+
+void Simulator::PrintProfile(std::ostream &flat, std::ostream &collapsed) const {
+  impl->cpu.PrintProfile(flat, collapsed);
+}
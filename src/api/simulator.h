@@ -0,0 +1,119 @@
+
+#ifndef RISCV_SIMULATOR_SIMULATOR_H
+#define RISCV_SIMULATOR_SIMULATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+
+/*
+ * embeddable simulator: one instance runs one program, instances share no state and can live in one process
+ * the C API(rvsim.h) wraps this class, main.cpp is a client of it
+ *
+ * usage: SetOption(...) -> LoadHex/LoadHexFile/LoadBinary -> [EnableCosim] -> Step(n)/Run() -> read results
+ * registers and memory can be read and written between steps: the pipeline is drained first(the instructions
+ * in flight are committed, the cycles are counted), cosim can't follow such changes
+ * a failure(an instruction that can't be decoded on the right path, or a cosim divergence) finishes the program,
+ * Failed() and Error() tell why
+ */
+class Simulator {
+public:
+  Simulator();
+
+  ~Simulator();
+
+  Simulator(const Simulator &) = delete;
+
+  Simulator &operator=(const Simulator &) = delete;
+
+  /*
+   * options(before the program starts), return false if name or value is unknown
+   * bus-policy: oldest | loads
+   * fusion, value-prediction: on | off
+   * prefetch: comma separated list of next-line, stride, stream, or all/none
+   * prefetch-degree, prefetch-distance: numbers
+   * lsb-latency: cycles of a LD/ST hitting the data cache(default LSB_LATENCY)
+   * sandbox: directory of the files opened by the program(default: none, open is refused)
+   * input: file read by the program as stdin(default: none)
+   * samples: file of the interval time series(csv, binary if it ends with .bin, see IntervalSampler, CounterTrace only)
+   * sample-interval: cycles or instructions per sample(default 10000), sample-by: cycles | instructions
+   * options can be changed in the middle of a program: the instructions in flight finish first
+   */
+  bool SetOption(const std::string &name, const std::string &value);
+
+  // back to a simulator without a program(cheaper than a new Simulator, see CPU::Reset), the symbols are kept
+  void Reset(bool keep_options = true);
+
+  /*
+   * program in hex text(the format of the test data: @address followed by bytes), the entry is the first address
+   * return false for a malformed image or a byte outside memory, Reset before loading another program
+   */
+  bool LoadHex(const char *data, size_t size);
+
+  bool LoadHexFile(const std::string &path);
+
+  // raw bytes at addr, the program starts at entry
+  bool LoadBinary(uint32_t addr, const void *data, size_t size, uint32_t entry);
+
+  // check every committed instruction against the reference model(after loading, before the program starts)
+  void EnableCosim();
+
+  // name pcs in the profile with the symbols of an elf file
+  bool LoadSymbols(const std::string &elf);
+
+  // run at most cycles cycles, return true if the program is finished
+  bool Step(long long cycles);
+
+  // run until the instruction at pc is the oldest in flight(about to commit), at most max_cycles cycles
+  // return false if the program finished or max_cycles passed before that
+  bool RunToPc(uint32_t pc, long long max_cycles);
+
+  // let the instructions in flight commit without issuing new ones(the cycles are counted, see CPU::Drain)
+  // return false if the program finished(or failed) meanwhile
+  bool Drain();
+
+  // write the stdout/stderr of the program buffered so far(e.g. before fork, or the children would write it again)
+  void FlushOutput();
+
+  // run until the program is finished, return the exit code(a0 & 255), -1 if it failed
+  int Run();
+
+  bool Finished() const;
+
+  bool Failed() const;
+
+  const std::string &Error() const;
+
+  // exit code(a0 & 255) after the program is finished
+  int ReturnValue() const;
+
+  // committed value of x[num](0 ~ 31)
+  uint32_t ReadRegister(int num) const;
+
+  void WriteRegister(int num, uint32_t value);
+
+  // return false if [addr, addr + size) is not in memory
+  bool ReadMemory(uint32_t addr, void *data, size_t size);
+
+  bool WriteMemory(uint32_t addr, const void *data, size_t size);
+
+  long long Cycles() const;
+
+  long long Instructions() const;
+
+  // statistics in json(see CPU::PrintStats)
+  void PrintStats(std::ostream &os) const;
+
+  std::string Stats() const;
+
+  // per-pc profile(CounterTrace only)
+  void PrintProfile(std::ostream &flat, std::ostream &collapsed) const;
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+};
+
+#endif //RISCV_SIMULATOR_SIMULATOR_H
@@ -0,0 +1,66 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include "batch_interpreter.h"
+
+/*
+ * run the same program on many harts with the batched interpreter, report the aggregate throughput
+ *
+ * usage: batch [--harts <n>] [--input-reg <num>] [--input-addr <hex>] [--max-instructions <n>] < program
+ * --harts: number of harts(default 1024)
+ * --input-reg: x[num] of hart i starts as i(the input of a sweep)
+ * --input-addr: the word at addr in the memory of hart i starts as i
+ * --max-instructions: stop a hart after n instructions(default 0: no limit)
+ */
+int main(int argc, char *argv[]) {
+  int harts = 1024, input_reg = -1;
+  long long input_addr = -1, max_instructions = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--harts") == 0 && i + 1 < argc) harts = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--input-reg") == 0 && i + 1 < argc) input_reg = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--input-addr") == 0 && i + 1 < argc) input_addr = strtoll(argv[++i], nullptr, 16);
+    else if (strcmp(argv[i], "--max-instructions") == 0 && i + 1 < argc) max_instructions = atoll(argv[++i]);
+  }
+  if (harts <= 0 || input_reg >= REGNUM || input_addr > MEMSIZE - 4) {
+    std::cerr << "bad arguments" << std::endl;
+    return 1;
+  }
+  std::unique_ptr<Memory> image(new Memory);
+  int pc = 0;
+  if (!image->InitInstructions(std::cin, pc)) {
+    std::cerr << "bad program" << std::endl;
+    return 1;
+  }
+  BatchInterpreter batch(*image, pc, harts);
+  for (int i = 0; i < harts; ++i) {
+    if (input_reg > 0) batch.WriteRegister(i, input_reg, i);
+    if (input_addr >= 0) {
+      u8 word[4] = {u8(i), u8(i >> 8), u8(i >> 16), u8(i >> 24)};
+      batch.WriteMemory(i, int(input_addr), word, 4);
+    }
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  batch.Run(max_instructions);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  int count[4] = {0};
+  std::map<int, int> exit_codes;
+  for (int i = 0; i < harts; ++i) {
+    ++count[int(batch.State(i))];
+    if (batch.State(i) == BatchInterpreter::HartState::Finished) ++exit_codes[batch.ReturnValue(i)];
+  }
+  std::cout << "harts: " << harts << " (finished " << count[int(BatchInterpreter::HartState::Finished)]
+            << ", failed " << count[int(BatchInterpreter::HartState::Failed)]
+            << ", limit " << count[int(BatchInterpreter::HartState::Limit)] << ")" << std::endl;
+  std::cout << "instructions: " << batch.Instructions() << ", " << double(batch.Instructions()) / std::max(1LL, batch.Groups())
+            << " harts per decoded instruction" << std::endl;
+  std::cout << "time: " << seconds << " s, " << batch.Instructions() / seconds / 1e6 << " million guest instructions per second" << std::endl;
+  for (const std::pair<const int, int> &tmp : exit_codes) {
+    std::cout << "exit " << tmp.first << ": " << tmp.second << " harts" << std::endl;
+  }
+  return (count[int(BatchInterpreter::HartState::Failed)] > 0) ? 1 : 0;
+}
@@ -0,0 +1,242 @@
+#include "batch_interpreter.h"
+#include <climits>
+#include <cstring>
+#include <exception>
+#include "../units/csr.h"
+#include "../units/muldiv.h"
+#include "../units/rss.h"
+
+BatchInterpreter::BatchInterpreter(const Memory &image, int pc, int harts)
+    : image(new Memory(image)), harts(harts), x(size_t(REGNUM) * harts, 0), pc(harts, pc), state(harts, HartState::Running),
+      instret(harts, 0), pages(size_t(harts) * PAGENUM) {
+  value1.resize(harts);
+  value2.resize(harts);
+  value.resize(harts);
+}
+
+void BatchInterpreter::WriteMemory(int hart, int addr, const u8 *data, int size) {
+  for (int i = 0; i < size; ++i) Store(hart, addr + i, 1, data[i]);
+}
+
+u8 BatchInterpreter::ReadByte(int hart, int addr) const {
+  return u8(Load(hart, addr, 1));
+}
+
+void BatchInterpreter::Run(long long max_instructions) {
+  active.clear();
+  for (int i = 0; i < harts; ++i) {
+    if (state[i] == HartState::Running) active.push_back(i);
+  }
+  while (!active.empty()) {
+    int now = INT_MAX;
+    for (int hart : active) now = std::min(now, pc[hart]);
+    group.clear();
+    for (int hart : active) {
+      if (pc[hart] == now) group.push_back(hart);
+    }
+    try {
+      const Decoded &tmp = Decode(group[0], now);
+      if (tmp.end) {
+        for (int hart : group) state[hart] = HartState::Finished;
+      }
+      else {
+        Execute(tmp.ins, now);
+      }
+    }
+    catch (const std::exception &) {
+      for (int hart : group) state[hart] = HartState::Failed;
+    }
+    if (max_instructions > 0) {
+      for (int hart : group) {
+        if (state[hart] == HartState::Running && instret[hart] >= max_instructions) state[hart] = HartState::Limit;
+      }
+    }
+    size_t size = 0;
+    for (int hart : active) {
+      if (state[hart] == HartState::Running) active[size++] = hart;
+    }
+    active.resize(size);
+  }
+}
+
+const BatchInterpreter::Decoded &BatchInterpreter::Decode(int hart, int pc) {
+  std::unordered_map<int, Decoded>::iterator iter = decoded.find(pc);
+  if (iter != decoded.end()) return iter->second;
+  if (pc < 0 || pc > MEMSIZE - 2) throw std::exception();
+  Decoded tmp;
+  int len = 4;
+  u32 code = InstructionUnit::Expand(Load(hart, pc, std::min(4, MEMSIZE - pc)), len);
+  if (code == 0x0ff00513) tmp.end = true;
+  else tmp.ins = iu.DecodeSet(code, len);
+  return decoded.emplace(pc, tmp).first->second;
+}
+
+void BatchInterpreter::Execute(const InstructionUnit::Instruction &ins, int pc) {
+  switch (ins.opt) {
+    case OptType::LB : case OptType::LH : case OptType::LW : case OptType::LBU : case OptType::LHU :
+    case OptType::SB : case OptType::SH : case OptType::SW :
+      ExecuteMemory(ins, pc);
+      return;
+    case OptType::MUL : case OptType::MULH : case OptType::MULHSU : case OptType::MULHU :
+    case OptType::DIV : case OptType::DIVU : case OptType::REM : case OptType::REMU :
+      ExecuteMulDiv(ins, pc);
+      return;
+    case OptType::ECALL : {
+      // only exit(exit code in a0), the other system calls fail the hart
+      for (int hart : group) {
+        int number = x[17 * harts + hart];
+        state[hart] = (number == 93 || number == 94) ? HartState::Finished : HartState::Failed;
+      }
+      return;
+    }
+    case OptType::CSRRW : case OptType::CSRRS : case OptType::CSRRC :
+    case OptType::CSRRWI : case OptType::CSRRSI : case OptType::CSRRCI :
+      ExecuteCsr(ins, pc);
+      return;
+    default: break;
+  }
+  int n = int(group.size());
+  const int *a = Gather(ins.rs1, value1), *b = Gather(ins.rs2, value2);
+  // imm as issue gives it to the reservation station
+  int imm = ins.imm;
+  if (ins.opt == OptType::AUIPC) imm = ins.imm + pc;
+  else if (ins.opt == OptType::JAL) imm = pc + ins.len;
+  ReservationStation::ComputeLanes(alu, ins.opt, imm, ins.len, a, b, value.data(), n);
+  switch (ins.opt) {
+    case OptType::BEQ : case OptType::BNE : case OptType::BLT : case OptType::BGE : case OptType::BLTU : case OptType::BGEU : {
+      // value is the offset of next pc
+      for (int i = 0; i < n; ++i) this->pc[group[i]] = pc + value[i];
+      for (int hart : group) ++instret[hart];
+      total += n;
+      ++groups;
+      return;
+    }
+    case OptType::JAL : {
+      Scatter(ins.rd);
+      Next(pc + ins.imm);
+      return;
+    }
+    case OptType::JALR : {
+      // value is the target, rd gets the link
+      for (int i = 0; i < n; ++i) {
+        this->pc[group[i]] = value[i];
+        value[i] = pc + ins.len;
+      }
+      Scatter(ins.rd);
+      for (int hart : group) ++instret[hart];
+      total += n;
+      ++groups;
+      return;
+    }
+    default: {
+      Scatter(ins.rd);
+      Next(pc + ins.len);
+    }
+  }
+}
+
+void BatchInterpreter::ExecuteMemory(const InstructionUnit::Instruction &ins, int pc) {
+  const OptMeta &meta = OptInfo(ins.opt);
+  int size = meta.size;
+  bool store = meta.store;
+  int n = int(group.size());
+  const int *a = Gather(ins.rs1, value1), *b = Gather(ins.rs2, value2);
+  for (int i = 0; i < n; ++i) {
+    int hart = group[i];
+    int addr = a[i] + ins.imm;
+    if (addr < 0 || addr > MEMSIZE - size) {
+      // the hart fails, the rest of the group goes on
+      state[hart] = HartState::Failed;
+      continue;
+    }
+    if (store) {
+      Store(hart, addr, size, u32(b[i]));
+      continue;
+    }
+    u32 tmp = Load(hart, addr, size);
+    if (ins.opt == OptType::LB || ins.opt == OptType::LH) value[i] = Memory::SignExtend(tmp, 8 * size);
+    else value[i] = int(tmp);
+  }
+  if (!store) Scatter(ins.rd);
+  Next(pc + ins.len);
+}
+
+void BatchInterpreter::ExecuteMulDiv(const InstructionUnit::Instruction &ins, int pc) {
+  int n = int(group.size());
+  const int *a = Gather(ins.rs1, value1), *b = Gather(ins.rs2, value2);
+  if (ins.opt == OptType::MUL || ins.opt == OptType::MULH || ins.opt == OptType::MULHSU || ins.opt == OptType::MULHU) {
+    for (int i = 0; i < n; ++i) value[i] = MultiplyUnit::Compute(ins.opt, a[i], b[i]);
+  }
+  else {
+    for (int i = 0; i < n; ++i) value[i] = DivideUnit::Compute(ins.opt, a[i], b[i]);
+  }
+  Scatter(ins.rd);
+  Next(pc + ins.len);
+}
+
+void BatchInterpreter::ExecuteCsr(const InstructionUnit::Instruction &ins, int pc) {
+  int n = int(group.size());
+  for (int i = 0; i < n; ++i) {
+    int hart = group[i];
+    long long counters[COUNTER_NUM] = {instret[hart], instret[hart], instret[hart]};
+    u32 tmp = 0;
+    if (!ReadCounterCsr(ins.imm, counters, tmp) || CsrWrites(ins.opt, ins.rs1)) state[hart] = HartState::Failed;
+    value[i] = int(tmp);
+  }
+  Scatter(ins.rd);
+  Next(pc + ins.len);
+}
+
+const int *BatchInterpreter::Gather(int num, std::vector<int> &dest) {
+  if (int(group.size()) == harts) return &x[size_t(num) * harts]; // all harts: the group is 0 ~ harts - 1
+  const int *row = &x[size_t(num) * harts];
+  for (size_t i = 0; i < group.size(); ++i) dest[i] = row[group[i]];
+  return dest.data();
+}
+
+void BatchInterpreter::Scatter(int num) {
+  if (num == 0) return;
+  int *row = &x[size_t(num) * harts];
+  if (int(group.size()) == harts) {
+    memcpy(row, value.data(), sizeof (int) * harts);
+    return;
+  }
+  for (size_t i = 0; i < group.size(); ++i) row[group[i]] = value[i];
+}
+
+void BatchInterpreter::Next(int next_pc) {
+  for (int hart : group) {
+    pc[hart] = next_pc;
+    ++instret[hart];
+  }
+  total += int(group.size());
+  ++groups;
+}
+
+u32 BatchInterpreter::Load(int hart, int addr, int size) const {
+  u32 ret = 0;
+  for (int i = size - 1; i >= 0; --i) {
+    int unit = addr + i;
+    const std::unique_ptr<u8[]> &page = pages[size_t(hart) * PAGENUM + unit / PAGESIZE];
+    ret = (ret << 8) | ((page) ? page[unit % PAGESIZE] : image->LoadByte(unit));
+  }
+  return ret;
+}
+
+void BatchInterpreter::Store(int hart, int addr, int size, u32 value) {
+  for (int i = 0; i < size; ++i) {
+    int unit = addr + i;
+    WritablePage(hart, unit / PAGESIZE)[unit % PAGESIZE] = u8(value >> (8 * i));
+  }
+}
+
+u8 *BatchInterpreter::WritablePage(int hart, int page) {
+  std::unique_ptr<u8[]> &ret = pages[size_t(hart) * PAGENUM + page];
+  if (!ret) {
+    // copy on the first store
+    ret.reset(new u8[PAGESIZE]);
+    int begin = page * PAGESIZE;
+    for (int i = 0; i < PAGESIZE; ++i) ret[i] = (begin + i < MEMSIZE) ? u8(image->LoadByte(begin + i)) : 0;
+  }
+  return ret.get();
+}
@@ -0,0 +1,107 @@
+
+#ifndef RISCV_SIMULATOR_BATCH_INTERPRETER_H
+#define RISCV_SIMULATOR_BATCH_INTERPRETER_H
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "../storage/memory.h"
+#include "../units/instuction.h"
+#include "../units/alu.h"
+
+/*
+ * functional interpreter of many harts running the same program(e.g. over different inputs) in lockstep
+ * registers are kept in structure-of-arrays layout: x[num][hart], so a register of all harts is contiguous
+ * each step takes the group of harts at the smallest pc(harts behind catch up, diverged paths meet again),
+ * decodes the instruction once and executes it on all of them(ALU operations: ReservationStation::ComputeLanes)
+ * every hart has a private copy-on-write view of the program image: a page is copied at its first store
+ * (the decoded instructions are cached by pc: the program must not modify its own code)
+ */
+class BatchInterpreter {
+public:
+  enum class HartState : u8 {Running, Finished, Failed, Limit};
+
+  BatchInterpreter(const Memory &image, int pc, int harts);
+
+  int Harts() const {return harts;}
+
+  int ReadRegister(int hart, int num) const {return x[num * harts + hart];}
+
+  void WriteRegister(int hart, int num, int value) {
+    if (num != 0) x[num * harts + hart] = value;
+  }
+
+  // addr + size should be in memory
+  void WriteMemory(int hart, int addr, const u8 *data, int size);
+
+  u8 ReadByte(int hart, int addr) const;
+
+  // run until every hart finished, failed or executed max_instructions(0: no limit)
+  void Run(long long max_instructions = 0);
+
+  HartState State(int hart) const {return state[hart];}
+
+  // a0 & 255 of a finished hart
+  int ReturnValue(int hart) const {return x[10 * harts + hart] & 255;}
+
+  // instructions executed by a hart, by all harts
+  long long Instructions(int hart) const {return instret[hart];}
+
+  long long Instructions() const {return total;}
+
+  // groups executed(instructions decoded), Instructions() / Groups() is the average lanes per instruction
+  long long Groups() const {return groups;}
+
+private:
+  static constexpr int PAGESIZE = 4096;
+  static constexpr int PAGENUM = (MEMSIZE + PAGESIZE - 1) / PAGESIZE;
+
+  std::unique_ptr<Memory> image;
+  InstructionUnit iu;
+  ArithmeticLogicUnit alu;
+  int harts;
+  std::vector<int> x; // x[num * harts + hart]
+  std::vector<int> pc;
+  std::vector<HartState> state;
+  std::vector<long long> instret;
+  std::vector<std::unique_ptr<u8[]>> pages; // pages[hart * PAGENUM + page], nullptr: not written, read from image
+  struct Decoded {
+    InstructionUnit::Instruction ins;
+    bool end = false; // .END
+  };
+  std::unordered_map<int, Decoded> decoded; // by pc
+  long long total = 0, groups = 0;
+
+  std::vector<int> active, group; // harts running, harts at the pc of this step
+  std::vector<int> value1, value2, value; // operands and results of the group
+
+  // the instruction at pc(in the memory of hart), throw std::exception if it can't be decoded
+  const Decoded &Decode(int hart, int pc);
+
+  void Execute(const InstructionUnit::Instruction &ins, int pc);
+
+  void ExecuteMemory(const InstructionUnit::Instruction &ins, int pc);
+
+  void ExecuteMulDiv(const InstructionUnit::Instruction &ins, int pc);
+
+  // counters only(see csr.h): cycle, time and instret are the instructions of the hart, hpmcounters read 0
+  // a write or another csr fails the hart
+  void ExecuteCsr(const InstructionUnit::Instruction &ins, int pc);
+
+  // x[num] of the group: the register row itself if the group is all harts, else gathered to dest
+  const int *Gather(int num, std::vector<int> &dest);
+
+  // value to x[num] of the group
+  void Scatter(int num);
+
+  // the group goes to next pc(the same for all) and counts the instruction
+  void Next(int next_pc);
+
+  u32 Load(int hart, int addr, int size) const;
+
+  void Store(int hart, int addr, int size, u32 value);
+
+  u8 *WritablePage(int hart, int page);
+};
+
+#endif //RISCV_SIMULATOR_BATCH_INTERPRETER_H
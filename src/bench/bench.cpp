@@ -0,0 +1,241 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include "../main/cpu.h"
+#include "kernels.h"
+
+/*
+ * host-side benchmark of the simulator
+ * micro: per-unit benchmarks in ns per operation
+ * kernels: end-to-end simulated cycles and instructions per second over synthetic RV32I kernels
+ *
+ * usage: bench [--out <file>] [--scale <n>] [--min-time <seconds>]
+ * --out: also write the results in json to <file>, to diff between builds
+ * --scale: multiply the iterations of every kernel
+ */
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double min_time = 0.2;
+volatile int sink = 0;
+
+double Seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/*
+ * call func(batch) until min_time is reached, func runs batch operations
+ * return ns per operation
+ */
+double Measure(const std::function<void(int)> &func) {
+  int batch = 1024;
+  long long ops = 0;
+  Clock::time_point start = Clock::now();
+  double elapsed = 0;
+  while (elapsed < min_time) {
+    func(batch);
+    ops += batch;
+    elapsed = Seconds(start);
+    if (elapsed < min_time / 16) batch *= 2;
+  }
+  return elapsed * 1e9 / double(ops);
+}
+
+double BenchCircularQueue() {
+  CircularQueue<int, ROBSIZE> queue;
+  return Measure([&](int batch) {
+    for (int i = 0; i < batch; ++i) {
+      queue.push(i);
+      if (queue.length() > ROBSIZE / 2) queue.pop();
+      int sum = 0;
+      for (CircularQueue<int, ROBSIZE>::iterator iter = queue.front(); iter != queue.end(); ++iter) sum += *iter;
+      sink = sink + sum;
+    }
+  });
+}
+
+// a full rss where no entry matches the bus: every entry is compared with every bus entry
+double BenchRssCheckBus() {
+  std::unique_ptr<Register> reg(new Register);
+  InstructionUnit::Instruction ins;
+  ins.type = InstructionType::I;
+  ins.opt = OptType::ADDI;
+  for (int i = 1; i < REGNUM; ++i) {
+    ins.rd = i;
+    reg->Rename(ins, 0); // x[i] waits for an unfinished producer
+  }
+  std::unique_ptr<ReservationStation> rss(new ReservationStation);
+  for (int i = 0; i < RSSSIZE; ++i) {
+    ins.type = InstructionType::R;
+    ins.opt = OptType::ADD;
+    ins.rd = 0; // no physical register is taken
+    ins.rs1 = (i + 3) % (REGNUM - 1) + 1;
+    ins.rs2 = (i + 7) % (REGNUM - 1) + 1;
+    rss->issue(i, ins, reg->Rename(ins, i * 4), i * 4);
+  }
+  CommonDataBus ready_bus;
+  for (int i = 0; i < CDBSIZE && i < int(BusPort::NUM); ++i) {
+    ready_bus.Request(BusPort(i), 1000 + i, i, i + 1); // committed registers, nobody waits for them
+  }
+  ready_bus.Arbitrate(BusPolicy::OldestFirst);
+  return Measure([&](int batch) {
+    for (int i = 0; i < batch; ++i) rss->CheckBus(ready_bus);
+  });
+}
+
+// a LD forwarded from the oldest of a full lsb of STs: the whole lsb is percolated
+double BenchLsbExecute() {
+  std::unique_ptr<LoadStoreBuffer> lsb(new LoadStoreBuffer);
+  CommonDataBus cdb;
+  for (int i = 0; i < LSBSIZE - 1; ++i) {
+    lsb->Execute(OptType::SW, 0x1000 + 4 * i, i, i, -1, cdb, UnitPort(FU_NUM - 1));
+    cdb.Arbitrate(BusPolicy::OldestFirst);
+    cdb.clear();
+  }
+  lsb->flush();
+  return Measure([&](int batch) {
+    for (int i = 0; i < batch; ++i) {
+      lsb->Execute(OptType::LW, 0x1000, 0, 100, 1, cdb, UnitPort(FU_NUM - 1));
+      cdb.Arbitrate(BusPolicy::OldestFirst);
+      sink = sink + cdb.TryGetValue(100).second;
+      cdb.clear();
+    }
+  });
+}
+
+// decode codes round and round
+double MeasureDecode(const std::vector<u32> &codes) {
+  InstructionUnit iu;
+  size_t next = 0;
+  return Measure([&](int batch) {
+    for (int i = 0; i < batch; ++i) {
+      const InstructionUnit::Instruction &ins = iu.DecodeSet(codes[next]);
+      if (++next == codes.size()) next = 0;
+      sink = sink + ins.imm + int(ins.opt);
+    }
+  });
+}
+
+// the instructions of the kernels
+double BenchDecode() {
+  std::vector<u32> codes;
+  for (const KernelBuilder &k : {AluChainKernel(1), BranchKernel(1), LoadStoreKernel(1), CallReturnKernel(1)}) {
+    for (u32 code : k.Code()) {
+      if (code != 0) codes.push_back(code);
+    }
+  }
+  return MeasureDecode(codes);
+}
+
+// random valid encodings(every format, RV32M and the CSR instructions included): the opcode is not predictable
+double BenchDecodeMix() {
+  std::mt19937 rng(1);
+  InstructionUnit iu;
+  std::vector<u32> codes;
+  while (codes.size() < 4096) {
+    u32 code = u32(rng()) | 0b11;
+    try {
+      iu.DecodeSet(code);
+    }
+    catch (const std::exception &) {
+      continue;
+    }
+    codes.push_back(code);
+  }
+  return MeasureDecode(codes);
+}
+
+struct KernelResult {
+  int ret = 0;
+  long long cycles = 0;
+  long long instructions = 0;
+  double seconds = 0;
+};
+
+KernelResult RunKernel(const KernelBuilder &kernel) {
+  std::unique_ptr<CPU<TracePolicy>> cpu(new CPU<TracePolicy>);
+  std::istringstream is(kernel.Hex());
+  if (!cpu->Init(is)) throw std::exception();
+  KernelResult ret;
+  Clock::time_point start = Clock::now();
+  ret.ret = cpu->run();
+  ret.seconds = Seconds(start);
+  ret.cycles = cpu->Cycles();
+  ret.instructions = cpu->Instructions();
+  return ret;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  const char *out_file = nullptr;
+  double scale = 1;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_file = argv[++i];
+    else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) scale = atof(argv[++i]);
+    else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) min_time = atof(argv[++i]);
+  }
+
+  std::pair<const char *, double (*)()> micros[] = {
+      {"circular_queue", BenchCircularQueue},
+      {"rss_check_bus", BenchRssCheckBus},
+      {"lsb_execute", BenchLsbExecute},
+      {"decode", BenchDecode},
+      {"decode_mix", BenchDecodeMix},
+  };
+  std::pair<const char *, KernelBuilder> kernels[] = {
+      {"alu_chain", AluChainKernel(int(20000 * scale))},
+      {"branch", BranchKernel(int(10000 * scale))},
+      {"load_store", LoadStoreKernel(int(20000 * scale))},
+      {"array_walk", ArrayWalkKernel(int(20000 * scale))},
+      {"call_return", CallReturnKernel(int(10000 * scale))},
+  };
+
+  std::ostringstream os;
+  JsonWriter json(os);
+  json.BeginObject();
+  json.Value("trace", TracePolicy::Name());
+  json.BeginObject("micro");
+  std::cout << std::left << std::setw(16) << "micro" << std::right << std::setw(12) << "ns/op" << std::endl;
+  for (const auto &micro : micros) {
+    double ns = micro.second();
+    std::cout << std::left << std::setw(16) << micro.first << std::right << std::setw(12) << std::fixed
+              << std::setprecision(2) << ns << std::endl;
+    json.BeginObject(micro.first);
+    json.Value("ns_per_op", ns);
+    json.EndObject();
+  }
+  json.EndObject();
+
+  json.BeginObject("kernels");
+  std::cout << std::endl << std::left << std::setw(16) << "kernel" << std::right << std::setw(12) << "cycles"
+            << std::setw(14) << "instructions" << std::setw(10) << "ret" << std::setw(14) << "cycles/s"
+            << std::setw(14) << "inst/s" << std::endl;
+  for (const auto &kernel : kernels) {
+    KernelResult result = RunKernel(kernel.second);
+    double cps = result.cycles / result.seconds, ips = result.instructions / result.seconds;
+    std::cout << std::left << std::setw(16) << kernel.first << std::right << std::setw(12) << result.cycles
+              << std::setw(14) << result.instructions << std::setw(10) << result.ret << std::setw(14)
+              << std::setprecision(0) << cps << std::setw(14) << ips << std::endl;
+    json.BeginObject(kernel.first);
+    json.Value("ret", result.ret);
+    json.Value("cycles", result.cycles);
+    json.Value("instructions", result.instructions);
+    json.Value("seconds", result.seconds);
+    json.Value("cycles_per_second", cps);
+    json.Value("instructions_per_second", ips);
+    json.EndObject();
+  }
+  json.EndObject();
+  json.EndObject();
+
+  if (out_file != nullptr) {
+    std::ofstream ofs(out_file);
+    ofs << os.str();
+  }
+  return 0;
+}
@@ -0,0 +1,218 @@
+
+#ifndef RISCV_SIMULATOR_KERNELS_H
+#define RISCV_SIMULATOR_KERNELS_H
+
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../utils/config.h"
+
+/*
+ * synthetic RV32I kernels for the benchmark, built directly as machine code
+ * every kernel ends with .END(addi a0, zero, 255), a0 holds a checksum
+ */
+class KernelBuilder {
+public:
+  enum Reg {
+    ZERO = 0, RA = 1, SP = 2, T0 = 5, T1 = 6, T2 = 7, S0 = 8, S1 = 9, A0 = 10, A1 = 11, T3 = 28, T4 = 29
+  };
+
+  // byte address of the next instruction
+  int Here() const {return int(code.size()) * 4;}
+
+  void R(u32 f7, int rd, int rs1, int rs2, u32 f3) {
+    Emit((f7 << 25) | (u32(rs2) << 20) | (u32(rs1) << 15) | (f3 << 12) | (u32(rd) << 7) | 0b0110011);
+  }
+
+  void I(u32 op, int rd, int rs1, int imm, u32 f3) {
+    Emit((u32(imm & 0xfff) << 20) | (u32(rs1) << 15) | (f3 << 12) | (u32(rd) << 7) | op);
+  }
+
+  void S(int rs1, int rs2, int imm, u32 f3) {
+    u32 tmp = u32(imm);
+    Emit(((tmp >> 5 & 0x7f) << 25) | (u32(rs2) << 20) | (u32(rs1) << 15) | (f3 << 12) | ((tmp & 0x1f) << 7) | 0b0100011);
+  }
+
+  // target: byte address
+  void B(int rs1, int rs2, int target, u32 f3) {
+    u32 tmp = u32(target - Here());
+    Emit(((tmp >> 12 & 1) << 31) | ((tmp >> 5 & 0x3f) << 25) | (u32(rs2) << 20) | (u32(rs1) << 15) | (f3 << 12)
+         | ((tmp >> 1 & 0xf) << 8) | ((tmp >> 11 & 1) << 7) | 0b1100011);
+  }
+
+  void JAL(int rd, int target) {
+    u32 tmp = u32(target - Here());
+    Emit(((tmp >> 20 & 1) << 31) | ((tmp >> 1 & 0x3ff) << 21) | ((tmp >> 11 & 1) << 20) | ((tmp >> 12 & 0xff) << 12)
+         | (u32(rd) << 7) | 0b1101111);
+  }
+
+  void JALR(int rd, int rs1, int imm) {I(0b1100111, rd, rs1, imm, 0);}
+
+  void LUI(int rd, int imm) {Emit((u32(imm) & 0xfffff000) | (u32(rd) << 7) | 0b0110111);}
+
+  void ADDI(int rd, int rs1, int imm) {I(0b0010011, rd, rs1, imm, 0b000);}
+  void XORI(int rd, int rs1, int imm) {I(0b0010011, rd, rs1, imm, 0b100);}
+  void ANDI(int rd, int rs1, int imm) {I(0b0010011, rd, rs1, imm, 0b111);}
+  void SLLI(int rd, int rs1, int shamt) {I(0b0010011, rd, rs1, shamt, 0b001);}
+  void SRLI(int rd, int rs1, int shamt) {I(0b0010011, rd, rs1, shamt, 0b101);}
+  void ADD(int rd, int rs1, int rs2) {R(0, rd, rs1, rs2, 0b000);}
+  void SUB(int rd, int rs1, int rs2) {R(0b0100000, rd, rs1, rs2, 0b000);}
+  void XOR(int rd, int rs1, int rs2) {R(0, rd, rs1, rs2, 0b100);}
+  void OR(int rd, int rs1, int rs2) {R(0, rd, rs1, rs2, 0b110);}
+  void LW(int rd, int rs1, int imm) {I(0b0000011, rd, rs1, imm, 0b010);}
+  void SW(int rs1, int rs2, int imm) {S(rs1, rs2, imm, 0b010);}
+  void BEQ(int rs1, int rs2, int target) {B(rs1, rs2, target, 0b000);}
+  void BNE(int rs1, int rs2, int target) {B(rs1, rs2, target, 0b001);}
+  void BLT(int rs1, int rs2, int target) {B(rs1, rs2, target, 0b100);}
+
+  // load a 32-bit constant with lui + addi
+  void LI(int rd, int value) {
+    int lo = (value << 20) >> 20;
+    LUI(rd, value - lo);
+    ADDI(rd, rd, lo);
+  }
+
+  void End() {Emit(0x0ff00513);}
+
+  void Emit(u32 ins) {code.push_back(ins);}
+
+  // overwrite the instruction at byte address addr(used to patch forward jumps)
+  void Patch(int addr, u32 ins) {code[addr / 4] = ins;}
+
+  const std::vector<u32> &Code() const {return code;}
+
+  // program in the format read by Memory::InitInstructions
+  std::string Hex() const {
+    std::ostringstream os;
+    os << "@00000000" << std::hex << std::uppercase << std::setfill('0');
+    for (int i = 0; i < int(code.size()) * 4; ++i) {
+      os << ((i % 16 == 0) ? '\n' : ' ') << std::setw(2) << ((code[i / 4] >> (8 * (i % 4))) & 0xff);
+    }
+    os << "\n";
+    return os.str();
+  }
+
+private:
+  std::vector<u32> code;
+};
+
+// dependent chain of arithmetic, one backward branch per 8 instructions
+inline KernelBuilder AluChainKernel(int iterations) {
+  KernelBuilder k;
+  using R = KernelBuilder::Reg;
+  k.LI(R::T0, iterations);
+  int loop = k.Here();
+  k.ADD(R::T1, R::T1, R::T0);
+  k.XOR(R::T2, R::T2, R::T1);
+  k.SLLI(R::T3, R::T2, 1);
+  k.SUB(R::T1, R::T3, R::T1);
+  k.SRLI(R::T4, R::T1, 3);
+  k.OR(R::T2, R::T2, R::T4);
+  k.ADDI(R::T0, R::T0, -1);
+  k.BNE(R::T0, R::ZERO, loop);
+  k.ADD(R::A0, R::T2, R::ZERO);
+  k.End();
+  return k;
+}
+
+// xorshift random numbers, two data-dependent branches per iteration
+inline KernelBuilder BranchKernel(int iterations) {
+  KernelBuilder k;
+  using R = KernelBuilder::Reg;
+  k.LI(R::T0, iterations);
+  k.LI(R::S0, 12345);
+  int loop = k.Here();
+  k.SLLI(R::T1, R::S0, 13);
+  k.XOR(R::S0, R::S0, R::T1);
+  k.SRLI(R::T1, R::S0, 17);
+  k.XOR(R::S0, R::S0, R::T1);
+  k.SLLI(R::T1, R::S0, 5);
+  k.XOR(R::S0, R::S0, R::T1);
+  k.ANDI(R::T2, R::S0, 1);
+  k.BEQ(R::T2, R::ZERO, k.Here() + 8);
+  k.ADDI(R::S1, R::S1, 3);
+  k.ANDI(R::T2, R::S0, 6);
+  k.BNE(R::T2, R::ZERO, k.Here() + 8);
+  k.XORI(R::S1, R::S1, 0x55);
+  k.ADDI(R::T0, R::T0, -1);
+  k.BNE(R::T0, R::ZERO, loop);
+  k.ADD(R::A0, R::S1, R::ZERO);
+  k.End();
+  return k;
+}
+
+// stream over an array of 256 words: load, add, store
+inline KernelBuilder LoadStoreKernel(int iterations) {
+  KernelBuilder k;
+  using R = KernelBuilder::Reg;
+  k.LI(R::S1, (iterations + 255) / 256);
+  int outer = k.Here();
+  k.LUI(R::S0, 0x10000);
+  k.LI(R::T0, 256);
+  int loop = k.Here();
+  k.LW(R::T1, R::S0, 0);
+  k.ADD(R::T1, R::T1, R::T0);
+  k.SW(R::S0, R::T1, 0);
+  k.ADD(R::A1, R::A1, R::T1);
+  k.ADDI(R::S0, R::S0, 4);
+  k.ADDI(R::T0, R::T0, -1);
+  k.BNE(R::T0, R::ZERO, loop);
+  k.ADDI(R::S1, R::S1, -1);
+  k.BNE(R::S1, R::ZERO, outer);
+  k.ADD(R::A0, R::A1, R::ZERO);
+  k.End();
+  return k;
+}
+
+// walk over an array of 4096 words(larger than the data cache), load and add
+inline KernelBuilder ArrayWalkKernel(int iterations) {
+  KernelBuilder k;
+  using R = KernelBuilder::Reg;
+  k.LI(R::S1, (iterations + 4095) / 4096);
+  int outer = k.Here();
+  k.LUI(R::S0, 0x20000);
+  k.LI(R::T0, 4096);
+  int loop = k.Here();
+  k.LW(R::T1, R::S0, 0);
+  k.ADD(R::A1, R::A1, R::T1);
+  k.ADD(R::A1, R::A1, R::T0);
+  k.ADDI(R::S0, R::S0, 4);
+  k.ADDI(R::T0, R::T0, -1);
+  k.BNE(R::T0, R::ZERO, loop);
+  k.ADDI(R::S1, R::S1, -1);
+  k.BNE(R::S1, R::ZERO, outer);
+  k.ADD(R::A0, R::A1, R::ZERO);
+  k.End();
+  return k;
+}
+
+// a loop calling a small leaf function, the function saves ra on the stack
+inline KernelBuilder CallReturnKernel(int iterations) {
+  KernelBuilder k;
+  using R = KernelBuilder::Reg;
+  k.Emit(0); // jal zero, main(patched)
+  int func = k.Here();
+  k.ADDI(R::SP, R::SP, -4);
+  k.SW(R::SP, R::RA, 0);
+  k.ADD(R::A0, R::A0, R::A1);
+  k.XORI(R::A0, R::A0, 0x3c);
+  k.LW(R::RA, R::SP, 0);
+  k.ADDI(R::SP, R::SP, 4);
+  k.JALR(R::ZERO, R::RA, 0);
+  int main = k.Here();
+  k.LUI(R::SP, 0x100000);
+  k.LI(R::T0, iterations);
+  int loop = k.Here();
+  k.ADD(R::A1, R::T0, R::ZERO);
+  k.JAL(R::RA, func);
+  k.ADDI(R::T0, R::T0, -1);
+  k.BNE(R::T0, R::ZERO, loop);
+  k.End();
+  KernelBuilder jump;
+  jump.JAL(R::ZERO, main);
+  k.Patch(0, jump.Code()[0]);
+  return k;
+}
+
+#endif //RISCV_SIMULATOR_KERNELS_H
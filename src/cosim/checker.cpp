@@ -0,0 +1,91 @@
+#include "checker.h"
+
+CosimChecker::CosimChecker(const Memory &mem, int pc) : ref(mem, pc) {
+  worker = std::thread(&CosimChecker::Run, this);
+}
+
+CosimChecker::~CosimChecker() {
+  if (worker.joinable()) {
+    queue.push({0, -1, 0, Kind::End});
+    worker.join();
+  }
+}
+
+void CosimChecker::Finish(int pc) {
+  if (!worker.joinable()) return;
+  queue.push({pc, -1, 0, Kind::End});
+  worker.join();
+}
+
+/*
+ * pop records until the end record, compare each with one step of the reference model
+ * after a divergence, the records are only drained so that the producer never blocks
+ */
+void CosimChecker::Run() {
+  Record record{};
+  long long count = 0;
+  while (true) {
+    if (!queue.pop(record)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (diverged.load(std::memory_order_relaxed)) {
+      if (record.kind == Kind::End) return;
+      continue;
+    }
+    if (record.kind == Kind::Store) {
+      ref.Store(record.pc, u8(record.value));
+      continue;
+    }
+    ReferenceModel::Retired ret;
+    try {
+      ret = ref.Step();
+    }
+    catch (const std::exception &) {
+      // the simulator fails at such an instruction, it is not committed
+      ret.pc = ref.Pc();
+      ret.fault = true;
+    }
+    int rd = (record.rd > 0) ? record.rd : -1;
+    bool same = !ret.fault && ret.pc == record.pc && ret.end == (record.kind == Kind::End);
+    if (record.kind == Kind::Syscall) {
+      // the result comes from the simulator, the reference only checks that it is at the same ECALL
+      same = same && ret.syscall;
+      if (same) ref.Return(record.value);
+    }
+    else if (ret.device || ret.csr) {
+      // a LD of a device, a CSR instruction: the value comes from the simulator
+      same = same && !ret.syscall && ret.rd == rd;
+      if (same && rd != -1) ref.Adopt(rd, record.value);
+    }
+    else {
+      same = same && !ret.syscall && ret.rd == rd && (rd == -1 || ret.value == record.value);
+    }
+    if (!same) {
+      got = record;
+      got.rd = rd;
+      expected = ret;
+      checked.store(count, std::memory_order_relaxed);
+      diverged.store(true, std::memory_order_release);
+    }
+    if (record.kind == Kind::End) break;
+    if ((++count & 0xfff) == 0) checked.store(count, std::memory_order_relaxed);
+  }
+  checked.store(count, std::memory_order_relaxed);
+}
+
+void CosimChecker::Report(std::ostream &os) const {
+  if (!diverged.load(std::memory_order_acquire)) {
+    os << "cosim: " << Checked() << " instructions checked, no divergence" << std::endl;
+    return;
+  }
+  os << "cosim: divergence after " << Checked() << " instructions" << std::endl;
+  os << std::hex;
+  os << "  simulator: pc = " << got.pc << ((got.kind == Kind::End) ? ", .END" : (got.kind == Kind::Syscall) ? ", ECALL" : "");
+  if (got.rd != -1) os << ", x" << std::dec << got.rd << std::hex << " = " << got.value;
+  os << std::endl;
+  os << "  reference: pc = " << expected.pc << (expected.end ? ", .END" : (expected.syscall) ? ", ECALL" : "")
+     << (expected.fault ? ", fault" : "");
+  if (expected.rd != -1) os << ", x" << std::dec << expected.rd << std::hex << " = " << expected.value;
+  os << std::dec << std::endl;
+}
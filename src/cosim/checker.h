@@ -0,0 +1,70 @@
+
+#ifndef RISCV_SIMULATOR_CHECKER_H
+#define RISCV_SIMULATOR_CHECKER_H
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include "../utils/spsc_queue.h"
+#include "reference.h"
+
+/*
+ * lockstep co-simulation: every committed instruction is sent through a queue to a host thread,
+ * which executes the golden reference model and compares pc, rd and the written value
+ *
+ * the simulation only pushes into the queue, so it is slowed down only when the checker falls behind
+ * the first divergence is kept, the simulation polls Diverged() and stops
+ */
+class CosimChecker {
+public:
+  // mem, pc: the state before the simulation starts
+  CosimChecker(const Memory &mem, int pc);
+
+  ~CosimChecker();
+
+  // rd == -1: no register is written
+  void Commit(int pc, int rd, int value) {
+    queue.push({pc, rd, value, Kind::Commit});
+  }
+
+  // the ECALL at pc returned value, the bytes it stored are sent by Store before
+  void Syscall(int pc, int value) {
+    queue.push({pc, 10, value, Kind::Syscall});
+  }
+
+  void Store(int addr, u8 value) {
+    queue.push({addr, -1, value, Kind::Store});
+  }
+
+  // .END at pc is committed, wait until all instructions are checked
+  void Finish(int pc);
+
+  bool Diverged() const {return diverged.load(std::memory_order_relaxed);}
+
+  long long Checked() const {return checked.load(std::memory_order_relaxed);}
+
+  void Report(std::ostream &os) const;
+
+private:
+  enum class Kind {Commit, Syscall, Store, End};
+
+  struct Record {
+    int pc; // Store: the address
+    int rd;
+    int value;
+    Kind kind;
+  };
+
+  SpscQueue<Record, 1 << 16> queue;
+  ReferenceModel ref;
+  std::thread worker;
+  std::atomic<bool> diverged{false};
+  std::atomic<long long> checked{0};
+  // the first divergence
+  Record got{};
+  ReferenceModel::Retired expected;
+
+  void Run();
+};
+
+#endif //RISCV_SIMULATOR_CHECKER_H
@@ -0,0 +1,103 @@
+#include "reference.h"
+
+ReferenceModel::Retired ReferenceModel::Step() {
+  Retired ret;
+  ret.pc = pc;
+  int len = 4;
+  u32 code = InstructionUnit::Expand(mem->LoadWord(pc), len);
+  if (code == 0x0ff00513) {
+    ret.end = true;
+    return ret;
+  }
+  InstructionUnit::Instruction ins = iu.DecodeSet(code, len);
+  if (ins.opt == OptType::ECALL) {
+    // exit, exit_group
+    ret.end = (x[17] == 93 || x[17] == 94);
+    ret.syscall = !ret.end;
+    return ret;
+  }
+  u32 a = u32(x[ins.rs1]), b = u32(x[ins.rs2]);
+  int next_pc = pc + len;
+  if (InstructionUnit::IsCsr(ins.opt)) {
+    ret.csr = true;
+    if (ins.rd != 0) ret.rd = ins.rd;
+    pc = next_pc;
+    return ret;
+  }
+  if (OptInfo(ins.opt).unit == UnitClass::LoadStore) {
+    int addr = int(a + u32(ins.imm));
+    if (addr < 0 || addr >= MEMSIZE) {
+      ret.device = true;
+      // a copy is done in memory when the ST to ctrl is executed, in program order(the simulator does it after commit)
+      if (OptInfo(ins.opt).store && addr >= DMA_BASE && addr < DMA_BASE + dma.Size()) {
+        dma.Store(addr - DMA_BASE, OptInfo(ins.opt).size, b, 0, *mem);
+      }
+      if (ins.opt < OptType::SB && ins.rd != 0) ret.rd = ins.rd;
+      pc = next_pc;
+      return ret;
+    }
+  }
+  bool write = true;
+  u32 value = 0;
+  switch (ins.opt) {
+    case OptType::LUI : value = u32(ins.imm); break;
+    case OptType::AUIPC : value = u32(pc + ins.imm); break;
+    case OptType::JAL : value = u32(pc + len); next_pc = pc + ins.imm; break;
+    case OptType::JALR : value = u32(pc + len); next_pc = int((a + u32(ins.imm)) & ~1u); break;
+    case OptType::BEQ : write = false; if (a == b) next_pc = pc + ins.imm; break;
+    case OptType::BNE : write = false; if (a != b) next_pc = pc + ins.imm; break;
+    case OptType::BLT : write = false; if (int(a) < int(b)) next_pc = pc + ins.imm; break;
+    case OptType::BGE : write = false; if (int(a) >= int(b)) next_pc = pc + ins.imm; break;
+    case OptType::BLTU : write = false; if (a < b) next_pc = pc + ins.imm; break;
+    case OptType::BGEU : write = false; if (a >= b) next_pc = pc + ins.imm; break;
+    case OptType::LB : value = u32(Memory::SignExtend(mem->LoadByte(int(a + u32(ins.imm))), 8)); break;
+    case OptType::LH : value = u32(Memory::SignExtend(mem->LoadHalf(int(a + u32(ins.imm))), 16)); break;
+    case OptType::LW : value = mem->LoadWord(int(a + u32(ins.imm))); break;
+    case OptType::LBU : value = mem->LoadByte(int(a + u32(ins.imm))); break;
+    case OptType::LHU : value = mem->LoadHalf(int(a + u32(ins.imm))); break;
+    case OptType::SB : write = false; mem->StoreByte(int(a + u32(ins.imm)), int(b)); break;
+    case OptType::SH : write = false; mem->StoreHalf(int(a + u32(ins.imm)), int(b)); break;
+    case OptType::SW : write = false; mem->StoreWord(int(a + u32(ins.imm)), int(b)); break;
+    case OptType::ADDI : value = a + u32(ins.imm); break;
+    case OptType::SLTI : value = int(a) < ins.imm; break;
+    case OptType::SLTIU : value = a < u32(ins.imm); break;
+    case OptType::XORI : value = a ^ u32(ins.imm); break;
+    case OptType::ORI : value = a | u32(ins.imm); break;
+    case OptType::ANDI : value = a & u32(ins.imm); break;
+    case OptType::SLLI : value = a << (ins.imm & 31); break;
+    case OptType::SRLI : value = a >> (ins.imm & 31); break;
+    case OptType::SRAI : value = u32(int(a) >> (ins.imm & 31)); break;
+    case OptType::ADD : value = a + b; break;
+    case OptType::SUB : value = a - b; break;
+    case OptType::SLL : value = a << (b & 31); break;
+    case OptType::SLT : value = int(a) < int(b); break;
+    case OptType::SLTU : value = a < b; break;
+    case OptType::XOR : value = a ^ b; break;
+    case OptType::SRL : value = a >> (b & 31); break;
+    case OptType::SRA : value = u32(int(a) >> (b & 31)); break;
+    case OptType::OR : value = a | b; break;
+    case OptType::AND : value = a & b; break;
+    case OptType::MUL :
+    case OptType::MULH :
+    case OptType::MULHSU :
+    case OptType::MULHU : value = u32(MultiplyUnit::Compute(ins.opt, int(a), int(b))); break;
+    case OptType::DIV :
+    case OptType::DIVU :
+    case OptType::REM :
+    case OptType::REMU : value = u32(DivideUnit::Compute(ins.opt, int(a), int(b))); break;
+    case OptType::ECALL :
+    case OptType::CSRRW :
+    case OptType::CSRRS :
+    case OptType::CSRRC :
+    case OptType::CSRRWI :
+    case OptType::CSRRSI :
+    case OptType::CSRRCI : break;
+  }
+  if (write && ins.rd != 0) {
+    x[ins.rd] = int(value);
+    ret.rd = ins.rd;
+    ret.value = int(value);
+  }
+  pc = next_pc;
+  return ret;
+}
@@ -0,0 +1,57 @@
+
+#ifndef RISCV_SIMULATOR_REFERENCE_H
+#define RISCV_SIMULATOR_REFERENCE_H
+
+#include <memory>
+#include "../storage/memory.h"
+#include "../storage/mmio.h"
+#include "../units/instuction.h"
+#include "../units/muldiv.h"
+
+/*
+ * golden functional model: executes one instruction at a time in program order
+ * it owns a copy of the memory taken before the simulation starts
+ */
+class ReferenceModel {
+public:
+  // an instruction executed by the model, rd == -1 if no register is written
+  struct Retired {
+    int pc = 0;
+    int rd = -1;
+    int value = 0;
+    bool end = false; // .END or an exit system call(the instruction is not executed)
+    bool syscall = false; // ECALL: not executed, its result is given by Return
+    bool device = false; // LD/ST outside memory(a device, see IoBus): not executed, a loaded value is given by Adopt
+    bool csr = false; // CSR instruction: not executed, the value read is given by Adopt
+    bool fault = false; // the instruction at pc can't be executed(not decoded, or a fetch/LD/ST outside memory)
+  };
+
+  ReferenceModel(const Memory &mem, int pc) : mem(new Memory(mem)), pc(pc) {}
+
+  Retired Step();
+
+  int Reg(int num) const {return x[num];}
+
+  int Pc() const {return pc;}
+
+  // the result of the ECALL at pc(done by the simulator), go to the next instruction
+  void Return(int value) {
+    x[10] = value;
+    pc += 4;
+  }
+
+  // a byte stored by a system call
+  void Store(int addr, u8 value) {mem->StoreByte(addr, value);}
+
+  // the value loaded from a device or read from a csr
+  void Adopt(int rd, int value) {x[rd] = value;}
+
+private:
+  std::unique_ptr<Memory> mem;
+  HostDma dma; // the dma device copies in memory: its registers are written by the STs of the model
+  InstructionUnit iu;
+  int x[REGNUM] = {0};
+  int pc;
+};
+
+#endif //RISCV_SIMULATOR_REFERENCE_H
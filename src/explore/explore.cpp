@@ -0,0 +1,239 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../api/simulator.h"
+
+/*
+ * compare configuration variants on the same program phase
+ * the program runs once to a warm point and is drained there(see Simulator::Drain), then one child process per variant
+ * is forked from it, so every variant starts from the same empty pipeline:
+ * the children share the warmed memory, caches and predictor tables through copy-on-write pages,
+ * each applies its options, runs to the end on its own and reports back through a pipe
+ * the program output before the fork is written once, the output of each variant after it is written by its child
+ *
+ * usage: explore [--option <name>=<value>]... [--warm-cycles <n> | --warm-pc <hex>] [--max-cycles <n>]
+ *                --variant <name>[:<option>=<value>,...]... < program
+ * --option: options of the warm-up run(see Simulator::SetOption), kept by every variant
+ * --warm-cycles: fork after n cycles(default 0: from the beginning)
+ * --warm-pc: fork when the instruction at pc is about to commit
+ * --max-cycles: cycles of each variant after the fork(default 0: no limit)
+ * --variant: e.g. --variant base --variant nofuse:fusion=off --variant pf:prefetch=all,prefetch-degree=4
+ *
+ * the table has one row per variant: exit code, cycles and instructions after the fork, IPC, speedup over the first variant
+ * (cosim isn't supported: the checker thread wouldn't survive fork, neither is the samples option in --option or
+ * --variant: the children would share the sample file of the parent, it is refused)
+ */
+namespace {
+
+struct Variant {
+  std::string name;
+  std::vector<std::pair<std::string, std::string>> options;
+};
+
+// result of a variant, written to the pipe as one line
+struct Result {
+  int status = -1; // 0 finished, 1 max cycles reached, 2 failed, 3 unknown option, -1 no report
+  int exit_code = -1;
+  long long cycles = 0, instructions = 0;
+};
+
+// name=value, return false if there is no '='
+bool ParseOption(const std::string &text, std::pair<std::string, std::string> &option) {
+  size_t eq = text.find('=');
+  if (eq == std::string::npos) return false;
+  option = {text.substr(0, eq), text.substr(eq + 1)};
+  return true;
+}
+
+bool ParseVariant(const std::string &text, Variant &variant) {
+  size_t colon = text.find(':');
+  variant.name = text.substr(0, colon);
+  if (colon == std::string::npos) return true;
+  size_t begin = colon + 1;
+  while (begin < text.size()) {
+    size_t end = text.find(',', begin);
+    if (end == std::string::npos) end = text.size();
+    std::pair<std::string, std::string> option;
+    if (!ParseOption(text.substr(begin, end - begin), option)) return false;
+    variant.options.push_back(option);
+    begin = end + 1;
+  }
+  return true;
+}
+
+// the samples option is given(see the usage)
+bool HasSamples(const std::vector<std::pair<std::string, std::string>> &options) {
+  for (const std::pair<std::string, std::string> &option : options) {
+    if (option.first == "samples") return true;
+  }
+  return false;
+}
+
+// child: run the variant from the warmed state, write the result to fd
+void RunVariant(Simulator &sim, const Variant &variant, long long max_cycles, int fd) {
+  Result ret;
+  long long cycles = sim.Cycles(), instructions = sim.Instructions();
+  bool ok = true;
+  for (const std::pair<std::string, std::string> &option : variant.options) {
+    if (!sim.SetOption(option.first, option.second)) {
+      std::cerr << variant.name << ": unknown option " << option.first << "=" << option.second << std::endl;
+      ok = false;
+      ret.status = 3;
+    }
+  }
+  if (ok) {
+    bool finished = (max_cycles > 0) ? sim.Step(max_cycles) : (sim.Run(), true);
+    ret.status = sim.Failed() ? 2 : (finished ? 0 : 1);
+    if (ret.status == 0) ret.exit_code = sim.ReturnValue();
+    ret.cycles = sim.Cycles() - cycles;
+    ret.instructions = sim.Instructions() - instructions;
+  }
+  sim.FlushOutput(); // the child leaves with _exit
+  char line[128];
+  int len = snprintf(line, sizeof (line), "%d %d %lld %lld\n", ret.status, ret.exit_code, ret.cycles, ret.instructions);
+  if (write(fd, line, size_t(len)) != len) std::cerr << variant.name << ": cannot report" << std::endl;
+}
+
+Result ReadResult(int fd) {
+  Result ret;
+  std::string text;
+  char buf[128];
+  ssize_t len;
+  while ((len = read(fd, buf, sizeof (buf))) != 0) {
+    if (len < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    text.append(buf, size_t(len));
+  }
+  if (sscanf(text.c_str(), "%d %d %lld %lld", &ret.status, &ret.exit_code, &ret.cycles, &ret.instructions) != 4) ret = Result();
+  return ret;
+}
+
+void PrintTable(const std::vector<Variant> &variants, const std::vector<Result> &results) {
+  static const char *status_name[] = {"ok", "limit", "failed", "option"};
+  std::cout << std::left << std::setw(16) << "variant" << std::right << std::setw(8) << "status" << std::setw(6) << "exit"
+            << std::setw(12) << "cycles" << std::setw(14) << "instructions" << std::setw(8) << "IPC" << std::setw(9) << "speedup" << std::endl;
+  std::cout << std::fixed << std::setprecision(3);
+  for (size_t i = 0; i < variants.size(); ++i) {
+    const Result &tmp = results[i];
+    std::cout << std::left << std::setw(16) << variants[i].name << std::right << std::setw(8)
+              << ((tmp.status < 0) ? "lost" : status_name[tmp.status]) << std::setw(6) << tmp.exit_code
+              << std::setw(12) << tmp.cycles << std::setw(14) << tmp.instructions
+              << std::setw(8) << ((tmp.cycles > 0) ? double(tmp.instructions) / tmp.cycles : 0.0);
+    if (tmp.cycles > 0 && results[0].cycles > 0) std::cout << std::setw(8) << double(results[0].cycles) / tmp.cycles << "x";
+    std::cout << std::endl;
+  }
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<std::pair<std::string, std::string>> options;
+  std::vector<Variant> variants;
+  long long warm_cycles = 0, max_cycles = 0;
+  long long warm_pc = -1;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--option") == 0 && i + 1 < argc) {
+      std::pair<std::string, std::string> option;
+      if (!ParseOption(argv[++i], option)) {
+        std::cerr << "bad option " << argv[i] << std::endl;
+        return 1;
+      }
+      options.push_back(option);
+    }
+    else if (strcmp(argv[i], "--variant") == 0 && i + 1 < argc) {
+      Variant variant;
+      if (!ParseVariant(argv[++i], variant)) {
+        std::cerr << "bad variant " << argv[i] << std::endl;
+        return 1;
+      }
+      variants.push_back(variant);
+    }
+    else if (strcmp(argv[i], "--warm-cycles") == 0 && i + 1 < argc) warm_cycles = atoll(argv[++i]);
+    else if (strcmp(argv[i], "--warm-pc") == 0 && i + 1 < argc) warm_pc = strtoll(argv[++i], nullptr, 16);
+    else if (strcmp(argv[i], "--max-cycles") == 0 && i + 1 < argc) max_cycles = atoll(argv[++i]);
+  }
+  if (variants.empty()) {
+    std::cerr << "no --variant given" << std::endl;
+    return 1;
+  }
+  bool samples = HasSamples(options);
+  for (const Variant &variant : variants) samples = samples || HasSamples(variant.options);
+  if (samples) {
+    std::cerr << "samples isn't supported by explore" << std::endl;
+    return 1;
+  }
+
+  Simulator sim;
+  for (const std::pair<std::string, std::string> &option : options) {
+    if (!sim.SetOption(option.first, option.second)) {
+      std::cerr << "unknown option " << option.first << "=" << option.second << std::endl;
+      return 1;
+    }
+  }
+  std::string program((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+  if (!sim.LoadHex(program.data(), program.size())) {
+    std::cerr << "bad program" << std::endl;
+    return 1;
+  }
+  bool warmed = (warm_pc >= 0) ? sim.RunToPc(uint32_t(warm_pc), (warm_cycles > 0) ? warm_cycles : 1LL << 62)
+                               : !sim.Step(warm_cycles);
+  // the options of a variant would drain the pipeline in the child: done once here, every variant starts from it
+  if (!warmed || !sim.Drain()) {
+    std::cerr << "the program finished(or failed) before the warm point" << std::endl;
+    return 1;
+  }
+  std::cerr << "forking " << variants.size() << " variants at cycle " << sim.Cycles() << ", "
+            << sim.Instructions() << " instructions committed" << std::endl;
+  sim.FlushOutput();
+  std::cout.flush();
+  std::cerr.flush();
+
+  std::vector<int> fds(variants.size(), -1);
+  std::vector<pid_t> pids(variants.size(), -1);
+  for (size_t i = 0; i < variants.size(); ++i) {
+    int pipe_fd[2];
+    if (pipe(pipe_fd) < 0) {
+      perror("pipe");
+      break;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      close(pipe_fd[0]);
+      close(pipe_fd[1]);
+      break;
+    }
+    if (pid == 0) {
+      close(pipe_fd[0]);
+      RunVariant(sim, variants[i], max_cycles, pipe_fd[1]);
+      close(pipe_fd[1]);
+      _exit(0); // skip the destructors and exit handlers of the parent's state
+    }
+    close(pipe_fd[1]);
+    fds[i] = pipe_fd[0];
+    pids[i] = pid;
+  }
+
+  std::vector<Result> results(variants.size());
+  for (size_t i = 0; i < variants.size(); ++i) {
+    if (fds[i] < 0) continue;
+    results[i] = ReadResult(fds[i]);
+    close(fds[i]);
+    waitpid(pids[i], nullptr, 0);
+  }
+  PrintTable(variants, results);
+  for (const Result &result : results) {
+    if (result.status != 0) return 1;
+  }
+  return 0;
+}
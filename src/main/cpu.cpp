@@ -1,215 +1,539 @@
+#include <sstream>
+#include <stdexcept>
 #include "cpu.h"
 
-u8 CPU::run() {
-  bool debug_st = false;
-  void (CPU::*func[4])() = {&CPU::TryIssue, &CPU::ExecuteRss, &CPU::AccessMem, &CPU::TryCommit};
-  while (true) {
-    std::shuffle(func, func + 4, std::mt19937(std::random_device()()));
-//    if (clk == 1368) debug_st = true;
-    if (debug_st) {
-      std::cout << std::endl;
-      std::cout << "clock cycle " << std::dec << clk << ": pc = " << std::hex << pc << std::dec << std::endl;
-    }
-
-    (this->*func[0])();
-    if (debug_st) {
-      std::cout << std::endl << "ROB_AFTER_ISSUE: " << std::endl;
-      rob.Print();
-      std::cout << std::endl << "LS_RSS_AFTER_ISSUE: " << std::endl;
-      ls_rss.print();
-      std::cout << "-----------------ARI_RSS_AFTER_ISSUE--------------------" << std::endl;
-      ari_rss.print();
-    }
-
-    (this->*func[1])();
-    if (debug_st) {
-      std::cout << std::endl << "LS_RSS_AFTER_EXECUTE: " << std::endl;
-      ls_rss.print();
-      std::cout << std::endl << "LSB_AFTER_EXECUTE: " << std::endl;
-      lsb.print();
-      std::cout << "-----------------ARI_RSS_AFTER_EXECUTE--------------------" << std::endl;
-      ari_rss.print();
-    }
+template <typename Trace>
+u8 CPU<Trace>::run() {
+  while (!Step()) {}
+  return ret_value;
+}
 
-    (this->*func[2])();
-    if (debug_st) {
-      std::cout << std::endl << "LSB_AFTER_ACCESS_MEM: " << std::endl;
-      lsb.print();
-    }
+template <typename Trace>
+void CPU<Trace>::Reset() {
+  checker.reset();
+  mem.Clear();
+  rob = ReorderBuffer();
+  iu = InstructionUnit();
+  reg = Register();
+  lsb = LoadStoreBuffer();
+  lsb.SetOutput(&output);
+  ls_rss = ari_rss = mul_rss = div_rss = ReservationStation();
+  mul = MultiplyUnit();
+  div = DivideUnit();
+  pool = FunctionalUnitPool();
+  predictor = Predictor();
+  value_predictor = ValuePredictor();
+  value_prediction = false;
+  ready_bus = CommonDataBus(READY_BUS_WIDTH);
+  commit_bus = CommonDataBus(COMMIT_BUS_WIDTH);
+  bus_policy = BusPolicy::OldestFirst;
+  fetch_queue = FetchQueue();
+  pc = 0;
+  jump_pc = jump_checkpoint = jump_tag = -1;
+  jump_label = -1;
+  jump_value = 0;
+  clk = 0;
+  instret = 0;
+  end_flag = finished = draining = false;
+  ret_value = 0;
+  trace = Trace();
+  end_fetched = fetch_fault = false;
+  end_pc = 0;
+  serialize_pending = false;
+  branch_mispredicts = lsb_stalls = 0;
+  std::fill(csr_offsets, csr_offsets + COUNTER_NUM, 0);
+  syscalls.Reset();
+}
 
-    (this->*func[3])();
-    if (debug_st) {
-      std::cout << std::endl << "ROB_AFTER_COMMIT: " << std::endl;
-      rob.Print();
-//      std::cout << std::endl << "REGISTER: " << std::endl;
-//      reg.print();
-      std::cout << std::endl <<  "READY_BUS: " << std::endl;
-      ready_bus.print();
-      std::cout << std::endl << "COMMIT_BUS: " << std::endl;
-      commit_bus.print();
-    }
+/*
+ * one cycle: the stages in random order, then write back, check the buses and flush
+ * when .END is committed: committed STs still in lsb are written to memory
+ */
+template <typename Trace>
+bool CPU<Trace>::Step() {
+  if (finished) return true;
+  void (CPU::*func[5])() = {&CPU::TryIssue, &CPU::ExecuteRss, &CPU::AccessMem, &CPU::TryCommit, &CPU::TryFetch};
+  int order[5] = {0, 1, 2, 3, 4};
+  std::shuffle(order, order + 5, std::mt19937(std::random_device()()));
+  trace.BeginCycle(*this);
+  for (int i = 0; i < 5; ++i) {
+    (this->*func[order[i]])();
+    trace.AfterStage(Stage(order[i]), *this);
+  }
+  WriteBack();
+  trace.EndCycle(*this);
 
-    CheckBus();
-    Flush();
+  CheckBus();
+  Flush();
 
-    if (end_flag) {
-      return ret_value;
+  if (checker != nullptr && checker->Diverged()) {
+    DumpDivergence();
+    finished = true;
+    return true;
+  }
+  if (end_flag) {
+    // the STs may start copies of the dma device, checked before the end
+    lsb.WriteStores(mem, clk);
+    if (checker != nullptr) {
+      checker->Finish(end_pc);
+      if (checker->Diverged()) DumpDivergence();
     }
+    syscalls.Flush();
+    trace.End(*this);
+    finished = true;
+    return true;
+  }
+  ++clk;
+  return false;
+}
 
-//    std::cout << "-----------------ARI_RSS_END--------------------" << std::endl;
-//    ari_rss.print();
-//    if (clk == 1374) return -1;
-    ++clk;
+/*
+ * let the instructions in flight commit(or be squashed) without issuing new ones, until rob and lsb are empty
+ * then fetch again from the oldest instruction not issued, so registers and memory can be changed in between
+ * the cycles are counted
+ */
+template <typename Trace>
+void CPU<Trace>::Drain() {
+  if (finished) return;
+  draining = true;
+  while (!(rob.empty() && lsb.size() == 0 && !commit_bus.Waiting(BusPort::Commit))) {
+    if (Step()) break;
   }
+  draining = false;
+  if (finished) return;
+  if (!fetch_queue.empty()) pc = fetch_queue.Front().pc;
+  fetch_queue.Clear();
+  fetch_queue.flush();
+  iu.stall = false;
+  end_fetched = false;
+  fetch_fault = false;
 }
 
-void CPU::Flush() {
-  if (jump_pc > 0) {
+/*
+ * report the first divergence found by the checker and dump the pipeline(printed to stderr)
+ * the pipeline may have run ahead of the diverging instruction
+ */
+template <typename Trace>
+void CPU<Trace>::DumpDivergence() {
+  std::streambuf *buf = std::cout.rdbuf(std::cerr.rdbuf());
+  checker->Report(std::cout);
+  std::cout << "pipeline at cycle " << clk << ", " << instret << " instructions committed:" << std::endl;
+  rob.Print();
+  std::cout << "-----------------LS_RSS--------------------" << std::endl;
+  ls_rss.print();
+  std::cout << "-----------------ARI_RSS--------------------" << std::endl;
+  ari_rss.print();
+  std::cout << "-----------------MUL_RSS--------------------" << std::endl;
+  mul_rss.print();
+  std::cout << "-----------------DIV_RSS--------------------" << std::endl;
+  div_rss.print();
+  lsb.print();
+  reg.print();
+  std::cout.rdbuf(buf);
+}
+
+template <typename Trace>
+void CPU<Trace>::Flush() {
+  if (jump_pc != -1) {
+    if (jump_tag < 0) ++branch_mispredicts; // not a LD
     ClearPipeline();
     pc = jump_pc;
     jump_pc = -1;
-    pc_start = true;
+    jump_tag = -1;
     iu.stall = false;
+    end_fetched = false;
+    fetch_fault = false;
   }
+  fetch_queue.flush();
+  predictor.flush();
+  value_predictor.flush();
   rob.flush();
-  reg.FlushSetX0();
   lsb.flush();
   ls_rss.flush();
   ari_rss.flush();
+  mul_rss.flush();
+  div_rss.flush();
   ready_bus.clear();
   commit_bus.clear();
 }
 
 /*
  * rob: check ready_bus(set ready and get value)
- * ls_rss, ari_rss: check ready_bus and commit_bus (clear dependency)
- * reg: check commit_bus(write data in x[rd], if dependency is same, clear dependency)
+ * ls_rss, ari_rss, mul_rss, div_rss: check ready_bus (clear dependency on the physical registers written)
+ * reg: check ready_bus(write data in the physical registers and set ready)
  * lsb: check commit_bus(for unready STs: set ready)
  *
  * operate directly on the next state
  */
-void CPU::CheckBus() {
-  rob.CheckBus(ready_bus);
-  ls_rss.CheckBus(ready_bus, commit_bus);
-  ari_rss.CheckBus(ready_bus, commit_bus);
-  reg.CheckBus(commit_bus);
+template <typename Trace>
+void CPU<Trace>::CheckBus() {
+  rob.CheckBus(ready_bus, clk);
+  ls_rss.CheckBus(ready_bus);
+  ari_rss.CheckBus(ready_bus);
+  mul_rss.CheckBus(ready_bus);
+  div_rss.CheckBus(ready_bus);
+  reg.CheckBus(ready_bus);
   lsb.CheckBus(commit_bus);
 }
 
 /*
- * called when prediction failed
- * clear all entries in rob, ari_rss, ls_rss, lsb
- * clear all dependency in reg
+ * called when a branch/JALR was mispredicted(found when it is executed) or a LD got another value than predicted
+ * clear all entries in fetch_queue
+ * remove instructions after the branch from rob, ari_rss, ls_rss, mul_rss, div_rss, lsb and the ops in mul, div, pool
+ * reg: return to the checkpoint of the branch, physical registers of the removed instructions are free
+ * LD: the loaded value is written now(its result may still be waiting for the bus), the instructions after it are
+ *     fetched again and read it
  */
-void CPU::ClearPipeline() {
-  rob.Clear();
-  ari_rss.Clear();
-  ls_rss.Clear();
-  lsb.Clear();
-  reg.ClearDependency();
-  ready_bus.clear();
-  commit_bus.clear();
+template <typename Trace>
+void CPU<Trace>::ClearPipeline() {
+  fetch_queue.Clear();
+  trace.Squash(rob.Squash(jump_label, reg, trace));
+  ari_rss.Squash(jump_label);
+  ls_rss.Squash(jump_label);
+  mul_rss.Squash(jump_label);
+  div_rss.Squash(jump_label);
+  mul.Squash(jump_label);
+  div.Squash(jump_label);
+  pool.Squash(jump_label);
+  lsb.Squash(jump_label);
+  ready_bus.Squash(jump_label);
+  reg.Restore(jump_checkpoint);
+  if (jump_tag >= 0) reg.Write(jump_tag, jump_value);
+  value_predictor.Squash();
+  serialize_pending = false; // an ECALL/CSR instruction is the youngest instruction, it is removed by any squash
+}
+
+/*
+ * a mispredicted branch/JALR or LD is found, the pipeline is cleared when flush
+ * the oldest one of the cycle is kept(the younger ones are removed with it)
+ */
+template <typename Trace>
+void CPU<Trace>::Redirect(long long label, int checkpoint, int pc, int tag, int value) {
+  if (jump_pc != -1 && jump_label < label) return;
+  jump_pc = pc;
+  jump_label = label;
+  jump_checkpoint = checkpoint;
+  jump_tag = tag;
+  jump_value = value;
 }
 
 /*
- * rob: check entry at front, if ready, commit, put on commit bus, remove entry
+ * a LD got its value(loaded or forwarded): train the value predictor
+ * if its value was predicted: drop the checkpoint if the prediction is correct,
+ *                             else the instructions after it are removed and fetched again
+ */
+template <typename Trace>
+void CPU<Trace>::VerifyLoad(const LoadStoreBuffer::Loaded &loaded) {
+  if (loaded.label == -1) return;
+  bool predicted = loaded.checkpoint >= 0;
+  bool correct = predicted && loaded.value == loaded.predicted;
+  value_predictor.Train(loaded.pc, loaded.value, predicted && !correct);
+  trace.LoadValue(predicted, correct);
+  if (!predicted) return;
+  if (correct) reg.Resolve(loaded.checkpoint);
+  else Redirect(loaded.label, loaded.checkpoint, loaded.pc + loaded.len, loaded.tag, loaded.value);
+}
+
+/*
+ * rob: check entry at front, if ready, commit(update the committed mapping of rd, ST: put on commit bus), remove entry
  *                            else return
- * handle .END, jalr and branch prediction
+ * handle .END and train branch prediction
+ * ECALL: waits until the STs before it are written to memory, then the system call is done(nothing after it is issued)
+ * CSR instruction: the csr is read(nothing after it is issued, so the counters are exact), rd is written before it commits
  *
- * Commit: .END: set end_flag and ret_value
- *         prediction failed: set jump_pc
+ * Commit: .END or exit: set end_flag and ret_value
  */
-void CPU::TryCommit() {
-//  if (clk % 100000 == 0) std::cout << "clk = " << clk << std::endl;
-  std::pair<int, int> tmp = rob.Commit(commit_bus, reg, predictor);
+template <typename Trace>
+void CPU<Trace>::TryCommit() {
+  if (commit_bus.Waiting(BusPort::Commit)) {
+    trace.CommitSlot(CommitStall::CdbFull);
+    return;
+  }
+  if (rob.empty()) {
+    trace.CommitSlot(CommitStall::Empty);
+    return;
+  }
+  if (!rob.HeadReady()) {
+    trace.CommitSlot(CommitStall::HeadNotReady);
+    return;
+  }
+  const ReorderBuffer::RoBEntry &head = rob.Front();
+  if (head.label == lsb.Fault()) throw std::exception(); // a LD outside memory
+  int head_pc = head.pc;
+  if (head.opt == OptType::ECALL) {
+    if (lsb.size() > 0 || commit_bus.Waiting(BusPort::Commit)) {
+      trace.CommitSlot(CommitStall::SyscallDrain);
+      return;
+    }
+    trace.CommitSlot(CommitStall::None);
+    ++instret;
+    serialize_pending = false;
+    if (Syscall(head_pc)) {
+      end_flag = true;
+      end_pc = head_pc;
+    }
+    rob.Commit(commit_bus, reg, predictor, trace);
+    return;
+  }
+  trace.CommitSlot(CommitStall::None);
+  if (InstructionUnit::IsCsr(head.opt)) {
+    int value = ExecuteCsr(head);
+    if (head.tag >= 0) reg.Write(head.tag, value);
+    serialize_pending = false;
+  }
+  if (checker != nullptr && !(head.opt == OptType::ADDI && head.rd == -1)) {
+    // fused pair: both instructions are checked
+    if (head.fused != FusedType::None) checker->Commit(head.pc, head.rd1, reg.Read(head.tag1));
+    checker->Commit(head.pc + head.len1, head.rd, (head.tag >= 0) ? reg.Read(head.tag) : head.value);
+  }
+  instret += (head.fused != FusedType::None) ? 2 : 1;
+  std::pair<int, int> tmp = rob.Commit(commit_bus, reg, predictor, trace);
   if (tmp.first == 1) {
     end_flag = true;
     ret_value = tmp.second;
+    end_pc = head_pc;
+  }
+}
+
+template <typename Trace>
+bool CPU<Trace>::Syscall(int pc) {
+  int args[6];
+  for (int i = 0; i < 6; ++i) args[i] = reg.ReadArch(10 + i);
+  syscall_written.clear();
+  SyscallEmulator::Result ret = syscalls.Call(mem, reg.ReadArch(17), args, clk, (checker != nullptr) ? &syscall_written : nullptr);
+  if (ret.exit) {
+    ret_value = u8(ret.value);
+    return true;
+  }
+  // nothing after the ECALL is in flight: the committed a0 is the one read by the next instructions
+  reg.WriteArch(10, ret.value);
+  if (checker != nullptr) {
+    for (const std::pair<int, u8> &tmp : syscall_written) checker->Store(tmp.first, tmp.second);
+    checker->Syscall(pc, ret.value);
   }
-  if (tmp.first == 2) {
-    // 下个周期才更新pc，这个周期最后flush的时候才clearpipeline
-    jump_pc = tmp.second;
+  return false;
+}
+
+template <typename Trace>
+int CPU<Trace>::ExecuteCsr(const ReorderBuffer::RoBEntry &entry) {
+  long long counters[COUNTER_NUM] = {clk, clk, instret, branch_mispredicts, lsb_stalls, lsb.DcacheMisses()};
+  static_assert(COUNTER_NUM == 6, "a value for each counter");
+  for (int i = 0; i < COUNTER_NUM; ++i) counters[i] += csr_offsets[i];
+  u32 value = 0;
+  bool legal = ReadCounterCsr(entry.csr, counters, value);
+  if (legal && CsrWrites(entry.opt, entry.rs1)) {
+    bool uimm = entry.opt == OptType::CSRRWI || entry.opt == OptType::CSRRSI || entry.opt == OptType::CSRRCI;
+    u32 src = uimm ? u32(entry.rs1) : u32(reg.ReadArch(entry.rs1));
+    ++counters[2]; // the write takes effect after the instruction itself is counted in instret
+    legal = WriteCounterCsr(entry.csr, counters, csr_offsets, CsrWriteValue(entry.opt, value, src));
+  }
+  // not a counter, or a write to a read-only counter
+  if (!legal) {
+    std::ostringstream os;
+    os << "illegal access to csr 0x" << std::hex << entry.csr << " at pc 0x" << entry.pc;
+    throw std::runtime_error(os.str());
   }
+  return int(value);
 }
 
 /*
- * lsb check and try access memory(load or store)
- * if a ld or store is finished, put information on bus and pop
+ * lsb check and try access memory(load or store) or a device(a LD of a device only at the head of rob)
+ * if a ld or store is finished, put information on bus and pop(a LD is verified against its predicted value)
  */
-void CPU::AccessMem() {
-  lsb.TryLoadStore(mem, ready_bus);
+template <typename Trace>
+void CPU<Trace>::AccessMem() {
+  VerifyLoad(lsb.TryLoadStore(mem, ready_bus, trace, rob.empty() ? -1 : rob.Front().label, clk));
 }
 
 /*
- * execute in ari_rss: find an entry without dependency and calculate in ALU and get result
- *                    put the information into bus(label, value), remove entry
- * execute in ls_rss: find an entry without dependency
- *                    if a ST is at top and without dependency,
+ * execute in ari_rss: entries without dependency are calculated in ALU and started on the free ALUs and branch units
+ *                    of pool, remove entries(the results are put on bus when the units finish them)
+ * execute in ls_rss: find entries without dependency, each on a free AGU
+ *                    if a ST is without dependency and no entry is before it,
  *                         calculate its addr and value, pop it into lsb and remove entry
  *                    if a LD is without dependency and has no STs before it,
  *                         calculate its addr, pop it into lsb(and then lsb.execute) and remove entry
+ *                         (a LD of a device only if no LD is before it)
  * execute in lsb: receive call from ls_rss(drop a LD/ST instruction)
  *                 if ST: add to the queue
  *                 if LD: percolate lsb, if there's a ST with same addr, put information on bus
  *                                       else add to queue
+ * execute in mul_rss, div_rss: start an entry without dependency in mul(pipelined) or div(one op at a time)
+ *
+ * a LD forwarded in lsb is verified against its predicted value like a loaded one
  */
-void CPU::ExecuteRss() {
-  ari_rss.AriExecute(alu, ready_bus, pc);
-  ls_rss.LsExecute(alu, ready_bus, lsb);
+template <typename Trace>
+void CPU<Trace>::ExecuteRss() {
+  ari_rss.AriExecute(alu, reg, ready_bus, pool, trace);
+  LoadStoreBuffer::Loaded loaded[AGU_NUM];
+  int forwarded = ls_rss.LsExecute(alu, reg, ready_bus, lsb, pool, trace, loaded);
+  for (int i = 0; i < forwarded; ++i) VerifyLoad(loaded[i]);
+  mul_rss.MulDivExecute(mul, reg, trace);
+  div_rss.MulDivExecute(div, reg, trace);
 }
 
 /*
- * get next instruction: get next pc(+4 or jump or predict)
- *                       if pc_start, read current pc(used cases: the very beginning or after clean pipeline)
- * decode next instruction: instruction_unit
- * if rob & rss is not full, issue an instruction in rob and rss
- * else, restore pc to checkpoint
+ * called after all stages of a cycle: mul, div and the units of pool move one cycle forward, a finished result asks for
+ * ready_bus(it waits in its unit while the last one is still waiting)
+ * a branch/JALR finished in pool: if predicted correctly, its checkpoint is dropped
+ *                                 else set jump_pc(younger instructions are removed when flush)
+ * then the slots of ready_bus and commit_bus are given to the requests by bus_policy, the others wait
  */
-void CPU::TryIssue() {
-  if (rob.full()) return;
-//  if (jump_pc > 0) {
-//    iu.stall = false;
-//  }
-  if (iu.stall) return;
-  u32 next_code = 0;
-  InstructionType next_type;
-  int pc_checkpoint = pc;
-  if (pc_start) {
-    next_code = mem.LoadWord(pc);
-    next_type = iu.GetInstructionType(next_code);
-    pc_start = false;
-  }
-  else {
-    pc = iu.NextPc(predictor, pc);
-    if (pc == -1) {
-      pc = pc_checkpoint;
+template <typename Trace>
+void CPU<Trace>::WriteBack() {
+  mul.Advance();
+  div.Advance();
+  pool.Advance();
+  for (int i = 0; i < FU_NUM; ++i) {
+    FunctionalUnitPool::Op *op = pool.Finished(i);
+    if (op == nullptr) continue;
+    if (op->checkpoint >= 0) {
+      // 下个周期才更新pc，这个周期最后flush的时候才clearpipeline
+      if (op->jump_pc == -1) reg.Resolve(op->checkpoint);
+      else Redirect(op->label, op->checkpoint, op->jump_pc);
+      op->checkpoint = -1;
+    }
+    if (ready_bus.Waiting(UnitPort(i))) continue;
+    ready_bus.Request(UnitPort(i), op->label, op->value, op->tag, op->tag1, op->first);
+    pool.Pop(i);
+  }
+  if (mul.Done() && !ready_bus.Waiting(BusPort::Mul)) {
+    ready_bus.Request(BusPort::Mul, mul.Label(), mul.Value(), mul.Tag());
+    mul.Pop();
+  }
+  if (div.Done() && !ready_bus.Waiting(BusPort::Div)) {
+    ready_bus.Request(BusPort::Div, div.Label(), div.Value(), div.Tag());
+    div.Pop();
+  }
+  int ready_waiting = ready_bus.Arbitrate(bus_policy);
+  int commit_waiting = commit_bus.Arbitrate(bus_policy);
+  trace.BusConflict(ready_waiting, commit_waiting);
+}
+
+/*
+ * fetch up to FETCH_WIDTH instructions at pc into fetch_queue(a compressed instruction is expanded to 32 bits)
+ * decode them and get next pc(+len or jump or predict)
+ * stop at a predicted taken branch/jump, a JALR without prediction(stall), .END(stall) or a full queue
+ * an instruction that can be fused with the one fetched before it in this cycle replaces that entry
+ * an instruction that can't be decoded(or is outside memory) stalls fetch: it is usually on a wrong path and a flush will come
+ */
+template <typename Trace>
+void CPU<Trace>::TryFetch() {
+  for (int i = 0; i < FETCH_WIDTH; ++i) {
+    if (iu.stall || fetch_queue.NextFull()) return;
+    FetchQueue::FetchEntry entry;
+    entry.pc = pc;
+    try {
+      int len = 4;
+      entry.code = iu.Expand(mem.LoadWord(pc), len);
+      entry.ins = iu.DecodeSet(entry.code, len);
+    }
+    catch (const std::exception &) {
+      iu.stall = true;
+      fetch_fault = true;
+      return;
+    }
+    if (entry.code == 0x0ff00513) {
+      fetch_queue.push(entry);
+      iu.stall = true;
+      end_fetched = true;
       return;
     }
-    next_code = mem.LoadWord(pc);
-    next_type = iu.GetInstructionType(next_code);
+    FetchQueue::FetchEntry *fetched = &entry;
+    if (i > 0 && iu.fusion && iu.Fuse(fetch_queue.Back().ins)) fetched = &fetch_queue.Back();
+    int next_pc = iu.NextPc(predictor, fetched->pc);
+    fetched->predicted = next_pc;
+    if (fetched == &entry) fetch_queue.push(entry);
+    if (next_pc == -1) return;
+    pc = next_pc;
+    if (next_pc != fetched->pc + fetched->ins.len) return;
+  }
+}
 
-    if (next_type == InstructionType::I || next_type == InstructionType::S) {
+/*
+ * take the instruction at the front of fetch_queue
+ * if rob & rss is not full(a physical register is free if rd is written, a checkpoint is free for a branch/JALR), rename it, issue it in rob and rss
+ * else it stays in fetch_queue
+ * LD: if the value predictor is confident(and a checkpoint is free), rd gets the predicted value at once
+ */
+template <typename Trace>
+void CPU<Trace>::TryIssue() {
+  if (draining) {
+    trace.IssueSlot(IssueStall::End);
+    return;
+  }
+  if (serialize_pending) {
+    trace.IssueSlot(IssueStall::Serialize);
+    return;
+  }
+  if (rob.full()) {
+    trace.IssueSlot(IssueStall::RobFull);
+    return;
+  }
+  if (fetch_queue.empty()) {
+    // the instruction that can't be decoded is on the right path
+    if (fetch_fault && rob.empty()) throw std::exception();
+    if (end_fetched) trace.IssueSlot(IssueStall::End);
+    else trace.IssueSlot((iu.stall && !fetch_fault) ? IssueStall::JalrStall : IssueStall::FetchQueueEmpty);
+    return;
+  }
+  const FetchQueue::FetchEntry &next = fetch_queue.Front();
+  const InstructionUnit::Instruction &next_ins = next.ins;
+  if (reg.full(next_ins)) {
+    trace.IssueSlot(IssueStall::PrfFull);
+    return;
+  }
+  if ((next_ins.type == InstructionType::B || next_ins.opt == OptType::JALR) && reg.CheckpointFull()) {
+    trace.IssueSlot(IssueStall::CheckpointFull);
+    return;
+  }
+  UnitClass unit = OptInfo(next_ins.opt).unit;
+  switch (unit) {
+    case UnitClass::Mul : case UnitClass::Div : {
+      if ((unit == UnitClass::Div) ? div_rss.full() : mul_rss.full()) {
+        trace.IssueSlot(IssueStall::MulDivRssFull);
+        return;
+      }
+      break;
+    }
+    case UnitClass::LoadStore : {
       if (ls_rss.full()) {
-        pc = pc_checkpoint;
+        ++lsb_stalls;
+        trace.IssueSlot((lsb.NextFull()) ? IssueStall::LsbFull : IssueStall::LsRssFull);
         return;
       }
+      break;
     }
-    else {
+    case UnitClass::Ari : {
       if (ari_rss.full()) {
-        pc = pc_checkpoint;
+        trace.IssueSlot(IssueStall::AriRssFull);
         return;
       }
+      break;
     }
+    case UnitClass::Commit : break;
   }
 
   // issue
-  if (next_code == 0x0ff00513) iu.stall = true;
-  InstructionUnit::Instruction next_ins = iu.DecodeSet(next_code, next_type);
-  int index = rob.issue(next_ins, reg, pc);
-  if ((next_ins.opt == OptType::LB || next_ins.opt == OptType::LH || next_ins.opt == OptType::LW || next_ins.opt == OptType::LBU || next_ins.opt == OptType::LHU) || next_type == InstructionType::S) {
-    ls_rss.issue(index, next_ins, reg, pc);
-  }
-  else {
-    ari_rss.issue(index, next_ins, reg, pc);
+  trace.IssueSlot(IssueStall::None);
+  Register::Renamed renamed = reg.Rename(next_ins, next.pc);
+  long long index = rob.issue(next_ins, renamed, next.pc, clk);
+  switch (unit) {
+    case UnitClass::LoadStore : {
+      int value = 0;
+      if (OptInfo(next_ins.opt).load && value_prediction && renamed.tag >= 0 && value_predictor.Predict(next.pc, value)
+          && !reg.CheckpointFull()) {
+        renamed.checkpoint = reg.PredictValue(renamed.tag, value);
+      }
+      ls_rss.issue(index, next_ins, renamed, next.pc, value);
+      break;
+    }
+    case UnitClass::Mul : mul_rss.issue(index, next_ins, renamed, next.pc); break;
+    case UnitClass::Div : div_rss.issue(index, next_ins, renamed, next.pc); break;
+    case UnitClass::Commit : serialize_pending = true; break; // only in rob, it is done when it commits
+    case UnitClass::Ari : ari_rss.issue(index, next_ins, renamed, next.pc, next.predicted); break;
   }
-}
\ No newline at end of file
+  fetch_queue.pop();
+}
+
+template class CPU<TracePolicy>;
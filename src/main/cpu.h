@@ -7,48 +7,219 @@
 #include "../units/rob.h"
 #include "../storage/memory.h"
 #include "../units/rss.h"
+#include "../units/fetch_queue.h"
+#include "../units/value_predictor.h"
+#include "trace.h"
+#include "syscall.h"
+#include "../units/csr.h"
+#include "../cosim/checker.h"
+#include "../utils/aligned.h"
 
+/*
+ * Trace: instrumentation policy(see trace.h), hooks are called at stage boundaries and bus events
+ */
+template <typename Trace>
 class CPU {
+  friend Trace;
 public:
-  CPU() = default;
+  CPU() {lsb.SetOutput(&output);}
 
-  void Init() {
-    pc = mem.InitInstructions();
+  // read the program(in hex text) from is, return false if it is not a valid image(see Memory::InitInstructions)
+  bool Init(std::istream &is = std::cin) {
+    if (!mem.InitInstructions(is, pc)) return false;
+    SetBreak(mem.ImageEnd());
+    return true;
   }
 
+  // the heap of the program(brk) starts after addr
+  void SetBreak(int addr) {syscalls.SetBreak((addr + 15) & ~15);}
+
+  // files opened by the program are relative to dir(see SyscallEmulator)
+  void SetSandbox(const std::string &dir) {syscalls.SetSandbox(dir);}
+
+  // the file read by the program as stdin, return false if it can't be opened
+  bool SetInput(const std::string &path) {return syscalls.SetInput(path);}
+
+  // write the output buffered so far to the host
+  void FlushOutput() {output.Flush();}
+
+  /*
+   * back to a new CPU without a program: only the memory pages written by the last program are zeroed
+   * settings(bus policy, fusion, value prediction, prefetchers, symbols) are reset too, give them again
+   */
+  void Reset();
+
+  // run until .END is committed(or the checker diverges), return a0 & 255
   u8 run();
 
+  // run one cycle, return true if the program is finished(Step does nothing then)
+  bool Step();
+
+  bool Finished() const {return finished;}
+
+  u8 ReturnValue() const {return ret_value;}
+
+  // start the program at pc instead of the address given by Init
+  void SetPc(int pc) {this->pc = pc;}
+
+  // commit the instructions in flight without issuing new ones, the next Step fetches again from the oldest one not issued
+  void Drain();
+
+  // committed value of x[num]
+  int ReadRegister(int num) const {return reg.ReadArch(num);}
+
+  // the pipeline is drained first(see Drain), then x[num] is changed
+  void WriteRegister(int num, int value) {
+    Drain();
+    reg.WriteArch(num, value);
+  }
+
+  // the pipeline is drained first, so all committed STs are in memory, addr + size should be in memory
+  void ReadMemory(int addr, u8 *data, int size) {
+    Drain();
+    for (int i = 0; i < size; ++i) data[i] = u8(mem.LoadByte(addr + i));
+  }
+
+  void WriteMemory(int addr, const u8 *data, int size) {
+    Drain();
+    for (int i = 0; i < size; ++i) mem.StoreByte(addr + i, data[i]);
+  }
+
+  long long Cycles() const {return clk + 1;}
+
+  long long Instructions() const {return instret;}
+
+  /*
+   * check every committed instruction against the reference model on another thread(call after Init)
+   * the simulation stops at the first divergence and dumps the pipeline to stderr
+   */
+  void EnableCosim() {
+    checker = MakeAligned<CosimChecker>(mem, pc);
+  }
+
+  bool CosimFailed() const {return checker != nullptr && checker->Diverged();}
+
+  // which results get ready_bus first when there are more results than slots
+  void SetBusPolicy(BusPolicy policy) {bus_policy = policy;}
+
+  // fuse adjacent pairs(lui + addi, auipc + jalr, slli + add, compare + branch) into one operation
+  void SetFusion(bool fusion) {iu.fusion = fusion;}
+
+  // give a confident LD its predicted value at issue, dependents don't wait for lsb
+  void SetValuePrediction(bool on) {value_prediction = on;}
+
+  // data prefetchers, kinds: bit i enables PrefetchKind(i), degree and distance: see Prefetcher
+  void SetPrefetch(unsigned kinds, int degree, int distance) {lsb.SetPrefetch(kinds, degree, distance);}
+
+  // cycles of a LD/ST in lsb hitting the data cache
+  void SetLsbLatency(int latency) {lsb.SetLatency(latency);}
+
+  // pc of the oldest instruction in flight(the next to commit), -1 if rob is empty
+  int HeadPc() {return rob.empty() ? -1 : rob.Front().pc;}
+
+  // statistics in json, performance counters are only collected by CounterTrace
+  void PrintStats(std::ostream &os) const {
+    JsonWriter json(os);
+    json.BeginObject();
+    json.Value("trace", Trace::Name());
+    json.Value("cycles", Cycles());
+    json.Value("bus_policy", (bus_policy == BusPolicy::LoadsFirst) ? "loads" : "oldest");
+    json.Value("syscalls", syscalls.Calls());
+    lsb.PrintStats(json);
+    json.BeginObject("units");
+    pool.PrintStats(json, Cycles());
+    FunctionalUnitPool::PrintUnit(json, "mul", mul.Ops(), mul.BusyCycles(), Cycles());
+    FunctionalUnitPool::PrintUnit(json, "div", div.Ops(), div.BusyCycles(), Cycles());
+    json.EndObject();
+    trace.PrintStats(json);
+    json.EndObject();
+  }
+
+  // interval samples of the performance counters(CounterTrace only, see IntervalSampler), empty path: none
+  bool SetSampling(const std::string &path, long long interval, bool by_instructions) {
+    return trace.SetSampling(path, interval, by_instructions);
+  }
+
+  // per-pc profile(CounterTrace only), symbols(may be nullptr) are used to name pcs and functions
+  void SetSymbols(const SymbolTable *symbols) {
+    trace.SetSymbols(symbols);
+  }
+
+  void PrintProfile(std::ostream &flat, std::ostream &collapsed) const {
+    trace.PrintProfile(flat, collapsed);
+  }
+
 private:
   class ArithmeticLogicUnit alu;
+  GuestOutput output; // stdout and stderr of the program, written by syscalls and the uart of lsb
   class ReorderBuffer rob;
   class InstructionUnit iu;
   class Register reg;
   class LoadStoreBuffer lsb;
   class Memory mem;
-  class ReservationStation ls_rss, ari_rss;
+  class ReservationStation ls_rss, ari_rss, mul_rss, div_rss;
+  class MultiplyUnit mul;
+  class DivideUnit div;
+  class FunctionalUnitPool pool; // ALUs, branch units and AGUs of ari_rss and ls_rss
   class Predictor predictor;
-  class CommonDataBus ready_bus, commit_bus;
-  int pc = 0;
-  bool pc_start = true;
-  int jump_pc = -1;
+  class ValuePredictor value_predictor;
+  bool value_prediction = false;
+  class CommonDataBus ready_bus{READY_BUS_WIDTH}, commit_bus{COMMIT_BUS_WIDTH};
+  BusPolicy bus_policy = BusPolicy::OldestFirst;
+  class FetchQueue fetch_queue;
+  int pc = 0; // next pc to fetch
+  int jump_pc = -1; // correct pc after a mispredicted branch/JALR(or LD), -1 if none
+  long long jump_label = -1; // the mispredicted branch/JALR(or LD)
+  int jump_checkpoint = -1;
+  int jump_tag = -1, jump_value = 0; // mispredicted LD: its physical register and the loaded value
   int clk = 0;
+  long long instret = 0; // committed instructions
   bool end_flag = false;
+  bool finished = false; // .END is committed or the checker diverged
+  bool draining = false; // issue is stopped by Drain
+  bool serialize_pending = false; // an ECALL or CSR instruction is in flight, issue waits until it commits
+  long long branch_mispredicts = 0, lsb_stalls = 0; // events of the hpmcounters(see HpmEvent)
+  long long csr_offsets[COUNTER_NUM] = {0}; // of the counter csrs, set by writes(see WriteCounterCsr)
+  SyscallEmulator syscalls{output};
+  std::vector<std::pair<int, u8>> syscall_written; // bytes stored by the last system call(for the checker)
   u8 ret_value = 0;
 
+  Trace trace;
+  bool end_fetched = false;
+  bool fetch_fault = false; // fetch stalled at an instruction that can't be decoded
+  AlignedPtr<CosimChecker> checker; // its queue has cache-line aligned indexes
+  int end_pc = 0;
+
   void ClearPipeline();
 
+  void Redirect(long long label, int checkpoint, int pc, int tag = -1, int value = 0);
+
+  void VerifyLoad(const LoadStoreBuffer::Loaded &loaded);
+
   void ExecuteRss();
 
+  void TryFetch();
+
   void TryIssue();
 
   void AccessMem();
 
   void TryCommit();
 
+  // the ECALL at the head of rob commits: the system call of a7, return true if the program exits
+  bool Syscall(int pc);
+
+  // the CSR instruction at the head of rob commits: return the value read from its csr(a counter, see csr.h), then write it
+  int ExecuteCsr(const ReorderBuffer::RoBEntry &entry);
+
+  void WriteBack();
+
   void CheckBus();
 
   void Flush();
 
+  void DumpDivergence();
+
 };
 
 #endif //RISCV_SIMULATOR_CPU_H
@@ -1,9 +1,82 @@
 #include <iostream>
-#include "cpu.h"
+#include <fstream>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include "../api/simulator.h"
 
-int main () {
-  CPU cpu;
-  cpu.Init();
-  std::cout << int(cpu.run());
+/*
+ * a client of the simulator library(see src/api/simulator.h)
+ * usage: code [--stats <file>] [--profile <prefix>] [--symbols <elf>] [--cosim] [--bus-policy <oldest|loads>] [--no-fusion] [--value-prediction]
+ *             [--prefetch <kinds>] [--prefetch-degree <n>] [--prefetch-distance <n>] [--sandbox <dir>] [--input <file>]
+ *             [--samples <file>] [--sample-interval <n>] [--sample-by <cycles|instructions>] < program
+ * --stats: write performance counters in json to <file> at exit("-" for stderr)
+ * --profile: write the per-pc profile to <prefix>.flat and the collapsed stacks to <prefix>.collapsed
+ * --symbols: name pcs and functions in the profile with the symbol table of the elf file
+ * --cosim: check every committed instruction against a functional reference model on another thread,
+ *          stop at the first divergence(exit status 1)
+ * --bus-policy: which results get ready_bus first when there are more results than slots
+ *               oldest(default): smaller rob label first, loads: LD results first
+ * --no-fusion: issue every instruction alone(adjacent pairs are fused into one operation by default)
+ * --value-prediction: a LD whose values follow a stride gets a predicted value at issue, its dependents don't wait for lsb
+ *                     (off by default: LDs still take their turn in lsb before they commit)
+ * --prefetch: data prefetchers, a comma separated list of next-line, stride, stream, or all/none(default: none)
+ * --prefetch-degree: prefetches for each trigger before throttling(default 2)
+ * --prefetch-distance: lines(strides for stride) between the trigger and the first prefetch(default 1)
+ * --sandbox: the program can open files in <dir>(ECALL open/openat, relative paths only)
+ * --input: the program reads <file> as stdin(the simulator's stdin is the program itself)
+ * --samples: write the counters of every interval to <file>(csv, binary if it ends with .bin), for phase analysis
+ * --sample-interval: cycles(or committed instructions with --sample-by instructions) per sample(default 10000)
+ * the output of the program(ECALL write to fd 1, 2, the uart at UART_BASE) goes to stdout, stderr before the exit code
+ */
+int main (int argc, char *argv[]) {
+  const char *stats_file = nullptr, *profile_prefix = nullptr, *elf_file = nullptr;
+  bool cosim = false;
+  Simulator sim;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) stats_file = argv[++i];
+    else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) profile_prefix = argv[++i];
+    else if (strcmp(argv[i], "--symbols") == 0 && i + 1 < argc) elf_file = argv[++i];
+    else if (strcmp(argv[i], "--cosim") == 0) cosim = true;
+    else if (strcmp(argv[i], "--no-fusion") == 0) sim.SetOption("fusion", "off");
+    else if (strcmp(argv[i], "--value-prediction") == 0) sim.SetOption("value-prediction", "on");
+    else if (i + 1 < argc && (strcmp(argv[i], "--prefetch") == 0 || strcmp(argv[i], "--prefetch-degree") == 0
+                               || strcmp(argv[i], "--prefetch-distance") == 0 || strcmp(argv[i], "--bus-policy") == 0
+                               || strcmp(argv[i], "--sandbox") == 0 || strcmp(argv[i], "--input") == 0
+                               || strcmp(argv[i], "--sample-interval") == 0 || strcmp(argv[i], "--sample-by") == 0
+                               || strcmp(argv[i], "--samples") == 0)) {
+      if (!sim.SetOption(argv[i] + 2, argv[i + 1])) std::cerr << "unknown value of " << argv[i] << ": " << argv[i + 1] << std::endl;
+      ++i;
+    }
+  }
+  if (elf_file != nullptr && !sim.LoadSymbols(elf_file)) {
+    std::cerr << "cannot read symbols from " << elf_file << std::endl;
+  }
+  std::string program((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+  if (!sim.LoadHex(program.data(), program.size())) {
+    std::cerr << "bad program" << std::endl;
+    return 1;
+  }
+  if (cosim) sim.EnableCosim();
+  int ret = sim.Run();
+  if (sim.Failed()) {
+    if (!sim.Error().empty()) std::cerr << sim.Error() << std::endl;
+    return 1;
+  }
+  std::cout << ret;
+  if (stats_file != nullptr) {
+    if (strcmp(stats_file, "-") == 0) {
+      sim.PrintStats(std::cerr);
+    }
+    else {
+      std::ofstream os(stats_file);
+      sim.PrintStats(os);
+    }
+  }
+  if (profile_prefix != nullptr) {
+    std::ofstream flat(std::string(profile_prefix) + ".flat");
+    std::ofstream collapsed(std::string(profile_prefix) + ".collapsed");
+    sim.PrintProfile(flat, collapsed);
+  }
   return 0;
 }
@@ -0,0 +1,168 @@
+#include "profiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+void Profiler::Commit(int pc, OptType opt, int rd, int rs1, int issue_clk, int ready_clk, int clk) {
+  PcProfile &entry = Get(pc);
+  ++entry.committed;
+  const OptMeta &meta = OptInfo(opt);
+  if (meta.load) {
+    ++entry.loads;
+    entry.load_latency += ready_clk - issue_clk;
+  }
+  if (!started || prev_control) entry.leader = true;
+
+  // calling context: the first instruction after a call is the entry of the callee
+  if (!started) {
+    nodes[0].func = pc;
+    started = true;
+  }
+  else if (pending_call) {
+    context = Child(context, pc);
+  }
+  else if (pending_tail) {
+    context = Child(nodes[context].parent, pc);
+  }
+  nodes[context].cycles += clk - last_commit_clk;
+  last_commit_clk = clk;
+
+  pending_call = pending_tail = false;
+  bool link = (rd == 1 || rd == 5);
+  if (opt == OptType::JAL || opt == OptType::JALR) {
+    if (link) {
+      pending_call = true;
+    }
+    else if (opt == OptType::JALR && rd == 0 && (rs1 == 1 || rs1 == 5)) {
+      if (nodes[context].parent != -1) context = nodes[context].parent; // return
+    }
+    else if (opt == OptType::JALR && rd == 0 && symbols != nullptr && nodes[context].parent != -1) {
+      pending_tail = true; // indirect jump out of the function: tail call
+    }
+  }
+  prev_control = meta.control;
+  entry.control = entry.control || prev_control;
+}
+
+int Profiler::Child(int node, u32 func) {
+  if (node < 0) node = 0;
+  std::map<u32, int>::iterator iter = nodes[node].children.find(func);
+  if (iter != nodes[node].children.end()) return iter->second;
+  nodes.push_back({node, func});
+  int ret = int(nodes.size()) - 1;
+  nodes[node].children[func] = ret;
+  return ret;
+}
+
+std::string Profiler::FuncName(u32 pc) const {
+  const SymbolTable::Symbol *sym = (symbols == nullptr) ? nullptr : symbols->Find(pc);
+  if (sym != nullptr) return sym->name;
+  std::ostringstream os;
+  os << "0x" << std::hex << pc;
+  return os.str();
+}
+
+std::string Profiler::PcName(u32 pc) const {
+  const SymbolTable::Symbol *sym = (symbols == nullptr) ? nullptr : symbols->Find(pc);
+  if (sym == nullptr) return "";
+  std::ostringstream os;
+  os << sym->name << "+0x" << std::hex << pc - sym->addr;
+  return os.str();
+}
+
+std::string Profiler::ContextName(int node) const {
+  if (nodes[node].parent == -1) return FuncName(nodes[node].func);
+  return ContextName(nodes[node].parent) + ";" + FuncName(nodes[node].func);
+}
+
+namespace {
+
+struct Row {
+  u32 pc = 0;
+  std::string name;
+  long long committed = 0;
+  long long head_cycles = 0;
+  long long mispredicts = 0;
+  long long loads = 0;
+  long long load_latency = 0;
+};
+
+void PrintRows(std::ostream &os, const char *title, std::vector<Row> &rows, long long total) {
+  std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+    return a.head_cycles != b.head_cycles ? a.head_cycles > b.head_cycles : a.pc < b.pc;
+  });
+  os << "# " << title << std::endl;
+  os << std::left << std::setw(10) << "# pc" << std::right << std::setw(12) << "committed" << std::setw(14) << "head_cycles"
+     << std::setw(9) << "%" << std::setw(13) << "mispredicts" << std::setw(10) << "loads" << std::setw(14) << "load_latency"
+     << "  name" << std::endl;
+  for (const Row &row : rows) {
+    os << std::left << std::setw(10) << std::hex << row.pc << std::dec << std::right
+       << std::setw(12) << row.committed << std::setw(14) << row.head_cycles
+       << std::setw(9) << std::fixed << std::setprecision(2) << (total ? 100.0 * row.head_cycles / total : 0)
+       << std::setw(13) << row.mispredicts << std::setw(10) << row.loads
+       << std::setw(14) << (row.loads ? double(row.load_latency) / row.loads : 0)
+       << "  " << row.name << std::endl;
+  }
+  os << std::endl;
+}
+
+void Add(Row &row, const Row &other) {
+  row.committed += other.committed;
+  row.head_cycles += other.head_cycles;
+  row.mispredicts += other.mispredicts;
+  row.loads += other.loads;
+  row.load_latency += other.load_latency;
+}
+
+}
+
+void Profiler::PrintFlat(std::ostream &os) const {
+  std::vector<Row> flat, blocks;
+  std::map<std::string, Row> funcs;
+  long long total = 0;
+  u32 prev_pc = 0;
+  bool prev_control_pc = true;
+  for (u32 page = 0; page < pages.size(); ++page) {
+    if (!pages[page]) continue;
+    for (u32 i = 0; i < PAGESIZE; ++i) {
+      const PcProfile &entry = pages[page][i];
+      if (entry.committed == 0 && entry.head_cycles == 0) continue;
+      u32 pc = (page * PAGESIZE + i) << 1;
+      Row row{pc, PcName(pc), entry.committed, entry.head_cycles, entry.mispredicts, entry.loads, entry.load_latency};
+      total += entry.head_cycles;
+      // a basic block starts at a leader, after a branch/jump, or after unexecuted code
+      if (blocks.empty() || entry.leader || prev_control_pc || pc > prev_pc + 4) {
+        blocks.push_back(row);
+      }
+      else {
+        Add(blocks.back(), row);
+      }
+      if (symbols != nullptr && !symbols->empty()) {
+        const SymbolTable::Symbol *sym = symbols->Find(pc);
+        Row &func = funcs[sym != nullptr ? sym->name : std::string("[unknown]")];
+        if (func.name.empty()) {
+          func.pc = (sym != nullptr) ? sym->addr : 0;
+          func.name = (sym != nullptr) ? sym->name : "[unknown]";
+        }
+        Add(func, row);
+      }
+      flat.push_back(row);
+      prev_pc = pc;
+      prev_control_pc = entry.control;
+    }
+  }
+  PrintRows(os, "instructions", flat, total);
+  PrintRows(os, "basic blocks(pc of the first instruction)", blocks, total);
+  if (!funcs.empty()) {
+    std::vector<Row> rows;
+    for (const std::pair<const std::string, Row> &func : funcs) rows.push_back(func.second);
+    PrintRows(os, "functions", rows, total);
+  }
+}
+
+void Profiler::PrintCollapsed(std::ostream &os) const {
+  for (int i = 0; i < int(nodes.size()); ++i) {
+    if (nodes[i].cycles == 0) continue;
+    os << ContextName(i) << " " << nodes[i].cycles << std::endl;
+  }
+}
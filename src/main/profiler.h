@@ -0,0 +1,101 @@
+
+#ifndef RISCV_SIMULATOR_PROFILER_H
+#define RISCV_SIMULATOR_PROFILER_H
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../utils/config.h"
+#include "../utils/symbol_table.h"
+#include "../units/instuction.h"
+
+/*
+ * per-pc hot-spot profiler of the guest program
+ * pc: committed instructions, cycles at the head of rob, mispredictions, load latency(issue to ready)
+ * call stack: calling context tree built from committed calls and returns,
+ *             cycles between two commits are charged to the current context
+ *
+ * counters of a pc live in pages allocated on first touch, so a commit costs one indexed access
+ */
+class Profiler {
+public:
+  Profiler() : pages((MEMSIZE >> 1) / PAGESIZE + 1) {
+    nodes.push_back({-1, 0});
+  }
+
+  void SetSymbols(const SymbolTable *symbols) {this->symbols = symbols;}
+
+  // called every cycle with the pc at the front of rob(if rob is not empty)
+  void HeadCycle(int pc) {
+    ++Get(pc).head_cycles;
+  }
+
+  /*
+   * called when the entry at the front of rob is committed
+   * issue_clk, ready_clk: used for load latency
+   */
+  void Commit(int pc, OptType opt, int rd, int rs1, int issue_clk, int ready_clk, int clk);
+
+  void Mispredict(int pc) {
+    ++Get(pc).mispredicts;
+  }
+
+  /*
+   * flat profile sorted by cycles at the head of rob,
+   * then the same counters rolled up into basic blocks, and into functions if symbols are given
+   */
+  void PrintFlat(std::ostream &os) const;
+
+  // one line per calling context: "f1;f2;f3 cycles", the input format of flamegraph.pl
+  void PrintCollapsed(std::ostream &os) const;
+
+private:
+  static constexpr int PAGESIZE = 1024;
+
+  struct PcProfile {
+    long long committed = 0;
+    long long head_cycles = 0;
+    long long mispredicts = 0;
+    long long loads = 0;
+    long long load_latency = 0;
+    bool leader = false; // first instruction of a basic block
+    bool control = false; // branch or jump, last instruction of a basic block
+  };
+
+  // calling context tree, nodes[0] is the root(program entry)
+  struct ContextNode {
+    int parent = -1;
+    u32 func = 0; // pc of the callee entry
+    long long cycles = 0;
+    std::map<u32, int> children;
+  };
+
+  std::vector<std::unique_ptr<PcProfile[]>> pages;
+  std::vector<ContextNode> nodes;
+  const SymbolTable *symbols = nullptr;
+  int context = 0;
+  int last_commit_clk = 0;
+  bool started = false;
+  bool prev_control = false;
+  bool pending_call = false;
+  bool pending_tail = false;
+
+  PcProfile &Get(int pc) {
+    u32 index = u32(pc) >> 1;
+    std::unique_ptr<PcProfile[]> &page = pages[index / PAGESIZE];
+    if (!page) page.reset(new PcProfile[PAGESIZE]);
+    return page[index % PAGESIZE];
+  }
+
+  int Child(int node, u32 func);
+
+  std::string FuncName(u32 pc) const;
+
+  std::string PcName(u32 pc) const;
+
+  std::string ContextName(int node) const;
+};
+
+#endif //RISCV_SIMULATOR_PROFILER_H
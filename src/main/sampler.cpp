@@ -0,0 +1,110 @@
+#include "sampler.h"
+#include <chrono>
+#include <vector>
+
+namespace {
+
+constexpr unsigned SAMPLE_VERSION = 1;
+
+// fixed columns before the occupancy and the stall slots
+const char *const COLUMNS[] = {
+    "sample", "cycle", "instret", "cycles", "instructions", "ipc",
+    "branches", "mispredicts", "mispredict_rate", "load_latency"
+};
+
+double Ratio(long long a, long long b) {
+  return b == 0 ? 0 : double(a) / double(b);
+}
+
+}
+
+IntervalSampler::IntervalSampler(long long interval, bool by_instructions, const PerfCounter &start)
+    : interval(interval), by_instructions(by_instructions), queue(MakeAligned<SpscQueue<Item, 1 << 12>>()) {
+  start.GetTotals(last);
+  next = (by_instructions ? start.Retired() : start.Cycles()) + interval;
+}
+
+IntervalSampler::~IntervalSampler() {
+  if (writer.joinable()) {
+    Item item;
+    item.end = true;
+    queue->push(item);
+    writer.join();
+  }
+  if (file != nullptr) fclose(file);
+}
+
+bool IntervalSampler::Open(const std::string &path) {
+  file = fopen(path.c_str(), "wb");
+  if (file == nullptr) return false;
+  binary = path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+  WriteHeader();
+  writer = std::thread(&IntervalSampler::Run, this);
+  return true;
+}
+
+void IntervalSampler::Push(const PerfCounter &counter, bool end) {
+  if (!writer.joinable()) return;
+  Item item;
+  counter.GetTotals(item.totals);
+  item.end = end;
+  queue->push(item);
+}
+
+void IntervalSampler::Finish(const PerfCounter &counter) {
+  if (!writer.joinable()) return;
+  Push(counter, true);
+  writer.join();
+  fflush(file);
+}
+
+// pop samples until the end item(it is written too if it has any cycles), sleep while the queue is empty
+void IntervalSampler::Run() {
+  Item item;
+  while (true) {
+    if (!queue->pop(item)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    if (!item.end || item.totals.cycles > last.cycles) WriteRow(item.totals);
+    if (item.end) break;
+  }
+}
+
+void IntervalSampler::WriteHeader() {
+  std::vector<std::string> names(std::begin(COLUMNS), std::end(COLUMNS));
+  for (int i = 0; i < PerfCounter::OCCUPANCY_NUM; ++i) names.push_back(PerfCounter::OccupancyName(i));
+  for (int i = 0; i < int(IssueStall::NUM); ++i) names.push_back(std::string("issue_") + PerfCounter::IssueName(i));
+  for (int i = 0; i < int(CommitStall::NUM); ++i) names.push_back(std::string("commit_") + PerfCounter::CommitName(i));
+  if (binary) {
+    unsigned header[2] = {SAMPLE_VERSION, unsigned(names.size())};
+    fwrite("RVTS", 1, 4, file);
+    fwrite(header, sizeof (unsigned), 2, file);
+    for (const std::string &name : names) fwrite(name.c_str(), 1, name.size() + 1, file);
+    return;
+  }
+  for (size_t i = 0; i < names.size(); ++i) fprintf(file, (i == 0) ? "%s" : ",%s", names[i].c_str());
+  fprintf(file, "\n");
+}
+
+void IntervalSampler::WriteRow(const PerfCounter::Totals &totals) {
+  long long cycles = totals.cycles - last.cycles, retired = totals.retired - last.retired;
+  long long branches = totals.branches - last.branches, flushes = totals.flushes - last.flushes;
+  std::vector<double> row = {
+      double(samples), double(totals.cycles), double(totals.retired), double(cycles), double(retired), Ratio(retired, cycles),
+      double(branches), double(flushes), Ratio(flushes, branches),
+      Ratio(totals.load_latency - last.load_latency, totals.loads - last.loads)
+  };
+  for (int i = 0; i < PerfCounter::OCCUPANCY_NUM; ++i) row.push_back(Ratio(totals.occupancy[i] - last.occupancy[i], cycles));
+  for (int i = 0; i < int(IssueStall::NUM); ++i) row.push_back(Ratio(totals.issue_slots[i] - last.issue_slots[i], cycles));
+  for (int i = 0; i < int(CommitStall::NUM); ++i) row.push_back(Ratio(totals.commit_slots[i] - last.commit_slots[i], cycles));
+  if (binary) {
+    fwrite(row.data(), sizeof (double), row.size(), file);
+  }
+  else {
+    for (size_t i = 0; i < row.size(); ++i) fprintf(file, (i == 0) ? "%.10g" : ",%.10g", row[i]);
+    fprintf(file, "\n");
+  }
+  last = totals;
+  ++samples;
+}
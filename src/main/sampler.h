@@ -0,0 +1,79 @@
+
+#ifndef RISCV_SIMULATOR_SAMPLER_H
+#define RISCV_SIMULATOR_SAMPLER_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include "../utils/aligned.h"
+#include "../utils/perf_counter.h"
+#include "../utils/spsc_queue.h"
+
+/*
+ * interval time series of the performance counters: a sample every interval cycles(or committed instructions)
+ * the simulation only copies the cumulative counters(PerfCounter::Totals) into a queue at the end of an interval,
+ * a writer thread takes the differences and writes the rows, so the cost per cycle is one comparison whatever the interval
+ *
+ * columns: sample, cycle, instret(at the end of the interval), cycles, instructions, ipc,
+ *          branches, mispredicts(flushes), mispredict_rate, load_latency(average of committed LDs, issue to ready),
+ *          average occupancy of fetch_queue, rob, ls_rss, ari_rss, mul_rss, div_rss, lsb,
+ *          issue_<stall>, commit_<stall>: fraction of the slots(see IssueStall, CommitStall)
+ * format: csv(a header line, then a line per sample), or binary if path ends with .bin:
+ *         "RVTS", u32 version(1), u32 columns, the column names(each ended by '\0'), then columns doubles per sample
+ *         (little endian)
+ */
+class IntervalSampler {
+public:
+  // start: the counters when sampling starts, the first interval begins there
+  IntervalSampler(long long interval, bool by_instructions, const PerfCounter &start);
+
+  ~IntervalSampler();
+
+  IntervalSampler(const IntervalSampler &) = delete;
+
+  IntervalSampler &operator=(const IntervalSampler &) = delete;
+
+  // open path and start the writer thread, return false if path can't be written
+  bool Open(const std::string &path);
+
+  // called every cycle(after PerfCounter::Sample)
+  void Tick(const PerfCounter &counter) {
+    if ((by_instructions ? counter.Retired() : counter.Cycles()) < next) return;
+    Push(counter, false);
+    next += interval;
+  }
+
+  // the program is finished: the last(partial) interval is sampled, wait until everything is written
+  void Finish(const PerfCounter &counter);
+
+  long long Interval() const {return interval;}
+
+  bool ByInstructions() const {return by_instructions;}
+
+private:
+  struct Item {
+    PerfCounter::Totals totals;
+    bool end;
+  };
+
+  long long interval;
+  bool by_instructions;
+  long long next;
+  PerfCounter::Totals last; // writer: the counters at the end of the last sample
+  FILE *file = nullptr;
+  bool binary = false;
+  long long samples = 0;
+  AlignedPtr<SpscQueue<Item, 1 << 12>> queue; // see MakeAligned
+  std::thread writer;
+
+  void Push(const PerfCounter &counter, bool end);
+
+  void Run();
+
+  void WriteHeader();
+
+  void WriteRow(const PerfCounter::Totals &totals);
+};
+
+#endif //RISCV_SIMULATOR_SAMPLER_H
@@ -0,0 +1,196 @@
+#include "syscall.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// riscv Linux system call numbers(used by newlib)
+constexpr int SYS_OPENAT = 56;
+constexpr int SYS_CLOSE = 57;
+constexpr int SYS_LSEEK = 62;
+constexpr int SYS_READ = 63;
+constexpr int SYS_WRITE = 64;
+constexpr int SYS_EXIT = 93;
+constexpr int SYS_EXIT_GROUP = 94;
+constexpr int SYS_CLOCK_GETTIME = 113;
+constexpr int SYS_BRK = 214;
+constexpr int SYS_CLOCK_GETTIME64 = 403;
+constexpr int SYS_OPEN = 1024; // newlib's open without a directory
+
+// open flags of newlib
+constexpr int NEWLIB_ACCMODE = 0x3;
+constexpr int NEWLIB_APPEND = 0x8;
+constexpr int NEWLIB_CREAT = 0x200;
+constexpr int NEWLIB_TRUNC = 0x400;
+constexpr int NEWLIB_EXCL = 0x800;
+constexpr int AT_FDCWD_GUEST = -100;
+
+constexpr int MAX_PATH = 4096;
+
+}
+
+SyscallEmulator::~SyscallEmulator() {
+  Reset();
+  if (input >= 0) close(input);
+}
+
+bool SyscallEmulator::SetInput(const std::string &path) {
+  if (input >= 0) close(input);
+  input = -1;
+  if (path.empty()) return true;
+  input = open(path.c_str(), O_RDONLY);
+  return input >= 0;
+}
+
+void SyscallEmulator::Reset() {
+  Flush();
+  for (int fd : files) {
+    if (fd >= 0) close(fd);
+  }
+  files.clear();
+  brk = initial_brk = 0;
+  calls = 0;
+  if (input >= 0) lseek(input, 0, SEEK_SET);
+}
+
+void SyscallEmulator::Flush() {
+  output.Flush();
+}
+
+SyscallEmulator::Result SyscallEmulator::Call(Memory &mem, int number, const int args[6], long long clk,
+                                              std::vector<std::pair<int, u8>> *written) {
+  Result ret;
+  ++calls;
+  switch (number) {
+    case SYS_WRITE : ret.value = Write(mem, args[0], args[1], args[2]); break;
+    case SYS_READ : ret.value = Read(mem, args[0], args[1], args[2], written); break;
+    case SYS_EXIT :
+    case SYS_EXIT_GROUP : {
+      Flush();
+      ret.exit = true;
+      ret.value = args[0];
+      break;
+    }
+    case SYS_BRK : {
+      // brk(0) asks for the break, a break outside [initial break, MEMSIZE) is refused(the old one is returned)
+      if (args[0] >= initial_brk && args[0] < MEMSIZE) brk = args[0];
+      ret.value = brk;
+      break;
+    }
+    case SYS_CLOCK_GETTIME :
+    case SYS_CLOCK_GETTIME64 : ret.value = ClockGettime(mem, args[1], clk, written); break;
+    case SYS_OPENAT : {
+      ret.value = (args[0] == AT_FDCWD_GUEST) ? Open(mem, args[1], args[2], args[3]) : -EBADF;
+      break;
+    }
+    case SYS_OPEN : ret.value = Open(mem, args[0], args[1], args[2]); break;
+    case SYS_CLOSE : {
+      if (args[0] >= 0 && args[0] <= 2) {
+        ret.value = 0;
+        break;
+      }
+      int fd = HostFd(args[0]);
+      if (fd < 0) {
+        ret.value = -EBADF;
+        break;
+      }
+      close(fd);
+      files[args[0] - 3] = -1;
+      ret.value = 0;
+      break;
+    }
+    case SYS_LSEEK : {
+      int fd = (args[0] == 0) ? input : HostFd(args[0]);
+      if (args[0] == 1 || args[0] == 2) ret.value = -ESPIPE;
+      else if (fd < 0) ret.value = -EBADF;
+      else {
+        off_t pos = lseek(fd, off_t(args[1]), args[2]);
+        ret.value = (pos < 0) ? -errno : int(pos);
+      }
+      break;
+    }
+    default: ret.value = -ENOSYS;
+  }
+  return ret;
+}
+
+int SyscallEmulator::Write(Memory &mem, int fd, int buf, int count) {
+  if (!InMemory(buf, count)) return -EFAULT;
+  if (fd == 1 || fd == 2) {
+    for (int i = 0; i < count; ++i) output.Write(fd, char(mem.LoadByte(buf + i)));
+    return count;
+  }
+  int host = HostFd(fd);
+  if (host < 0) return -EBADF;
+  std::string tmp(size_t(count), '\0');
+  for (int i = 0; i < count; ++i) tmp[i] = char(mem.LoadByte(buf + i));
+  ssize_t len = write(host, tmp.data(), tmp.size());
+  return (len < 0) ? -errno : int(len);
+}
+
+int SyscallEmulator::Read(Memory &mem, int fd, int buf, int count, std::vector<std::pair<int, u8>> *written) {
+  if (!InMemory(buf, count)) return -EFAULT;
+  if (fd == 1 || fd == 2) return -EBADF;
+  int host = (fd == 0) ? input : HostFd(fd);
+  if (fd == 0 && host < 0) return 0; // no input: end of file
+  if (host < 0) return -EBADF;
+  std::string tmp(size_t(count), '\0');
+  ssize_t len = read(host, &tmp[0], tmp.size());
+  if (len < 0) return -errno;
+  for (int i = 0; i < int(len); ++i) Store(mem, buf + i, u8(tmp[i]), written);
+  return int(len);
+}
+
+int SyscallEmulator::Open(Memory &mem, int path, int flags, int mode) {
+  std::string name;
+  for (int addr = path; ; ++addr) {
+    if (!InMemory(addr, 1) || name.size() >= MAX_PATH) return -EFAULT;
+    char c = char(mem.LoadByte(addr));
+    if (c == '\0') break;
+    name.push_back(c);
+  }
+  // a relative path without .. stays in the sandbox
+  if (sandbox.empty() || name.empty() || name[0] == '/') return -EACCES;
+  for (size_t begin = 0; begin <= name.size(); ) {
+    size_t end = name.find('/', begin);
+    if (end == std::string::npos) end = name.size();
+    if (name.compare(begin, end - begin, "..") == 0) return -EACCES;
+    begin = end + 1;
+  }
+  int host_flags = flags & NEWLIB_ACCMODE; // O_RDONLY, O_WRONLY, O_RDWR are the same
+  if (flags & NEWLIB_APPEND) host_flags |= O_APPEND;
+  if (flags & NEWLIB_CREAT) host_flags |= O_CREAT;
+  if (flags & NEWLIB_TRUNC) host_flags |= O_TRUNC;
+  if (flags & NEWLIB_EXCL) host_flags |= O_EXCL;
+  int fd = open((sandbox + "/" + name).c_str(), host_flags, mode & 0777);
+  if (fd < 0) return -errno;
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (files[i] < 0) {
+      files[i] = fd;
+      return int(i) + 3;
+    }
+  }
+  files.push_back(fd);
+  return int(files.size()) + 2;
+}
+
+int SyscallEmulator::ClockGettime(Memory &mem, int tp, long long clk, std::vector<std::pair<int, u8>> *written) {
+  // struct timespec of rv32: 64-bit tv_sec, 32-bit tv_nsec
+  if (!InMemory(tp, 12)) return -EFAULT;
+  long long sec = clk / SIM_CLOCK_HZ;
+  long long nsec = (clk % SIM_CLOCK_HZ) * 1000000000LL / SIM_CLOCK_HZ;
+  for (int i = 0; i < 8; ++i) Store(mem, tp + i, u8(sec >> (8 * i)), written);
+  for (int i = 0; i < 4; ++i) Store(mem, tp + 8 + i, u8(nsec >> (8 * i)), written);
+  return 0;
+}
+
+int SyscallEmulator::HostFd(int fd) const {
+  if (fd < 3 || fd - 3 >= int(files.size())) return -1;
+  return files[fd - 3];
+}
+
+void SyscallEmulator::Store(Memory &mem, int addr, u8 value, std::vector<std::pair<int, u8>> *written) {
+  mem.StoreByte(addr, value);
+  if (written != nullptr) written->emplace_back(addr, value);
+}
@@ -0,0 +1,84 @@
+
+#ifndef RISCV_SIMULATOR_SYSCALL_H
+#define RISCV_SIMULATOR_SYSCALL_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "../storage/memory.h"
+#include "../utils/guest_output.h"
+
+/*
+ * newlib-style system calls(riscv Linux numbers, a7: number, a0 ~ a5: arguments, a0: result or -errno)
+ * executed when an ECALL commits(see CPU::TryCommit)
+ *
+ * write, read, exit, exit_group, brk, clock_gettime, openat/open, close, lseek
+ * fd 1, 2: the host stdout, stderr, through output(shared with the uart, see GuestOutput)
+ * fd 0: the input file(SetInput), empty if none
+ * open: only relative paths inside the sandbox directory(SetSandbox), refused if there is no sandbox
+ *       flags in the newlib encoding
+ * clock_gettime: the simulated time, cycles at SIM_CLOCK_HZ
+ */
+class SyscallEmulator {
+public:
+  struct Result {
+    int value = 0; // a0
+    bool exit = false; // the program is finished, value is the exit code
+  };
+
+  explicit SyscallEmulator(GuestOutput &output) : output(output) {}
+
+  SyscallEmulator(const SyscallEmulator &) = delete;
+
+  SyscallEmulator &operator=(const SyscallEmulator &) = delete;
+
+  ~SyscallEmulator();
+
+  // files opened by the program are relative to dir(empty: open is refused)
+  void SetSandbox(const std::string &dir) {sandbox = dir;}
+
+  // the file read as fd 0(empty: none), return false if it can't be opened
+  bool SetInput(const std::string &path);
+
+  // the program break starts after the program image
+  void SetBreak(int addr) {brk = initial_brk = addr;}
+
+  /*
+   * args: a0 ~ a5, clk: cycles so far
+   * written(may be nullptr): the bytes the call stored in memory(addr, value), for the checker
+   */
+  Result Call(Memory &mem, int number, const int args[6], long long clk, std::vector<std::pair<int, u8>> *written);
+
+  // write the buffered output to the host
+  void Flush();
+
+  // flush, close the files of the program, forget the break(the sandbox and the input are kept, read from the start)
+  void Reset();
+
+  long long Calls() const {return calls;}
+
+private:
+  std::string sandbox;
+  int input = -1; // host fd of the input file
+  std::vector<int> files; // host fds of guest fds 3, 4, ...(-1 if closed)
+  GuestOutput &output;
+  int brk = 0, initial_brk = 0;
+  long long calls = 0;
+
+  int Write(Memory &mem, int fd, int buf, int count);
+
+  int Read(Memory &mem, int fd, int buf, int count, std::vector<std::pair<int, u8>> *written);
+
+  int Open(Memory &mem, int path, int flags, int mode);
+
+  int ClockGettime(Memory &mem, int tp, long long clk, std::vector<std::pair<int, u8>> *written);
+
+  // host fd of a guest fd > 2, -1 if it is not open
+  int HostFd(int fd) const;
+
+  static bool InMemory(int addr, int size) {return addr >= 0 && size >= 0 && addr <= MEMSIZE - size;}
+
+  static void Store(Memory &mem, int addr, u8 value, std::vector<std::pair<int, u8>> *written);
+};
+
+#endif //RISCV_SIMULATOR_SYSCALL_H
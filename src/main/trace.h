@@ -0,0 +1,287 @@
+
+#ifndef RISCV_SIMULATOR_TRACE_H
+#define RISCV_SIMULATOR_TRACE_H
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include "../utils/json.h"
+#include "../utils/perf_counter.h"
+#include "../units/register.h"
+#include "profiler.h"
+#include "sampler.h"
+
+// stages of a cycle, in the same order as the stage functions in CPU::run
+enum class Stage {
+  Issue, Execute, AccessMem, Commit, Fetch
+};
+
+/*
+ * instrumentation policies of the cycle loop, selected at compile time(TRACE_POLICY in CMakeLists.txt)
+ * CPU and the units call the hooks below at stage boundaries and bus events
+ *
+ * NoTrace: every hook is empty and is inlined away
+ * DebugTrace: dump rob, rss, lsb and buses after every stage
+ * CommitTrace: log every execution, memory access and commit(with registers)
+ * CounterTrace: performance counters(--stats) and per-pc profiler(--profile)
+ *
+ * the other policies derive from NoTrace and hide the hooks they need
+ */
+class NoTrace {
+public:
+  static const char *Name() {return "NoTrace";}
+
+  template <typename Cpu>
+  void BeginCycle(Cpu &cpu) {}
+
+  template <typename Cpu>
+  void AfterStage(Stage stage, Cpu &cpu) {}
+
+  // after all stages, before the buses are checked
+  template <typename Cpu>
+  void EndCycle(Cpu &cpu) {}
+
+  // the program is finished
+  template <typename Cpu>
+  void End(Cpu &cpu) {}
+
+  void IssueSlot(IssueStall stall) {}
+
+  void CommitSlot(CommitStall stall) {}
+
+  // an entry of rss is executed, value: result(ari) or address(ls)
+  void Execute(long long label, OptType opt, int value) {}
+
+  // lsb finished a LD/ST
+  void MemAccess(long long label, OptType opt, int addr, int value) {}
+
+  // a LD got its value(loaded or forwarded), predicted: it was issued with a predicted value
+  void LoadValue(bool predicted, bool correct) {}
+
+  // the entry at the front of rob is committed
+  template <typename Entry>
+  void Commit(const Entry &entry, const Register &reg) {}
+
+  template <typename Entry>
+  void Mispredict(const Entry &entry) {}
+
+  void Squash(int squashed) {}
+
+  // after the buses are arbitrated: requests that didn't get a slot
+  void BusConflict(int ready_waiting, int commit_waiting) {}
+
+  void SetSymbols(const SymbolTable *symbols) {}
+
+  // interval samples of the counters to path(empty: none), return false if they can't be written
+  bool SetSampling(const std::string &path, long long interval, bool by_instructions) {return path.empty();}
+
+  void PrintStats(JsonWriter &json) const {}
+
+  void PrintProfile(std::ostream &flat, std::ostream &collapsed) const {}
+};
+
+class DebugTrace : public NoTrace {
+public:
+  static const char *Name() {return "DebugTrace";}
+
+  template <typename Cpu>
+  void BeginCycle(Cpu &cpu) {
+    std::cout << std::endl;
+    std::cout << "clock cycle " << std::dec << cpu.clk << ": pc = " << std::hex << cpu.pc << std::dec << std::endl;
+  }
+
+  template <typename Cpu>
+  void AfterStage(Stage stage, Cpu &cpu) {
+    switch (stage) {
+      case Stage::Issue : {
+        std::cout << std::endl << "ROB_AFTER_ISSUE: " << std::endl;
+        cpu.rob.Print();
+        std::cout << std::endl << "LS_RSS_AFTER_ISSUE: " << std::endl;
+        cpu.ls_rss.print();
+        std::cout << "-----------------ARI_RSS_AFTER_ISSUE--------------------" << std::endl;
+        cpu.ari_rss.print();
+        std::cout << "-----------------MUL_RSS_AFTER_ISSUE--------------------" << std::endl;
+        cpu.mul_rss.print();
+        std::cout << "-----------------DIV_RSS_AFTER_ISSUE--------------------" << std::endl;
+        cpu.div_rss.print();
+        break;
+      }
+      case Stage::Execute : {
+        std::cout << std::endl << "LS_RSS_AFTER_EXECUTE: " << std::endl;
+        cpu.ls_rss.print();
+        std::cout << std::endl << "LSB_AFTER_EXECUTE: " << std::endl;
+        cpu.lsb.print();
+        std::cout << "-----------------ARI_RSS_AFTER_EXECUTE--------------------" << std::endl;
+        cpu.ari_rss.print();
+        std::cout << "-----------------MUL_RSS_AFTER_EXECUTE--------------------" << std::endl;
+        cpu.mul_rss.print();
+        std::cout << "-----------------DIV_RSS_AFTER_EXECUTE--------------------" << std::endl;
+        cpu.div_rss.print();
+        break;
+      }
+      case Stage::AccessMem : {
+        std::cout << std::endl << "LSB_AFTER_ACCESS_MEM: " << std::endl;
+        cpu.lsb.print();
+        break;
+      }
+      case Stage::Commit : {
+        std::cout << std::endl << "ROB_AFTER_COMMIT: " << std::endl;
+        cpu.rob.Print();
+        break;
+      }
+      case Stage::Fetch : {
+        std::cout << std::endl << "FETCH_QUEUE_AFTER_FETCH: " << std::endl;
+        cpu.fetch_queue.print();
+        break;
+      }
+    }
+  }
+
+  template <typename Cpu>
+  void EndCycle(Cpu &cpu) {
+    std::cout << std::endl << "READY_BUS: " << std::endl;
+    cpu.ready_bus.print();
+    std::cout << std::endl << "COMMIT_BUS: " << std::endl;
+    cpu.commit_bus.print();
+  }
+};
+
+class CommitTrace : public NoTrace {
+public:
+  static const char *Name() {return "CommitTrace";}
+
+  template <typename Cpu>
+  void BeginCycle(Cpu &cpu) {clk = cpu.clk;}
+
+  void Execute(long long label, OptType opt, int value) {
+    std::cout << std::dec << clk << ": execute label = " << label << ", value = " << std::hex << value << std::dec << std::endl;
+  }
+
+  void MemAccess(long long label, OptType opt, int addr, int value) {
+    std::cout << std::dec << clk << ": memory label = " << label << ", addr = " << std::hex << addr
+              << ", value = " << value << std::dec << std::endl;
+  }
+
+  template <typename Entry>
+  void Commit(const Entry &entry, const Register &reg) {
+    std::cout << std::hex << "commit: pc = " << entry.pc << std::dec << std::endl;
+    reg.print();
+  }
+
+  template <typename Entry>
+  void Mispredict(const Entry &entry) {
+    std::cout << std::dec << clk << ": mispredict pc = " << std::hex << entry.pc << std::dec << std::endl;
+  }
+
+private:
+  int clk = 0;
+};
+
+class CounterTrace : public NoTrace {
+public:
+  static const char *Name() {return "CounterTrace";}
+
+  template <typename Cpu>
+  void EndCycle(Cpu &cpu) {
+    counter.Sample(issue_stall, commit_stall, cpu.rob.HeadIsMemory(), cpu.fetch_queue.size(),
+                   cpu.rob.size(), cpu.ls_rss.size(), cpu.ari_rss.size(), cpu.mul_rss.size(), cpu.div_rss.size(),
+                   cpu.lsb.size());
+    if (sampler != nullptr) sampler->Tick(counter);
+    if (!cpu.rob.empty()) profiler.HeadCycle(cpu.rob.Front().pc);
+    ++clk;
+  }
+
+  template <typename Cpu>
+  void End(Cpu &cpu) {
+    if (sampler != nullptr) sampler->Finish(counter);
+  }
+
+  // the issue slot is counted as recovery until an instruction is issued after a flush
+  void IssueSlot(IssueStall stall) {
+    if (stall == IssueStall::FetchQueueEmpty && refilling) stall = IssueStall::Recovery;
+    else if (stall == IssueStall::None) refilling = false;
+    issue_stall = stall;
+  }
+
+  // the commit slot is counted as a misprediction until rob is refilled after a flush
+  void CommitSlot(CommitStall stall) {
+    if (stall == CommitStall::Empty && recovering) stall = CommitStall::Mispredict;
+    else recovering = false;
+    commit_stall = stall;
+  }
+
+  template <typename Entry>
+  void Commit(const Entry &entry, const Register &reg) {
+    if (entry.fused == FusedType::None) counter.Retire(entry.len);
+    else counter.RetireFused(entry.fused, entry.len1, entry.len - entry.len1);
+    const OptMeta &meta = OptInfo(entry.opt);
+    if (meta.load) counter.RetireLoad(entry.ready_clk - entry.issue_clk);
+    else if (meta.branch || entry.opt == OptType::JALR) counter.RetireBranch();
+    if (entry.fused == FusedType::None) {
+      profiler.Commit(entry.pc, entry.opt, entry.rd, entry.rs1, entry.issue_clk, entry.ready_clk, clk);
+      return;
+    }
+    // a fused pair is profiled as its two instructions(the first one is never a load or a jump)
+    profiler.Commit(entry.pc, entry.opt1, entry.rd1, 0, entry.issue_clk, entry.ready_clk, clk);
+    profiler.Commit(entry.pc + entry.len1, entry.opt, entry.rd, entry.rs1, entry.issue_clk, entry.ready_clk, clk);
+  }
+
+  template <typename Entry>
+  void Mispredict(const Entry &entry) {
+    profiler.Mispredict((entry.fused == FusedType::None) ? entry.pc : entry.pc + entry.len1);
+  }
+
+  void Squash(int squashed) {
+    counter.Squash(squashed);
+    recovering = refilling = true;
+  }
+
+  void BusConflict(int ready_waiting, int commit_waiting) {counter.BusConflict(ready_waiting, commit_waiting);}
+
+  void LoadValue(bool predicted, bool correct) {counter.LoadValue(predicted, correct);}
+
+  void SetSymbols(const SymbolTable *symbols) {profiler.SetSymbols(symbols);}
+
+  // a new sampler unless the same one is running(sampling starts at the current counters)
+  bool SetSampling(const std::string &path, long long interval, bool by_instructions) {
+    if (sampler != nullptr && path == sampling_path && interval == sampler->Interval() && by_instructions == sampler->ByInstructions()) {
+      return true;
+    }
+    sampler.reset();
+    sampling_path.clear();
+    if (path.empty()) return true;
+    sampler.reset(new IntervalSampler(interval, by_instructions, counter));
+    if (!sampler->Open(path)) {
+      sampler.reset();
+      return false;
+    }
+    sampling_path = path;
+    return true;
+  }
+
+  void PrintStats(JsonWriter &json) const {counter.PrintJson(json);}
+
+  void PrintProfile(std::ostream &flat, std::ostream &collapsed) const {
+    profiler.PrintFlat(flat);
+    profiler.PrintCollapsed(collapsed);
+  }
+
+private:
+  class PerfCounter counter;
+  class Profiler profiler;
+  std::unique_ptr<IntervalSampler> sampler;
+  std::string sampling_path;
+  IssueStall issue_stall = IssueStall::None;
+  CommitStall commit_stall = CommitStall::None;
+  bool recovering = false; // rob is refilling after a misprediction
+  bool refilling = false; // fetch_queue is refilling after a misprediction
+  int clk = 0;
+};
+
+#ifndef RISCV_TRACE_POLICY
+#define RISCV_TRACE_POLICY CounterTrace
+#endif
+
+using TracePolicy = RISCV_TRACE_POLICY;
+
+#endif //RISCV_SIMULATOR_TRACE_H
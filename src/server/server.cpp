@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "../api/simulator.h"
+#include "../utils/config.h"
+
+/*
+ * simulation daemon: a pool of simulators(one per worker thread) serves jobs sent over a Unix domain socket
+ * the simulators are allocated once and reset between jobs(only the memory pages written by a job are zeroed)
+ *
+ * usage: server --socket <path> [--workers <n>] [--max-cycles <n>]
+ * --workers: worker threads = simulators(default: the number of host cores)
+ * --max-cycles: the limit of a job without max-cycles(default 1e9), a job that never ends can't hold a worker forever
+ *
+ * a connection is served by one worker, it can send any number of jobs, each answered before the next one is read
+ * jobs on different connections run in parallel
+ * job(text lines, the program line ends it):
+ *   option <name> <value>    see Simulator::SetOption(options only last for this job)
+ *                            sandbox, input and samples are refused: they name files of the host
+ *   cosim                    check every committed instruction against the reference model
+ *   max-cycles <n>           stop the job after n cycles(at most the limit given by --max-cycles, default 0: that limit)
+ *   program <size>           followed by size bytes of the program in hex text(at most MAX_PROGRAM_SIZE), the job starts
+ * reply:
+ *   status <ok|timeout|failed|error> [message]
+ *   exit <a0 & 255, -1 unless ok>
+ *   cycles <n>
+ *   instructions <n>
+ *   stats <size>             followed by size bytes of statistics in json(see CPU::PrintStats)
+ */
+namespace {
+
+// hex text of a program: about 3 bytes per byte of memory, with room for addresses and comments
+constexpr long long MAX_PROGRAM_SIZE = 4LL * MEMSIZE;
+
+// options a job can't set
+const char *const host_options[] = {"sandbox", "input", "samples"};
+
+// buffered reads of lines and blocks from a socket
+class Reader {
+public:
+  explicit Reader(int fd) : fd(fd) {}
+
+  // return false at the end of the stream
+  bool ReadLine(std::string &line) {
+    line.clear();
+    while (true) {
+      if (pos == buffer.size() && !Fill()) return !line.empty();
+      size_t end = buffer.find('\n', pos);
+      if (end == std::string::npos) {
+        line.append(buffer, pos, std::string::npos);
+        pos = buffer.size();
+        continue;
+      }
+      line.append(buffer, pos, end - pos);
+      pos = end + 1;
+      return true;
+    }
+  }
+
+  bool ReadBlock(size_t size, std::string &block) {
+    block.clear();
+    while (block.size() < size) {
+      if (pos == buffer.size() && !Fill()) return false;
+      size_t len = std::min(size - block.size(), buffer.size() - pos);
+      block.append(buffer, pos, len);
+      pos += len;
+    }
+    return true;
+  }
+
+private:
+  int fd;
+  std::string buffer;
+  size_t pos = 0;
+
+  bool Fill() {
+    char tmp[65536];
+    ssize_t len;
+    do {
+      len = read(fd, tmp, sizeof (tmp));
+    } while (len < 0 && errno == EINTR);
+    if (len <= 0) return false;
+    buffer.assign(tmp, size_t(len));
+    pos = 0;
+    return true;
+  }
+};
+
+bool WriteAll(int fd, const std::string &data) {
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t len = write(fd, data.data() + done, data.size() - done);
+    if (len < 0 && errno == EINTR) continue;
+    if (len <= 0) return false;
+    done += size_t(len);
+  }
+  return true;
+}
+
+struct Job {
+  std::vector<std::pair<std::string, std::string>> options;
+  bool cosim = false;
+  long long max_cycles = 0;
+  std::string program;
+};
+
+/*
+ * read the next job of a connection
+ * return 1 if a job is read, 0 at the end of the stream, -1 if the job is malformed(error is set)
+ */
+int ReadJob(Reader &reader, Job &job, std::string &error) {
+  job = Job();
+  std::string line;
+  while (reader.ReadLine(line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    std::istringstream is(line);
+    std::string key;
+    if (!(is >> key)) continue; // empty line
+    if (key == "option") {
+      std::string name, value;
+      if (!(is >> name >> value)) {
+        error = "option needs a name and a value";
+        return -1;
+      }
+      for (const char *host_option : host_options) {
+        if (name == host_option) {
+          error = "option " + name + " is not allowed in a job";
+          return -1;
+        }
+      }
+      job.options.emplace_back(name, value);
+    }
+    else if (key == "cosim") job.cosim = true;
+    else if (key == "max-cycles") {
+      if (!(is >> job.max_cycles) || job.max_cycles < 0) {
+        error = "bad max-cycles";
+        return -1;
+      }
+    }
+    else if (key == "program") {
+      long long size = -1;
+      if (!(is >> size) || size < 0 || size > MAX_PROGRAM_SIZE) {
+        error = "bad program size";
+        return -1;
+      }
+      if (!reader.ReadBlock(size_t(size), job.program)) return 0;
+      return 1;
+    }
+    else {
+      error = "unknown command " + key;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+std::string Reply(const std::string &status, int exit_code, long long cycles, long long instructions, const std::string &stats) {
+  std::ostringstream os;
+  os << "status " << status << "\nexit " << exit_code << "\ncycles " << cycles << "\ninstructions " << instructions
+     << "\nstats " << stats.size() << "\n" << stats;
+  return os.str();
+}
+
+std::string Run(Simulator &sim, const Job &job, long long default_max_cycles) {
+  sim.Reset(false);
+  for (const std::pair<std::string, std::string> &option : job.options) {
+    if (!sim.SetOption(option.first, option.second)) {
+      return Reply("error unknown option " + option.first + " " + option.second, -1, 0, 0, "");
+    }
+  }
+  if (!sim.LoadHex(job.program.data(), job.program.size())) return Reply("error bad program", -1, 0, 0, "");
+  if (job.cosim) sim.EnableCosim();
+  bool finished = sim.Step((job.max_cycles > 0) ? std::min(job.max_cycles, default_max_cycles) : default_max_cycles);
+  std::string status = "ok";
+  if (sim.Failed()) status = "failed " + sim.Error();
+  else if (!finished) status = "timeout";
+  int exit_code = (status == "ok") ? sim.ReturnValue() : -1;
+  return Reply(status, exit_code, sim.Cycles(), sim.Instructions(), sim.Stats());
+}
+
+// connections waiting for a worker
+class ConnectionQueue {
+public:
+  void Push(int fd) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      fds.push_back(fd);
+    }
+    cond.notify_one();
+  }
+
+  int Pop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this]() {return !fds.empty();});
+    int fd = fds.front();
+    fds.pop_front();
+    return fd;
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<int> fds;
+};
+
+// worker: serve connections with its own simulator
+void Serve(ConnectionQueue &queue, long long default_max_cycles) {
+  Simulator sim;
+  while (true) {
+    int fd = queue.Pop();
+    Reader reader(fd);
+    Job job;
+    std::string error;
+    while (true) {
+      int read = ReadJob(reader, job, error);
+      if (read == 0) break;
+      std::string reply = (read == 1) ? Run(sim, job, default_max_cycles) : Reply("error " + error, -1, 0, 0, "");
+      if (!WriteAll(fd, reply) || read == -1) break; // a malformed job: the rest of the stream can't be parsed
+    }
+    close(fd);
+  }
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  const char *path = nullptr;
+  int workers = int(std::thread::hardware_concurrency());
+  long long max_cycles = 1000000000;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) path = argv[++i];
+    else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) workers = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--max-cycles") == 0 && i + 1 < argc) max_cycles = atoll(argv[++i]);
+  }
+  if (path == nullptr || max_cycles <= 0) {
+    std::cerr << "usage: server --socket <path> [--workers <n>] [--max-cycles <n>]" << std::endl;
+    return 1;
+  }
+  if (workers <= 0) workers = 1;
+  signal(SIGPIPE, SIG_IGN); // a client gone before its reply: the write fails instead
+
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof (addr.sun_path)) {
+    std::cerr << "socket path too long" << std::endl;
+    return 1;
+  }
+  strcpy(addr.sun_path, path);
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);
+  if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof (addr)) < 0 || listen(listen_fd, 64) < 0) {
+    std::cerr << "cannot listen on " << path << ": " << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  ConnectionQueue queue;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < workers; ++i) threads.emplace_back(Serve, std::ref(queue), max_cycles);
+  while (true) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      std::cerr << "accept: " << strerror(errno) << std::endl;
+      break;
+    }
+    queue.Push(fd);
+  }
+  close(listen_fd);
+  unlink(path);
+  for (std::thread &thread : threads) thread.detach();
+  return 1;
+}
@@ -0,0 +1,186 @@
+
+#ifndef RISCV_SIMULATOR_CACHE_H
+#define RISCV_SIMULATOR_CACHE_H
+
+#include "../utils/config.h"
+#include "../utils/json.h"
+
+// the prefetchers of the data cache, a line brought by one of them remembers it until a LD/ST uses it
+enum class PrefetchKind {
+  NextLine, Stride, Stream, NUM
+};
+
+/*
+ * timing model of the data cache(tags only, values are always in Memory)
+ * set associative, LRU, write allocate: a LD/ST missing the cache takes DCACHE_MISS_PENALTY more cycles in lsb
+ * Access(): called by lsb when a LD/ST starts
+ * Prefetch(): a prefetcher asks for a line, it is filled DCACHE_MISS_PENALTY cycles later
+ * Tick(): called once per cycle by lsb
+ *
+ * counters of each prefetcher:
+ *   issued: prefetches sent to memory(lines already in the cache or in flight are not sent)
+ *   useful: prefetched lines used by a LD/ST, late: the LD/ST came while the prefetch was in flight
+ *   useless: prefetched lines evicted before any use
+ *   pollution: LD/ST misses on lines evicted by a prefetch
+ *   dropped: prefetches not sent because PREFETCH_QUEUE_SIZE prefetches are in flight
+ */
+class DataCache {
+public:
+  DataCache() = default;
+
+  /*
+   * a LD/ST accesses the line of addr, return the extra cycles(0 on a hit)
+   * trigger: the LD/ST missed or is the first use of a prefetched line(prefetchers train on them)
+   */
+  int Access(int addr, bool &trigger) {
+    u32 line = u32(addr) / DCACHE_LINE;
+    ++accesses;
+    Line *hit = Find(line);
+    if (hit != nullptr) {
+      trigger = hit->source >= 0;
+      if (trigger) {
+        ++counter[hit->source].useful;
+        hit->source = -1;
+      }
+      hit->used = ++stamp;
+      return 0;
+    }
+    ++misses;
+    trigger = true;
+    for (int i = 0; i < inflight_size; ++i) {
+      if (inflight[i].line == line) {
+        int remain = inflight[i].remain;
+        ++counter[inflight[i].source].useful;
+        ++counter[inflight[i].source].late;
+        inflight[i] = inflight[--inflight_size];
+        Fill(line, -1);
+        return remain;
+      }
+    }
+    Victim &victim = evicted[line % DCACHE_SETS];
+    if (victim.valid && victim.line == line) {
+      ++counter[victim.source].pollution;
+      victim.valid = false;
+    }
+    Fill(line, -1);
+    return DCACHE_MISS_PENALTY;
+  }
+
+  // return true if the prefetch is sent
+  bool Prefetch(u32 line, PrefetchKind kind) {
+    if (Find(line) != nullptr) return false;
+    for (int i = 0; i < inflight_size; ++i) {
+      if (inflight[i].line == line) return false;
+    }
+    if (inflight_size == PREFETCH_QUEUE_SIZE) {
+      ++counter[int(kind)].dropped;
+      return false;
+    }
+    inflight[inflight_size++] = {line, int(kind), DCACHE_MISS_PENALTY};
+    ++counter[int(kind)].issued;
+    return true;
+  }
+
+  // prefetches in flight move one cycle forward, the finished ones are filled
+  void Tick() {
+    for (int i = 0; i < inflight_size;) {
+      if (--inflight[i].remain > 0) {
+        ++i;
+        continue;
+      }
+      Fill(inflight[i].line, inflight[i].source);
+      inflight[i] = inflight[--inflight_size];
+    }
+  }
+
+  long long Misses() const {return misses;}
+
+  long long Issued(PrefetchKind kind) const {return counter[int(kind)].issued;}
+
+  long long Useful(PrefetchKind kind) const {return counter[int(kind)].useful;}
+
+  void PrintStats(JsonWriter &json) const {
+    json.BeginObject("dcache");
+    json.Value("size", DCACHE_LINE * DCACHE_SETS * DCACHE_WAYS);
+    json.Value("line", DCACHE_LINE);
+    json.Value("ways", DCACHE_WAYS);
+    json.Value("miss_penalty", DCACHE_MISS_PENALTY);
+    json.Value("accesses", accesses);
+    json.Value("misses", misses);
+    json.Value("miss_rate", (accesses == 0) ? 0 : double(misses) / double(accesses));
+    json.EndObject();
+  }
+
+  // counters of the prefetcher kind, accuracy: useful / issued, timeliness: useful in time / useful
+  void PrintPrefetchStats(JsonWriter &json, PrefetchKind kind) const {
+    const Counter &tmp = counter[int(kind)];
+    json.Value("issued", tmp.issued);
+    json.Value("useful", tmp.useful);
+    json.Value("late", tmp.late);
+    json.Value("useless", tmp.useless);
+    json.Value("pollution", tmp.pollution);
+    json.Value("dropped", tmp.dropped);
+    json.Value("accuracy", (tmp.issued == 0) ? 0 : double(tmp.useful) / double(tmp.issued));
+    json.Value("timeliness", (tmp.useful == 0) ? 0 : double(tmp.useful - tmp.late) / double(tmp.useful));
+  }
+
+private:
+  struct Line {
+    bool valid = false;
+    u32 line = 0;
+    int source = -1; // the prefetcher that brought the line, -1 after a LD/ST used it
+    long long used = 0; // for LRU
+  };
+  struct Victim {
+    bool valid = false;
+    u32 line = 0;
+    int source = -1; // the prefetcher whose fill evicted the line
+  };
+  struct Inflight {
+    u32 line = 0;
+    int source = -1;
+    int remain = 0;
+  };
+  struct Counter {
+    long long issued = 0, useful = 0, late = 0, useless = 0, pollution = 0, dropped = 0;
+  };
+
+  Line lines[DCACHE_SETS][DCACHE_WAYS];
+  Victim evicted[DCACHE_SETS]; // the last line evicted by a prefetch in each set
+  Inflight inflight[PREFETCH_QUEUE_SIZE];
+  int inflight_size = 0;
+  long long stamp = 0;
+  long long accesses = 0, misses = 0;
+  Counter counter[int(PrefetchKind::NUM)];
+
+  Line *Find(u32 line) {
+    Line *set = lines[line % DCACHE_SETS];
+    for (int i = 0; i < DCACHE_WAYS; ++i) {
+      if (set[i].valid && set[i].line == line) return &set[i];
+    }
+    return nullptr;
+  }
+
+  // put line in an empty way or the LRU one, source: the prefetcher(-1 for a LD/ST)
+  void Fill(u32 line, int source) {
+    Line *set = lines[line % DCACHE_SETS];
+    Line *way = &set[0];
+    for (int i = 0; i < DCACHE_WAYS; ++i) {
+      if (!set[i].valid) {
+        way = &set[i];
+        break;
+      }
+      if (set[i].used < way->used) way = &set[i];
+    }
+    if (way->valid) {
+      if (way->source >= 0) ++counter[way->source].useless;
+      if (source >= 0) evicted[line % DCACHE_SETS] = {true, way->line, source};
+    }
+    way->valid = true;
+    way->line = line;
+    way->source = source;
+    way->used = ++stamp;
+  }
+};
+
+#endif //RISCV_SIMULATOR_CACHE_H
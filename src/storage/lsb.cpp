@@ -1,187 +1,275 @@
 #include "lsb.h"
+#include "../main/trace.h"
 
 void LoadStoreBuffer::print() {
   std::cout << "count = " << count << std::endl;
   std::cout << "----------------LSB_NOW--------------------" << std::endl;
-  lsb_now.print();
+  Print(lsb_now);
   std::cout << "----------------LSB_NEXT--------------------" << std::endl;
-  lsb_next.print();
+  Print(lsb_next);
+}
+
+void LoadStoreBuffer::Print(const Window &window) {
+  for (long long i = window.head; i != window.tail; ++i) {
+    int slot = Slot(i);
+    std::cout << "label = " << slots.label[slot] << ", opt = ";
+    switch (slots.opt[slot]) {
+      case OptType::LB : std::cout << "LB"; break;
+      case OptType::LH : std::cout << "LH"; break;
+      case OptType::LW : std::cout << "LW"; break;
+      case OptType::LBU : std::cout << "LBU"; break;
+      case OptType::LHU : std::cout << "LHU"; break;
+      case OptType::SB : std::cout << "SB"; break;
+      case OptType::SH : std::cout << "SH"; break;
+      case OptType::SW : std::cout << "SW"; break;
+    }
+    std::cout << ", addr = " << std::hex << slots.addr[slot] << ", value = " << slots.entry[slot].value << std::dec;
+    if (slots.ready[slot]) std::cout << ", is ready." << std::endl;
+    else std::cout << ", is not ready." << std::endl;
+  }
 }
 
 void LoadStoreBuffer::flush() {
   lsb_now = lsb_next;
 }
 
+// a slot out of lsb_next may match too(a ST squashed before): its ready is set again when it is pushed
 void LoadStoreBuffer::CheckBus(const CommonDataBus &cdb) {
-  if (lsb_next.empty()) return;
-  CircularQueue<LsbEntry, LSBSIZE>::iterator iter = lsb_next.front();
-  while (iter != lsb_next.end()) {
-    if (iter->opt == OptType::SB || iter->opt == OptType::SH || iter->opt == OptType::SW) {
-      if (!iter->ready) {
-        if (cdb.TryGetValue(iter->label).first) iter->ready = true;
-      }
+  long long label[CDBSIZE];
+  int value[CDBSIZE];
+  int n = cdb.Results(label, value);
+  for (int j = 0; j < n; ++j) {
+    long long committed = label[j];
+    for (int i = 0; i < LSBSIZE; ++i) {
+      slots.ready[i] = slots.ready[i] || slots.label[i] == committed;
     }
-    ++iter;
   }
 }
 
-void LoadStoreBuffer::Execute(OptType opt, int addr, int value, int label, CommonDataBus &cdb)  {
-  if (opt == OptType::SB || opt == OptType::SH || opt == OptType::SW) {
-    int tmp = lsb_next.push({-1, false, opt, addr, value, label}); // ST: not ready
-    lsb_next.back()->cnt = tmp;
-    cdb.PutOnBus(label, value);
-    return;
+void LoadStoreBuffer::Push(OptType opt, int addr, long long label, bool ready, const LsbEntry &entry) {
+  int slot = Slot(lsb_next.tail++);
+  slots.label[slot] = label;
+  slots.ready[slot] = ready;
+  slots.opt[slot] = opt;
+  slots.addr[slot] = addr;
+  slots.entry[slot] = entry;
+}
+
+void LoadStoreBuffer::Move(int from, int to) {
+  if (from == to) return;
+  slots.label[to] = slots.label[from];
+  slots.ready[to] = slots.ready[from];
+  slots.opt[to] = slots.opt[from];
+  slots.addr[to] = slots.addr[from];
+  slots.entry[to] = slots.entry[from];
+}
+
+LoadStoreBuffer::Loaded LoadStoreBuffer::Execute(OptType opt, int addr, int value, long long label, int tag, CommonDataBus &cdb,
+                                                 BusPort port, int pc, int len, int checkpoint, int predicted) {
+  if (IsStore(opt)) {
+    Push(opt, addr, label, false, {value, -1, pc, len, -1, 0, io.Find(addr)}); // ST: not ready
+    cdb.Request(port, label, value);
+    return Loaded();
   }
+  LsbEntry entry{value, tag, pc, len, checkpoint, predicted, io.Find(addr)};
 
-  // percolate lsb, find ST with overlapped units
-  if (!lsb_now.empty()) {
-    CircularQueue<LsbEntry, LSBSIZE>::iterator iter = lsb_now.back();
-    while (true) {
-      if (iter->opt == OptType::SB) {
-        int tmp = Memory::GetByte(iter->value);
-        if ((opt == OptType::LB || opt == OptType::LBU) && iter->addr == addr) {
-          cdb.PutOnBus(label, (opt == OptType::LB) ? Memory::SignExtend(tmp, 8) : tmp);
-          return;
-        }
-      }
-
-      if (iter->opt == OptType::SH) {
-        int tmp = Memory::GetHalf(iter->value);
-        if (opt == OptType::LB || opt == OptType::LBU) {
-          if (addr == iter->addr) {
-            tmp = Memory::GetHighByte(tmp);
-            cdb.PutOnBus(label, (opt == OptType::LB) ? Memory::SignExtend(tmp, 8) : tmp);
-            return;
-          }
-          if (addr == iter->addr + 1) {
-            tmp = Memory::GetByte(tmp);
-            cdb.PutOnBus(label, (opt == OptType::LBU) ? Memory::SignExtend(tmp, 8) : tmp);
-            return;
-          }
-        }
-        if ((opt == OptType::LH || opt == OptType::LHU) && addr == iter->addr) {
-          cdb.PutOnBus(label, (opt == OptType::LH) ? Memory::SignExtend(tmp, 16) : tmp);
-          return;
-        }
-      }
-
-      if (iter->opt == OptType::SW) {
-        int tmp = iter->value;
-        if ((opt == OptType::LB || opt == OptType::LBU) && (addr >= iter->addr && addr <= iter->addr + 3)) {
-          if (addr == iter->addr) tmp = Memory::GetHighByte(Memory::GetHighHalf(tmp));
-          else if (addr == iter->addr + 1) tmp = Memory::GetByte(Memory::GetHighHalf(tmp));
-          else if (addr == iter->addr + 2) tmp = tmp = Memory::GetHighByte(Memory::GetHalf(tmp));
-          else tmp = Memory::GetByte(tmp);
-          cdb.PutOnBus(label, (opt == OptType::LB) ? Memory::SignExtend(tmp, 8) : tmp);
-          return;
-        }
-        if ((opt == OptType::LH || opt == OptType::LHU) && (addr >= iter->addr && addr <= iter->addr + 2)) {
-          if (addr == iter->addr) tmp = Memory::GetHighHalf(tmp);
-          else if (addr == iter->addr + 1) tmp = Memory::GetMidHalf(tmp);
-          else tmp = Memory::GetHalf(tmp);
-          cdb.PutOnBus(label, (opt == OptType::LH) ? Memory::SignExtend(tmp, 16) : tmp);
-          return;
-        }
-        if (opt == OptType::LW && addr == iter->addr) {
-          cdb.PutOnBus(label, tmp);
-          return;
-        }
-      }
-
-      if (iter == lsb_now.front()) break;
-      --iter;
-    }
-  }
-
-  int tmp = lsb_next.push({-1, true, opt, addr, value, label}); // LD: ready
-  lsb_next.back()->cnt = tmp;
+  // percolate lsb(from the youngest ST), forward the value of a ST covering all units of the LD
+  // a ST with only some of the units: the LD waits in the queue(memory is written by then)
+  // a ST of a device: the LD waits too, the device may write memory(dma) when the ST is done
+  if (entry.device < 0) {
+    int size = Size(opt);
+    for (long long i = lsb_now.tail - 1; i >= lsb_now.head; --i) {
+      int slot = Slot(i);
+      if (!IsStore(slots.opt[slot])) continue;
+      if (slots.entry[slot].device >= 0) break;
+      int st_addr = slots.addr[slot], st_size = Size(slots.opt[slot]);
+      if (addr >= st_addr + st_size || st_addr >= addr + size) continue;
+      if (addr < st_addr || addr + size > st_addr + st_size) break;
+      // little endian: the unit at addr is byte addr - st_addr of the value
+      u32 tmp = u32(slots.entry[slot].value) >> (8 * (addr - st_addr));
+      if (size < 4) tmp &= (1u << (8 * size)) - 1;
+      if (opt == OptType::LB || opt == OptType::LH) tmp = u32(Memory::SignExtend(tmp, 8 * size));
+      return Finish(port, label, entry, int(tmp), cdb);
+    }
+  }
+
+  Push(opt, addr, label, true, entry); // LD: ready
+  return Loaded();
+}
+
+LoadStoreBuffer::Loaded LoadStoreBuffer::Finish(BusPort port, long long label, const LsbEntry &entry, int value, CommonDataBus &cdb) {
+  cdb.Request(port, label, value, entry.tag);
+  Loaded ret;
+  ret.label = label;
+  ret.pc = entry.pc;
+  ret.len = entry.len;
+  ret.tag = entry.tag;
+  ret.value = value;
+  ret.checkpoint = entry.checkpoint;
+  ret.predicted = entry.predicted;
+  return ret;
 }
 
-void LoadStoreBuffer::TryLoadStore(Memory &mem, CommonDataBus &cdb) {
+template <typename Trace>
+LoadStoreBuffer::Loaded LoadStoreBuffer::TryLoadStore(Memory &mem, CommonDataBus &cdb, Trace &trace, long long head, long long clk) {
+  Loaded ret;
+  dcache.Tick();
   if (count > 0) {
     --count;
-    return;
+    return ret;
   }
-  if (lsb_now.empty()) {
+  if (lsb_now.size() == 0) {
     count = -1;
-    return; // lsb is empty, count = -1, waiting
+    return ret; // lsb is empty, count = -1, waiting
   }
-  CircularQueue<LsbEntry, LSBSIZE>::iterator iter = lsb_now.front();
+  long long front = lsb_now.head;
   if (count == 0) {
-    if (iter->opt == OptType::SB) {
-      mem.StoreByte(iter->addr, iter->value);
+    int slot = Slot(front);
+    OptType opt = slots.opt[slot];
+    int addr = slots.addr[slot];
+    long long label = slots.label[slot];
+    const LsbEntry &entry = slots.entry[slot];
+    // LD: the last loaded value hasn't got the bus, finish next cycle
+    if (!IsStore(opt) && cdb.Waiting(BusPort::Load)) return ret;
+    if (entry.device >= 0) {
+      ret = DeviceAccess(slot, mem, cdb, clk);
     }
-    else if (iter->opt == OptType::SH) {
-      mem.StoreHalf(iter->addr, iter->value);
+    else if (opt == OptType::SB) {
+      mem.StoreByte(addr, entry.value);
     }
-    else if (iter->opt == OptType::SW) {
-      mem.StoreWord(iter->addr, iter->value);
+    else if (opt == OptType::SH) {
+      mem.StoreHalf(addr, entry.value);
     }
-
-    else if (iter->opt == OptType::LB) {
-      cdb.PutOnBus(iter->label, Memory::SignExtend(mem.LoadByte(iter->addr), 8));
+    else if (opt == OptType::SW) {
+      mem.StoreWord(addr, entry.value);
+    }
+    else if (!Memory::InMemory(addr, Size(opt))) {
+      // a LD outside memory(not a device) gets 0, the program fails if it commits(see Fault)
+      if (fault < 0 || label < fault) fault = label;
+      ret = Finish(BusPort::Load, label, entry, 0, cdb);
+    }
+    else if (opt == OptType::LB) {
+      ret = Finish(BusPort::Load, label, entry, Memory::SignExtend(mem.LoadByte(addr), 8), cdb);
     }
-    else if (iter->opt == OptType::LBU) {
-      cdb.PutOnBus(iter->label, int(mem.LoadByte(iter->addr)));
+    else if (opt == OptType::LBU) {
+      ret = Finish(BusPort::Load, label, entry, int(mem.LoadByte(addr)), cdb);
     }
-    else if (iter->opt == OptType::LH) {
-      cdb.PutOnBus(iter->label, Memory::SignExtend(mem.LoadHalf(iter->addr), 16));
+    else if (opt == OptType::LH) {
+      ret = Finish(BusPort::Load, label, entry, Memory::SignExtend(mem.LoadHalf(addr), 16), cdb);
     }
-    else if (iter->opt == OptType::LHU) {
-      cdb.PutOnBus(iter->label, int(mem.LoadHalf(iter->addr)));
+    else if (opt == OptType::LHU) {
+      ret = Finish(BusPort::Load, label, entry, int(mem.LoadHalf(addr)), cdb);
     }
-    else if (iter->opt == OptType::LW) {
-      cdb.PutOnBus(iter->label, int(mem.LoadWord(iter->addr)));
+    else if (opt == OptType::LW) {
+      ret = Finish(BusPort::Load, label, entry, int(mem.LoadWord(addr)), cdb);
     }
     else throw std::exception();
-    lsb_next.pop();
-    ++iter;
+    trace.MemAccess(label, opt, addr, entry.value);
+    ++lsb_next.head;
+    ++front;
   }
 
-  if (iter == lsb_now.end() || !iter->ready) {
+  int slot = Slot(front);
+  if (front == lsb_now.tail || !slots.ready[slot]) {
     count = -1;
   }
+  else if (slots.entry[slot].device >= 0) {
+    // a LD of a device waits until nothing older can be squashed
+    count = (IsStore(slots.opt[slot]) || slots.label[slot] == head) ? MMIO_LATENCY : -1;
+  }
   else {
-    count = 3;
+    count = latency + Access(slot);
   }
+  return ret;
 }
 
+LoadStoreBuffer::Loaded LoadStoreBuffer::DeviceAccess(int slot, Memory &mem, CommonDataBus &cdb, long long clk) {
+  OptType opt = slots.opt[slot];
+  const LsbEntry &entry = slots.entry[slot];
+  int size = Size(opt);
+  if (IsStore(opt)) {
+    io.Store(entry.device, slots.addr[slot], size, u32(entry.value), clk, mem);
+    return Loaded();
+  }
+  u32 tmp = io.Load(entry.device, slots.addr[slot], size, clk);
+  if (size < 4) tmp &= (1u << (8 * size)) - 1;
+  if (opt == OptType::LB || opt == OptType::LH) tmp = u32(Memory::SignExtend(tmp, 8 * size));
+  return Finish(BusPort::Load, slots.label[slot], entry, int(tmp), cdb);
+}
+
+int LoadStoreBuffer::Access(int slot) {
+  bool trigger = false;
+  int ret = dcache.Access(slots.addr[slot], trigger);
+  prefetcher.Train(slots.entry[slot].pc, slots.addr[slot], trigger, dcache);
+  return ret;
+}
+
+// lsb_next is rebuilt in place from the entries of lsb_now(an entry is moved to a slot already read)
 void LoadStoreBuffer::Clear() {
-  lsb_next.clear();
-  if (lsb_now.empty()) {
+  fault = -1;
+  if (lsb_now.size() == 0) {
+    lsb_next = lsb_now;
     count = -1;
     return;
   }
-  CircularQueue<LsbEntry, LSBSIZE>::iterator iter = lsb_now.front();
+  int front = Slot(lsb_now.head);
+  lsb_next.head = lsb_next.tail = lsb_now.head;
 
   // deal with the undergoing process
   bool interrupted = false;
   if (count >= 0) {
     // LD is being done, do not push the entry into lsb_next, interrupt it
-    if (iter->opt != OptType::SB && iter->opt != OptType::SH && iter->opt != OptType::SW) {
+    if (!IsStore(slots.opt[front])) {
       interrupted = true;
     }
     else { // ST is being done, push into lsb_next, do not interrupt
-      int tmp = lsb_next.push(*iter);
-      lsb_next.back()->cnt = tmp;
+      Move(front, Slot(lsb_next.tail++));
     }
   }
 
   // other entrys
-  ++iter;
-  while (iter != lsb_now.end()) {
-    if (iter->opt == OptType::SB || iter->opt == OptType::SH || iter->opt == OptType::SW) {
-      if (iter->ready) {
-        int tmp = lsb_next.push(*iter);
-        lsb_next.back()->cnt = tmp;
-      }
-    }
-    ++iter;
+  for (long long i = lsb_now.head + 1; i != lsb_now.tail; ++i) {
+    int slot = Slot(i);
+    if (IsStore(slots.opt[slot]) && slots.ready[slot]) Move(slot, Slot(lsb_next.tail++));
   }
 
-  // set new counter: if the top is a ready ST, start the ST(count = 3)
+  // set new counter: if the top is a ready ST, start the ST(count = latency)
   //                  else, lsb_next is empty, count = -1;
   if (interrupted) {
-    (lsb_next.empty()) ? count = -1 : count = 3;
+    (lsb_next.size() == 0) ? count = -1 : count = latency;
   }
-}
\ No newline at end of file
+}
+
+void LoadStoreBuffer::WriteStores(Memory &mem, long long clk) {
+  for (long long i = lsb_next.head; i != lsb_next.tail; ++i) {
+    int slot = Slot(i);
+    OptType opt = slots.opt[slot];
+    int addr = slots.addr[slot];
+    const LsbEntry &entry = slots.entry[slot];
+    if (entry.device >= 0) {
+      if (IsStore(opt)) io.Store(entry.device, addr, Size(opt), u32(entry.value), clk, mem);
+    }
+    else if (opt == OptType::SB) mem.StoreByte(addr, entry.value);
+    else if (opt == OptType::SH) mem.StoreHalf(addr, entry.value);
+    else if (opt == OptType::SW) mem.StoreWord(addr, entry.value);
+  }
+  lsb_next.head = lsb_next.tail;
+  lsb_now = lsb_next;
+  count = -1;
+  io.Flush();
+}
+
+// the entries kept are moved forward in place(lsb_now is not read again before flush)
+void LoadStoreBuffer::Squash(long long label) {
+  if (fault > label) fault = -1;
+  if (lsb_next.size() == 0) return;
+  // the entry being done is at the front
+  if (count >= 0 && slots.label[Slot(lsb_next.head)] > label) count = -1;
+  long long tail = lsb_next.head;
+  for (long long i = lsb_next.head; i != lsb_next.tail; ++i) {
+    if (slots.label[Slot(i)] <= label) Move(Slot(i), Slot(tail++));
+  }
+  lsb_next.tail = tail;
+}
+
+template LoadStoreBuffer::Loaded LoadStoreBuffer::TryLoadStore<TracePolicy>(Memory &, CommonDataBus &, TracePolicy &, long long, long long);
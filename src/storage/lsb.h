@@ -2,42 +2,43 @@
 #ifndef RISCV_SIMULATOR_LSB_H
 #define RISCV_SIMULATOR_LSB_H
 
-#include "../utils/circular_queue.h"
 #include "../utils/config.h"
 #include "../units/instuction.h"
 #include "../storage/memory.h"
 #include "../units/bus.h"
+#include "cache.h"
+#include "prefetcher.h"
+#include "mmio.h"
 
+/*
+ * structure of arrays: label, ready(read by CheckBus) and opt, addr(read by the forwarding of every LD) are packed
+ * apart from the other fields of the entries(LsbEntry)
+ * lsb_now and lsb_next share the slots(the slot of a position is position % LSBSIZE), only their windows are double
+ * buffered: Execute writes the slots after lsb_now and at most one entry is popped per cycle, so a slot of lsb_now is
+ * not written before flush(CheckBus, Squash: after all stages)
+ */
 class LoadStoreBuffer {
 private:
   struct LsbEntry {
-    int cnt = -1;
-    bool ready;
-    OptType opt;
-    int addr = -1;
     int value = -1;
-    int label = -1;
-
-    friend std::ostream &operator<<(std::ostream &os, const LoadStoreBuffer::LsbEntry &obj) {
-      os << "label = " << obj.label << ", opt = ";
-      switch (obj.opt) {
-        case OptType::LB : os << "LB"; break;
-        case OptType::LH : os << "LH"; break;
-        case OptType::LW : os << "LW"; break;
-        case OptType::LBU : os << "LBU"; break;
-        case OptType::LHU : os << "LHU"; break;
-        case OptType::SB : os << "SB"; break;
-        case OptType::SH : os << "SH"; break;
-        case OptType::SW : os << "SW"; break;
-      }
-      os << ", addr = " << std::hex << obj.addr << ", value = " << obj.value << std::dec;
-      if (obj.ready) os << ", is ready.";
-      else os << ", is not ready.";
-      return os;
-    }
+    int tag = -1; // LD: physical register of the result
+    int pc = 0, len = 4;
+    int checkpoint = -1; // LD: checkpoint in register if the value is predicted, -1 if not
+    int predicted = 0; // LD: the predicted value
+    int device = -1; // the device accessed(see IoBus), -1 for memory
   };
 
 public:
+  // a LD whose value is known(loaded or forwarded), the value predictor is trained with it
+  struct Loaded {
+    long long label = -1; // -1 if no LD is finished
+    int pc = 0, len = 4;
+    int tag = -1;
+    int value = 0;
+    int checkpoint = -1; // -1 if the value is not predicted
+    int predicted = 0;
+  };
+
   LoadStoreBuffer() = default;
 
   void print();
@@ -53,34 +54,126 @@ public:
    */
   void Clear();
 
+  /*
+   * remove LDs and STs after the instruction of label(a mispredicted branch/JALR), none of them is committed
+   * if the LD being done is removed, interrupt it
+   */
+  void Squash(long long label);
+
   /*
    * receive call from ls_rss(drop a LD/ST instruction)
    *       if ST: add to the queue, and put information on bus(so that rob can set ready)
    *       if LD: percolate lsb(from back to front)
-   *              if there's a ST with same addr(overlap), put information on bus
+   *              if the youngest overlapping ST covers the LD, put its value on bus(return it as Loaded)
    *              else add to queue
+   *       a LD of a device is never forwarded(see TryLoadStore), a LD is not forwarded past a ST of a device
+   * port: of the AGU sending it(a ST or a forwarded LD is put there)
+   * pc, len: the prefetchers are trained with pc, checkpoint, predicted: see LsbEntry(only used by LD)
    */
-  void Execute(OptType opt, int addr, int value, int label, CommonDataBus &cdb);
+  Loaded Execute(OptType opt, int addr, int value, long long label, int tag, CommonDataBus &cdb, BusPort port,
+                 int pc = 0, int len = 4, int checkpoint = -1, int predicted = 0);
 
   /*
+   * the data cache moves one cycle forward(prefetches in flight)
    * check count: if count > 0: a ld/st is undergoing, --count
-   *              if count == 0: a ld/st is finished, (instruction at front is ready), (if LD)put on bus, (if ST)store in memory, pop
+   *              if count == 0: a ld/st is finished, (instruction at front is ready), (if LD)put on bus(return it as Loaded), (if ST)store in memory, pop
+   *                             (a LD waits while the last loaded value hasn't got the bus)
    *                             check if instruction at top is ready, if not, count = -1
-   *                                                                   else, count = 3
+   *                                                                   else, count = latency(+ DCACHE_MISS_PENALTY on a miss)
    *              if count == -1: nothing is going on, still waiting
-   *                              check the instruction at top, if it is ready, count = 3
+   *                              check the instruction at top, if it is ready, count = latency(+ DCACHE_MISS_PENALTY on a miss)
+   * the prefetchers are trained by every LD/ST started
+   *
+   * LD/ST of a device(addr mapped in io): uncached, count = MMIO_LATENCY, not seen by the data cache and the prefetchers
+   * a LD of a device is not speculative: it starts only when it is the oldest instruction in flight(head: label of the
+   * head of rob, -1 if empty), STs are committed anyway, clk: the cycle seen by the devices
+   * a LD outside memory and not of a device gets 0(it may be on a wrong path, see Fault), such a ST throws(it is committed)
    */
-  void TryLoadStore(Memory &mem, CommonDataBus &cdb);
+  template <typename Trace>
+  Loaded TryLoadStore(Memory &mem, CommonDataBus &cdb, Trace &trace, long long head, long long clk);
 
   // * for unready STs: set ready
   void CheckBus(const CommonDataBus &cdb);
 
-  bool NextFull() {return lsb_next.full();}
+  // LSBSIZE - 1 entries
+  bool NextFull() const {return lsb_next.size() == LSBSIZE - 1;}
+
+  // the program is finished: write the STs still in lsb to memory or devices(all of them are committed), flush the devices
+  void WriteStores(Memory &mem, long long clk);
+
+  // label of the oldest LD in flight that was outside memory and not a device(-1 if none)
+  long long Fault() const {return fault;}
+
+  // the output of the uart(see IoBus)
+  void SetOutput(GuestOutput *output) {io.SetOutput(output);}
+
+  // addr is mapped to a device(see IoBus)
+  bool IsDevice(int addr) const {return io.Find(addr) >= 0;}
+
+  int size() const {return lsb_now.size();}
+
+  // kinds: bit i enables PrefetchKind(i), see Prefetcher
+  void SetPrefetch(unsigned kinds, int degree, int distance) {prefetcher.Configure(kinds, degree, distance);}
+
+  // LD/STs missing the data cache
+  long long DcacheMisses() const {return dcache.Misses();}
+
+  // cycles of a LD/ST hitting the data cache
+  void SetLatency(int latency) {this->latency = latency;}
+
+  // data cache and prefetcher counters(part of the model, collected with every trace policy)
+  void PrintStats(JsonWriter &json) const {
+    dcache.PrintStats(json);
+    prefetcher.PrintStats(json, dcache);
+    io.PrintStats(json);
+  }
 
 private:
-  CircularQueue<LsbEntry, LSBSIZE> lsb_now;
-  CircularQueue<LsbEntry, LSBSIZE> lsb_next;
+  struct Window {
+    long long head = 0, tail = 0; // positions of the oldest entry and of the next one pushed
+
+    int size() const {return int(tail - head);}
+  };
+
+  struct Slots {
+    long long label[LSBSIZE];
+    bool ready[LSBSIZE]; // LD: always, ST: committed
+    OptType opt[LSBSIZE];
+    int addr[LSBSIZE];
+    LsbEntry entry[LSBSIZE];
+  };
+
+  Slots slots;
+  Window lsb_now, lsb_next;
   int count = -1;
+  long long fault = -1;
+  int latency = LSB_LATENCY;
+  DataCache dcache;
+  Prefetcher prefetcher;
+  IoBus io;
+
+  static int Slot(long long position) {return int(position % LSBSIZE);}
+
+  // add an entry at the back of lsb_next
+  void Push(OptType opt, int addr, long long label, bool ready, const LsbEntry &entry);
+
+  void Move(int from, int to);
+
+  void Print(const Window &window);
+
+  // the LD/ST in slot starts: return its extra cycles in the data cache, train the prefetchers
+  int Access(int slot);
+
+  // units accessed by a LD/ST
+  static int Size(OptType opt) {return OptInfo(opt).size;}
+
+  static bool IsStore(OptType opt) {return OptInfo(opt).store;}
+
+  // the LD/ST of a device in slot is finished(see TryLoadStore)
+  Loaded DeviceAccess(int slot, Memory &mem, CommonDataBus &cdb, long long clk);
+
+  // put the value of a LD on bus
+  static Loaded Finish(BusPort port, long long label, const LsbEntry &entry, int value, CommonDataBus &cdb);
 };
 
 #endif //RISCV_SIMULATOR_LSB_H
@@ -2,8 +2,10 @@
 #ifndef RISCV_SIMULATOR_MEMORY_H
 #define RISCV_SIMULATOR_MEMORY_H
 
+#include <cctype>
 #include <cstring>
 #include <iostream>
+#include <string>
 #include <iomanip>
 #include "../utils/config.h"
 
@@ -11,6 +13,17 @@ class Memory {
 public:
   Memory() {
     memset(units, 0, sizeof (units));
+    memset(dirty, 0, sizeof (dirty));
+  }
+
+  // zero the pages written since the last Clear(much cheaper than a new Memory for a small program)
+  void Clear() {
+    image_end = 0;
+    for (int i = 0; i < PAGENUM; ++i) {
+      if (!dirty[i]) continue;
+      memset(units + i * PAGESIZE, 0, (i == PAGENUM - 1) ? MEMSIZE - i * PAGESIZE : PAGESIZE);
+      dirty[i] = false;
+    }
   }
 
   static int SignExtend(u32 src, int len) {
@@ -51,16 +64,26 @@ public:
     return src;
   }
 
+  // [addr, addr + size) is in memory
+  static bool InMemory(int addr, int size) {return addr >= 0 && addr <= MEMSIZE - size;}
+
+  // a LD/ST outside memory throws(the program fails, see LoadStoreBuffer::TryLoadStore for LDs on a wrong path)
   void StoreByte(int addr, int value) {
+    if (!InMemory(addr, 1)) throw std::exception();
+    Touch(addr, 1);
     units[addr] = u8(value);
   }
 
   void StoreHalf(int addr, int value) {
+    if (!InMemory(addr, 2)) throw std::exception();
+    Touch(addr, 2);
     units[addr + 1] = u8(GetHighByte(value));
     units[addr] = u8(GetByte(value));
   }
 
   void StoreWord(int addr, int value) {
+    if (!InMemory(addr, 4)) throw std::exception();
+    Touch(addr, 4);
     units[addr + 3] = u8(GetHighByte(GetHighHalf(value)));
     units[addr + 2] = u8(GetByte(GetHighHalf(value)));
     units[addr + 1] = u8(GetHighByte(value));
@@ -68,16 +91,19 @@ public:
   }
 
   u32 LoadByte(int addr) const {
+    if (!InMemory(addr, 1)) throw std::exception();
     return u32(units[addr]);
   }
 
   u32 LoadHalf(int addr) const {
+    if (!InMemory(addr, 2)) throw std::exception();
     u32 tmp1 = (u32)units[addr + 1] << 8;
     u32 tmp2 = (u32)units[addr];
     return tmp1 | tmp2;
   }
 
   u32 LoadWord(int addr) const {
+    if (!InMemory(addr, 4)) throw std::exception();
     u32 tmp1 = (u32)units[addr + 3] << 24;
     u32 tmp2 = (u32)units[addr + 2] << 16;
     u32 tmp3 = (u32)units[addr + 1] << 8;
@@ -85,33 +111,67 @@ public:
     return tmp1 | tmp2 | tmp3 | tmp4;
   }
 
+  // memmove [src, src + len) to [dst, dst + len), both in memory
+  void Copy(int dst, int src, int len) {
+    if (len <= 0) return;
+    for (int i = dst / PAGESIZE; i <= (dst + len - 1) / PAGESIZE; ++i) dirty[i] = true;
+    memmove(units + dst, units + src, len);
+  }
+
+  // the end of the program read by InitInstructions(the highest address + 1)
+  int ImageEnd() const {return image_end;}
+
   /*
    * read instructions and put into memory
-   * return PC value
+   * the image: @address(hex) followed by bytes(1 or 2 hex digits), separated by whitespace, starting with an address
+   * pc: the first address
+   * return false if a token is malformed or a byte is outside memory(the bytes before it are already written)
    */
-  int InitInstructions() {
-    int addr = 0, ret = 0;
-    getchar();
-    std::cin >> std::hex >> addr;
-    ret = addr;
-    while (!std::cin.eof()) {
-      while (!std::cin.eof()) {
-        int tmp;
-        std::cin >> std::hex >> tmp;
-        units[addr] = u8(tmp);
-        getchar();
-        if (std::cin.peek() == '\n') getchar();
-        if (std::cin.peek() == '@') break;
-        ++addr;
+  bool InitInstructions(std::istream &is, int &pc) {
+    std::string token;
+    long long addr = -1;
+    while (is >> token) {
+      u32 value = 0;
+      if (token[0] == '@') {
+        if (!ParseHex(token, 1, 8, value)) return false;
+        if (addr < 0) pc = int(value);
+        addr = value;
+        continue;
       }
-      getchar();
-      std::cin >> std::hex >> addr;
+      if (addr < 0 || !ParseHex(token, 0, 2, value) || addr >= MEMSIZE) return false;
+      Touch(int(addr), 1);
+      units[addr] = u8(value);
+      if (addr >= image_end) image_end = int(addr) + 1;
+      ++addr;
     }
-    return ret;
+    return addr >= 0;
   }
 
 private:
+  static constexpr int PAGESIZE = 4096;
+  static constexpr int PAGENUM = (MEMSIZE + PAGESIZE - 1) / PAGESIZE;
+
   u8 units[MEMSIZE];
+  bool dirty[PAGENUM]; // pages written since the last Clear
+  int image_end = 0;
+
+  // the hex digits of s from pos(1 to max_digits of them, nothing else) into value
+  static bool ParseHex(const std::string &s, size_t pos, size_t max_digits, u32 &value) {
+    if (s.size() <= pos || s.size() - pos > max_digits) return false;
+    value = 0;
+    for (size_t i = pos; i < s.size(); ++i) {
+      int digit = isdigit(u8(s[i])) ? s[i] - '0' : isxdigit(u8(s[i])) ? tolower(s[i]) - 'a' + 10 : -1;
+      if (digit < 0) return false;
+      value = value << 4 | u32(digit);
+    }
+    return true;
+  }
+
+  // mark the pages of [addr, addr + size)(size <= PAGESIZE) as written
+  void Touch(int addr, int size) {
+    dirty[addr / PAGESIZE] = true;
+    dirty[(addr + size - 1) / PAGESIZE] = true;
+  }
 };
 
 #endif //RISCV_SIMULATOR_MEMORY_H
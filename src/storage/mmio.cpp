@@ -0,0 +1,122 @@
+#include "mmio.h"
+
+void Uart::Store(int offset, int size, u32 value, long long clk, Memory &mem) {
+  if (offset != 0) return;
+  if (output != nullptr) output->Write(1, char(value & 0xff));
+  ++bytes;
+}
+
+void Uart::Flush() {
+  if (output != nullptr) output->Flush();
+}
+
+u32 Timer::Load(int offset, int size, long long clk) {
+  long long time = clk - base;
+  switch (offset) {
+    case 0x0 : return u32(time);
+    case 0x4 : return u32(time >> 32);
+    case 0x8 : return u32(cmp);
+    case 0xc : return u32(cmp >> 32);
+    case 0x10 : return (cmp >= 0 && time >= cmp) ? 1 : 0;
+    default : return 0;
+  }
+}
+
+void Timer::Store(int offset, int size, u32 value, long long clk, Memory &mem) {
+  long long time = clk - base;
+  switch (offset) {
+    case 0x0 : base = clk - ((time & ~0xffffffffll) | value); break;
+    case 0x4 : base = clk - ((time & 0xffffffffll) | (long long)value << 32); break;
+    case 0x8 : cmp = (cmp & ~0xffffffffll) | value; break;
+    case 0xc : cmp = (cmp & 0xffffffffll) | (long long)value << 32; break;
+    default : break;
+  }
+}
+
+u32 HostDma::Load(int offset, int size, long long clk) {
+  switch (offset) {
+    case 0x0 : return u32(src);
+    case 0x4 : return u32(dst);
+    case 0x8 : return u32(len);
+    case 0xc : return status;
+    default : return 0;
+  }
+}
+
+void HostDma::Store(int offset, int size, u32 value, long long clk, Memory &mem) {
+  switch (offset) {
+    case 0x0 : src = int(value); break;
+    case 0x4 : dst = int(value); break;
+    case 0x8 : len = int(value); break;
+    case 0xc : {
+      if (value != 1) break;
+      if (len < 0 || src < 0 || dst < 0 || src > MEMSIZE - len || dst > MEMSIZE - len) {
+        status = 1;
+        break;
+      }
+      mem.Copy(dst, src, len);
+      status = 0;
+      ++copies;
+      bytes += len;
+      break;
+    }
+    default : break;
+  }
+}
+
+IoBus::IoBus() {
+  uart = new Uart();
+  Map(UART_BASE, std::unique_ptr<Device>(uart));
+  Map(TIMER_BASE, std::unique_ptr<Device>(new Timer()));
+  Map(DMA_BASE, std::unique_ptr<Device>(new HostDma()));
+}
+
+void IoBus::Map(int base, std::unique_ptr<Device> device) {
+  int size = device->Size();
+  if (base < MEMSIZE || base > 0x7fffffff - size) throw std::exception();
+  for (const Mapped &tmp : devices) {
+    if (base < tmp.base + tmp.size && tmp.base < base + size) throw std::exception();
+  }
+  Mapped mapped;
+  mapped.base = base;
+  mapped.size = size;
+  mapped.device = std::move(device);
+  devices.push_back(std::move(mapped));
+}
+
+int IoBus::Find(int addr) const {
+  if (addr >= 0 && addr < MEMSIZE) return -1;
+  for (int i = 0; i < int(devices.size()); ++i) {
+    if (addr >= devices[i].base && addr < devices[i].base + devices[i].size) return i;
+  }
+  return -1;
+}
+
+u32 IoBus::Load(int index, int addr, int size, long long clk) {
+  Mapped &mapped = devices[index];
+  ++mapped.loads;
+  return mapped.device->Load(addr - mapped.base, size, clk);
+}
+
+void IoBus::Store(int index, int addr, int size, u32 value, long long clk, Memory &mem) {
+  Mapped &mapped = devices[index];
+  ++mapped.stores;
+  mapped.device->Store(addr - mapped.base, size, value, clk, mem);
+}
+
+void IoBus::Flush() {
+  for (Mapped &mapped : devices) mapped.device->Flush();
+}
+
+void IoBus::PrintStats(JsonWriter &json) const {
+  json.BeginObject("devices");
+  for (const Mapped &mapped : devices) {
+    json.BeginObject(mapped.device->Name());
+    json.Value("base", mapped.base);
+    json.Value("loads", mapped.loads);
+    json.Value("stores", mapped.stores);
+    mapped.device->PrintStats(json);
+    json.EndObject();
+  }
+  json.EndObject();
+}
@@ -0,0 +1,152 @@
+
+#ifndef RISCV_SIMULATOR_MMIO_H
+#define RISCV_SIMULATOR_MMIO_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "../utils/config.h"
+#include "../utils/guest_output.h"
+#include "../utils/json.h"
+#include "memory.h"
+
+/*
+ * a device model behind a range of addresses(outside memory), accessed by LD/ST through IoBus
+ * offset: from the base of the device, size: 1, 2 or 4 bytes, clk: the cycle of the access
+ */
+class Device {
+public:
+  virtual ~Device() = default;
+
+  virtual const char *Name() const = 0;
+
+  // bytes of the address range
+  virtual int Size() const = 0;
+
+  virtual u32 Load(int offset, int size, long long clk) = 0;
+
+  // mem: the memory of the program(a device may read or write it)
+  virtual void Store(int offset, int size, u32 value, long long clk, Memory &mem) = 0;
+
+  // at the end of the program
+  virtual void Flush() {}
+
+  // counters of the device itself(the accesses are counted by IoBus)
+  virtual void PrintStats(JsonWriter &json) const {}
+};
+
+/*
+ * console output, registers of a 16550(byte access):
+ * 0 THR: a stored byte is written to the host stdout through output(shared with the system calls, see GuestOutput)
+ *    RBR: loads 0(there is no input)
+ * 5 LSR: 0x60, the transmitter is always empty
+ */
+class Uart : public Device {
+public:
+  const char *Name() const override {return "uart";}
+
+  int Size() const override {return 8;}
+
+  u32 Load(int offset, int size, long long clk) override {return (offset == 5) ? 0x60 : 0;}
+
+  void Store(int offset, int size, u32 value, long long clk, Memory &mem) override;
+
+  void Flush() override;
+
+  void PrintStats(JsonWriter &json) const override {json.Value("bytes_out", bytes);}
+
+  // the bytes stored are dropped without an output
+  void SetOutput(GuestOutput *output) {this->output = output;}
+
+private:
+  GuestOutput *output = nullptr;
+  long long bytes = 0;
+};
+
+/*
+ * a cycle counter(there are no interrupts, the program polls it), word registers:
+ * 0x0, 0x4 time: cycles since the start(low, high), a store sets it
+ * 0x8, 0xc cmp(low, high)
+ * 0x10 status: bit 0 = time >= cmp
+ */
+class Timer : public Device {
+public:
+  const char *Name() const override {return "timer";}
+
+  int Size() const override {return 0x14;}
+
+  u32 Load(int offset, int size, long long clk) override;
+
+  void Store(int offset, int size, u32 value, long long clk, Memory &mem) override;
+
+private:
+  long long base = 0; // time = clk - base
+  long long cmp = -1;
+};
+
+/*
+ * copies a block of memory in one host operation(memmove), word registers:
+ * 0x0 src, 0x4 dst, 0x8 len
+ * 0xc ctrl: storing 1 starts the copy, it is done when the ST finishes
+ *           loads the status of the last copy: 0 done, 1 refused(the block is not in memory)
+ */
+class HostDma : public Device {
+public:
+  const char *Name() const override {return "dma";}
+
+  int Size() const override {return 0x10;}
+
+  u32 Load(int offset, int size, long long clk) override;
+
+  void Store(int offset, int size, u32 value, long long clk, Memory &mem) override;
+
+  void PrintStats(JsonWriter &json) const override {
+    json.Value("copies", copies);
+    json.Value("bytes_copied", bytes);
+  }
+
+private:
+  int src = 0, dst = 0, len = 0;
+  u32 status = 0;
+  long long copies = 0, bytes = 0;
+};
+
+/*
+ * address decoding in front of memory: devices are mapped to ranges outside [0, MEMSIZE)
+ * the uart, the timer and the dma device are mapped at UART_BASE, TIMER_BASE and DMA_BASE
+ * lsb sends a LD/ST here if Find(addr) >= 0(see LoadStoreBuffer: device accesses are uncached and not speculative)
+ */
+class IoBus {
+public:
+  IoBus();
+
+  // the range must be outside memory and not overlap another device
+  void Map(int base, std::unique_ptr<Device> device);
+
+  // the device of addr, -1 if addr is not mapped
+  int Find(int addr) const;
+
+  u32 Load(int index, int addr, int size, long long clk);
+
+  void Store(int index, int addr, int size, u32 value, long long clk, Memory &mem);
+
+  void Flush();
+
+  // the output of the uart
+  void SetOutput(GuestOutput *output) {uart->SetOutput(output);}
+
+  // per device: loads, stores and the counters of the device
+  void PrintStats(JsonWriter &json) const;
+
+private:
+  struct Mapped {
+    int base, size;
+    std::unique_ptr<Device> device;
+    long long loads = 0, stores = 0;
+  };
+
+  std::vector<Mapped> devices;
+  Uart *uart = nullptr;
+};
+
+#endif //RISCV_SIMULATOR_MMIO_H
@@ -0,0 +1,176 @@
+
+#ifndef RISCV_SIMULATOR_PREFETCHER_H
+#define RISCV_SIMULATOR_PREFETCHER_H
+
+#include "../utils/config.h"
+#include "../utils/json.h"
+#include "cache.h"
+
+/*
+ * prefetchers of the data cache, trained by every LD/ST lsb starts(Train)
+ * next line: on a trigger(a miss or the first use of a prefetched line), the lines after it
+ * stride: a table indexed by pc, once a LD/ST repeats its stride, the addresses strides ahead
+ *         (a stride shorter than a line moves a line at a time)
+ * stream: triggers on neighbouring lines form a stream, once its direction is confirmed, the lines ahead of it
+ *
+ * degree: prefetches for each trigger, distance: how far ahead(lines, or strides for stride) the first one is
+ * throttling: every PREFETCH_EPOCH prefetches of a prefetcher, its degree goes down if the accuracy of the epoch
+ *             is below PREFETCH_LOW_ACCURACY(to 0: paused for PREFETCH_EPOCH triggers) and up if above PREFETCH_HIGH_ACCURACY
+ */
+class Prefetcher {
+public:
+  Prefetcher() = default;
+
+  // kinds: bit i enables PrefetchKind(i)
+  void Configure(unsigned kinds, int degree, int distance) {
+    this->kinds = kinds;
+    this->degree = degree;
+    this->distance = distance;
+    for (int i = 0; i < int(PrefetchKind::NUM); ++i) level[i] = degree;
+  }
+
+  bool Enabled(PrefetchKind kind) const {return kinds >> int(kind) & 1u;}
+
+  // a LD/ST at pc accessed addr, trigger: see DataCache::Access
+  void Train(int pc, int addr, bool trigger, DataCache &cache) {
+    if (kinds == 0) return;
+    u32 line = u32(addr) / DCACHE_LINE;
+    if (trigger && Active(PrefetchKind::NextLine)) {
+      for (int i = 0; i < Level(PrefetchKind::NextLine); ++i) {
+        Issue(PrefetchKind::NextLine, line + distance + i, cache);
+      }
+    }
+    if (Enabled(PrefetchKind::Stride)) TrainStride(pc, addr, trigger, cache);
+    if (trigger && Enabled(PrefetchKind::Stream)) TrainStream(line, cache);
+  }
+
+  void PrintStats(JsonWriter &json, const DataCache &cache) const {
+    static const char *const name[] = {"next_line", "stride", "stream"};
+    json.BeginObject("prefetch");
+    json.Value("degree", degree);
+    json.Value("distance", distance);
+    for (int i = 0; i < int(PrefetchKind::NUM); ++i) {
+      if (!Enabled(PrefetchKind(i))) continue;
+      json.BeginObject(name[i]);
+      cache.PrintPrefetchStats(json, PrefetchKind(i));
+      json.Value("throttled", throttled[i]);
+      json.Value("level", level[i]);
+      json.EndObject();
+    }
+    json.EndObject();
+  }
+
+private:
+  struct StrideEntry {
+    int pc = -1;
+    int last = 0;
+    int stride = 0;
+    int confidence = 0;
+  };
+  struct Stream {
+    bool valid = false;
+    u32 line = 0; // the last trigger
+    int direction = 0;
+    int confirmed = 0;
+    long long used = 0;
+  };
+
+  unsigned kinds = 0;
+  int degree = 0, distance = 1;
+  int level[int(PrefetchKind::NUM)] = {0}; // degree after throttling
+  int paused[int(PrefetchKind::NUM)] = {0}; // triggers left while the level is 0
+  long long epoch_issued[int(PrefetchKind::NUM)] = {0}, epoch_useful[int(PrefetchKind::NUM)] = {0};
+  long long throttled[int(PrefetchKind::NUM)] = {0}; // times the level went down
+  StrideEntry strides[PREFETCH_STRIDE_NUM];
+  Stream streams[PREFETCH_STREAM_NUM];
+  long long stamp = 0;
+
+  int Level(PrefetchKind kind) const {return level[int(kind)];}
+
+  // enabled and not paused, a paused prefetcher counts down its triggers
+  bool Active(PrefetchKind kind) {
+    if (!Enabled(kind)) return false;
+    if (level[int(kind)] > 0) return true;
+    if (--paused[int(kind)] <= 0) level[int(kind)] = 1;
+    return false;
+  }
+
+  void Issue(PrefetchKind kind, u32 line, DataCache &cache) {
+    if (!cache.Prefetch(line, kind)) return;
+    int k = int(kind);
+    if (cache.Issued(kind) - epoch_issued[k] < PREFETCH_EPOCH) return;
+    double accuracy = double(cache.Useful(kind) - epoch_useful[k]) / double(cache.Issued(kind) - epoch_issued[k]);
+    epoch_issued[k] = cache.Issued(kind);
+    epoch_useful[k] = cache.Useful(kind);
+    if (accuracy < PREFETCH_LOW_ACCURACY) {
+      ++throttled[k];
+      if (--level[k] == 0) paused[k] = PREFETCH_EPOCH;
+    }
+    else if (accuracy > PREFETCH_HIGH_ACCURACY && level[k] < degree) {
+      ++level[k];
+    }
+  }
+
+  void TrainStride(int pc, int addr, bool trigger, DataCache &cache) {
+    StrideEntry &entry = strides[(u32(pc) >> 1) % PREFETCH_STRIDE_NUM];
+    if (entry.pc != pc) {
+      entry = StrideEntry();
+      entry.pc = pc;
+      entry.last = addr;
+      return;
+    }
+    int stride = addr - entry.last;
+    entry.last = addr;
+    if (stride == 0) return;
+    if (stride == entry.stride) {
+      if (entry.confidence < 3) ++entry.confidence;
+    }
+    else {
+      entry.stride = stride;
+      entry.confidence = 0;
+      return;
+    }
+    if (entry.confidence < 2 || !Active(PrefetchKind::Stride)) return;
+    int step = stride;
+    if (step > -DCACHE_LINE && step < DCACHE_LINE) step = (stride > 0) ? DCACHE_LINE : -DCACHE_LINE;
+    for (int i = 0; i < Level(PrefetchKind::Stride); ++i) {
+      Issue(PrefetchKind::Stride, u32(addr + step * (distance + i)) / DCACHE_LINE, cache);
+    }
+  }
+
+  void TrainStream(u32 line, DataCache &cache) {
+    Stream *stream = nullptr, *lru = &streams[0];
+    for (int i = 0; i < PREFETCH_STREAM_NUM; ++i) {
+      if (streams[i].valid) {
+        int diff = int(line - streams[i].line);
+        if (diff == 0) return;
+        if (diff >= -2 && diff <= 2) {
+          stream = &streams[i];
+          break;
+        }
+      }
+      if (!streams[i].valid || (lru->valid && streams[i].used < lru->used)) lru = &streams[i];
+    }
+    if (stream == nullptr) {
+      *lru = Stream();
+      lru->valid = true;
+      lru->line = line;
+      lru->used = ++stamp;
+      return;
+    }
+    int direction = (int(line - stream->line) > 0) ? 1 : -1;
+    if (direction == stream->direction) ++stream->confirmed;
+    else {
+      stream->direction = direction;
+      stream->confirmed = 1;
+    }
+    stream->line = line;
+    stream->used = ++stamp;
+    if (stream->confirmed < 2 || !Active(PrefetchKind::Stream)) return;
+    for (int i = 0; i < Level(PrefetchKind::Stream); ++i) {
+      Issue(PrefetchKind::Stream, line + direction * (distance + i), cache);
+    }
+  }
+};
+
+#endif //RISCV_SIMULATOR_PREFETCHER_H
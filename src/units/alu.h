@@ -28,19 +28,15 @@ public:
     return a | b;
   }
 
+  // only the lower 5 bits of shamt are used
   int ShiftLeftLogical(int a, int shamt) const {
-    return a << shamt;
+    return int(u32(a) << (shamt & 31));
   }
   int ShiftRightLogical(int a, int shamt) const {
-    if (a >= 0) return a >> shamt;
-    u32 tmp = 0;
-    for (int i = 0; i < 32 - shamt; ++i) {
-      tmp = tmp | (1 << i);
-    }
-    return int(tmp) & (a >> shamt);
+    return int(u32(a) >> (shamt & 31));
   }
   int ShiftRightAri(int a, int shamt) const {
-    return a >> shamt;
+    return a >> (shamt & 31);
   }
 };
 
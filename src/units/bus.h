@@ -7,32 +7,89 @@
 #include <utility>
 #include <iostream>
 
+/*
+ * producers of a bus, each holds at most one result waiting for a slot
+ * Unit: the first port of the functional units(FunctionalUnitPool, FU_NUM ports), an AGU puts a ST or a forwarded LD there
+ */
+enum class BusPort {
+  Load, Mul, Div, Commit, Unit, NUM = Unit + FU_NUM
+};
+
+inline BusPort UnitPort(int unit) {return BusPort(int(BusPort::Unit) + unit);}
+
+/*
+ * which requests get the slots when there are more requests than slots
+ * OldestFirst: smaller label first
+ * LoadsFirst: LD results(loaded or forwarded) first, then smaller label
+ */
+enum class BusPolicy {
+  OldestFirst, LoadsFirst
+};
+
 class CommonDataBus {
   friend class Register;
 private:
   struct BusEntry {
     bool busy = false;
-    int label = -1; // for ST calls, only need label
+    long long label = -1; // for ST calls, only need label
     int value = -1;
-    int rd = -1; // only used in commit_bus
+    int tag = -1; // physical register written by the result(ready_bus), -1 if none
+    int fused_tag = -1; // physical register written by the first instruction of a fused pair, -1 if none
+    int fused_value = 0;
 
     friend std::ostream &operator<<(std::ostream &os, const CommonDataBus::BusEntry &obj) {
-      os << "label = " << obj.label << ", value = " << obj.value << ", rd = " << obj.rd;
+      os << "label = " << obj.label << ", value = " << obj.value << ", tag = " << obj.tag;
+      if (obj.fused_tag >= 0) os << ", fused_tag = " << obj.fused_tag << ", fused_value = " << obj.fused_value;
       return os;
     }
   };
 public:
-  void PutOnBus(int label, int value, int rd = -1) {
-    int index = 0;
-    for (int i = 0; i < CDBSIZE; ++i) {
-      if (bus[i].busy) index = i + 1;
-      else break;
+  // width: slots of the bus per cycle(no more than CDBSIZE)
+  explicit CommonDataBus(int width = CDBSIZE) : width(width) {}
+
+  /*
+   * a producer asks for a slot for its result, slots are given by Arbitrate after all stages
+   * a result that doesn't get a slot waits in the port and asks again next cycle
+   * a port holds one result: the producer should check Waiting first and stall
+   * fused_tag, fused_value: the register written by the first instruction of a fused pair
+   */
+  void Request(BusPort port, long long label, int value, int tag = -1, int fused_tag = -1, int fused_value = 0) {
+    if (request[int(port)].busy) throw std::exception();
+    request[int(port)] = {true, label, value, tag, fused_tag, fused_value};
+  }
+
+  // the last result of port hasn't got a slot
+  bool Waiting(BusPort port) const {return request[int(port)].busy;}
+
+  /*
+   * give the slots(the bus is cleared) to the waiting requests in the order of policy
+   * return the number of requests that are still waiting
+   */
+  int Arbitrate(BusPolicy policy) {
+    for (int slot = 0; slot < width; ++slot) {
+      int best = -1;
+      for (int i = 0; i < int(BusPort::NUM); ++i) {
+        if (request[i].busy && (best == -1 || Before(policy, i, best))) best = i;
+      }
+      if (best == -1) break;
+      bus[slot] = request[best];
+      request[best].busy = false;
+    }
+    int waiting = 0;
+    for (int i = 0; i < int(BusPort::NUM); ++i) {
+      if (request[i].busy) ++waiting;
+    }
+    return waiting;
+  }
+
+  // remove waiting results after the instruction of label(a mispredicted branch/JALR)
+  void Squash(long long label) {
+    for (int i = 0; i < int(BusPort::NUM); ++i) {
+      if (request[i].busy && request[i].label > label) request[i].busy = false;
     }
-    if (index == CDBSIZE) throw std::exception();
-    bus[index] = {true, label, value, rd};
   }
 
-  std::pair<bool, int> TryGetValue(int label) const {
+  std::pair<bool, int> TryGetValue(long long label) const {
     for (int i = 0; i < CDBSIZE; ++i) {
       if (bus[i].busy && bus[i].label == label) {
         return {true, bus[i].value};
@@ -41,6 +98,37 @@ public:
     return {false, 0};
   }
 
+  // the results on the bus: label[i], value[i](in order of the slots), return the number of them
+  int Results(long long label[CDBSIZE], int value[CDBSIZE]) const {
+    int n = 0;
+    for (int i = 0; i < CDBSIZE; ++i) {
+      if (!bus[i].busy) continue;
+      label[n] = bus[i].label;
+      value[n++] = bus[i].value;
+    }
+    return n;
+  }
+
+  // the physical registers written by the results on the bus(fused pairs write two), return the number of them
+  int WrittenTags(int tag[2 * CDBSIZE]) const {
+    int n = 0;
+    for (int i = 0; i < CDBSIZE; ++i) {
+      if (!bus[i].busy) continue;
+      if (bus[i].tag >= 0) tag[n++] = bus[i].tag;
+      if (bus[i].fused_tag >= 0) tag[n++] = bus[i].fused_tag;
+    }
+    return n;
+  }
+
+  // a result written to physical register tag is on the bus
+  bool IsWritten(int tag) const {
+    for (int i = 0; i < CDBSIZE; ++i) {
+      if (bus[i].busy && (bus[i].tag == tag || bus[i].fused_tag == tag)) return true;
+    }
+    return false;
+  }
+
+  // clear the slots, waiting requests stay
   void clear() {
     for (int i = 0; i < CDBSIZE; ++i) {
       bus[i].busy = false;
@@ -53,10 +141,27 @@ public:
         std::cout << bus[i] << std::endl;
       }
     }
+    for (int i = 0; i < int(BusPort::NUM); ++i) {
+      if (request[i].busy) {
+        std::cout << "waiting: " << request[i] << std::endl;
+      }
+    }
   }
 
 private:
+  int width;
   BusEntry bus[CDBSIZE];
+  BusEntry request[int(BusPort::NUM)];
+
+  // a LD result: from the Load port, or forwarded through the port of an AGU(a ST result has no register)
+  bool IsLoad(int port) const {
+    return port == int(BusPort::Load) || (port >= int(BusPort::Unit) + ALU_NUM + BRANCH_UNIT_NUM && request[port].tag >= 0);
+  }
+
+  bool Before(BusPolicy policy, int a, int b) const {
+    if (policy == BusPolicy::LoadsFirst && IsLoad(a) != IsLoad(b)) return IsLoad(a);
+    return request[a].label < request[b].label;
+  }
 };
 
 #endif //RISCV_SIMULATOR_BUS_H
@@ -0,0 +1,162 @@
+#include "instuction.h"
+#include <exception>
+
+/*
+ * RV32C: every 16-bit instruction is rewritten to the 32-bit instruction it stands for
+ * rd', rs1', rs2': 3-bit register numbers of x8 ~ x15
+ */
+
+namespace {
+
+u32 Bits(u32 c, int hi, int lo) {
+  return (c >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+u32 EncodeR(u32 f7, int rs2, int rs1, u32 f3, int rd, u32 op) {
+  return (f7 << 25) | (u32(rs2) << 20) | (u32(rs1) << 15) | (f3 << 12) | (u32(rd) << 7) | op;
+}
+
+u32 EncodeI(int imm, int rs1, u32 f3, int rd, u32 op) {
+  return (u32(imm & 0xfff) << 20) | (u32(rs1) << 15) | (f3 << 12) | (u32(rd) << 7) | op;
+}
+
+u32 EncodeS(int imm, int rs2, int rs1, u32 f3) {
+  u32 tmp = u32(imm);
+  return (Bits(tmp, 11, 5) << 25) | (u32(rs2) << 20) | (u32(rs1) << 15) | (f3 << 12) | (Bits(tmp, 4, 0) << 7) | 0b0100011;
+}
+
+u32 EncodeB(int imm, int rs2, int rs1, u32 f3) {
+  u32 tmp = u32(imm);
+  return (Bits(tmp, 12, 12) << 31) | (Bits(tmp, 10, 5) << 25) | (u32(rs2) << 20) | (u32(rs1) << 15) | (f3 << 12)
+         | (Bits(tmp, 4, 1) << 8) | (Bits(tmp, 11, 11) << 7) | 0b1100011;
+}
+
+u32 EncodeJ(int imm, int rd) {
+  u32 tmp = u32(imm);
+  return (Bits(tmp, 20, 20) << 31) | (Bits(tmp, 10, 1) << 21) | (Bits(tmp, 11, 11) << 20) | (Bits(tmp, 19, 12) << 12)
+         | (u32(rd) << 7) | 0b1101111;
+}
+
+}
+
+u32 InstructionUnit::Expand(u32 instruction, int &len) {
+  if ((instruction & 0b11) == 0b11) {
+    len = 4;
+    return instruction;
+  }
+  len = 2;
+  return ExpandCompressed(instruction & 0xffff);
+}
+
+u32 InstructionUnit::ExpandCompressed(u32 c) {
+  u32 f3 = Bits(c, 15, 13);
+  int rd = int(Bits(c, 11, 7)); // also rs1
+  int rs2 = int(Bits(c, 6, 2));
+  int rd_ = 8 + int(Bits(c, 4, 2)); // rd' or rs2'
+  int rs1_ = 8 + int(Bits(c, 9, 7)); // rs1' or rd'
+  // imm[5] = c[12], imm[4:0] = c[6:2]
+  int imm6 = SignExtend((Bits(c, 12, 12) << 5) | Bits(c, 6, 2), 6);
+  switch (Bits(c, 1, 0)) {
+    case 0b00 : {
+      switch (f3) {
+        case 0b000 : { // C.ADDI4SPN
+          u32 imm = (Bits(c, 10, 7) << 6) | (Bits(c, 12, 11) << 4) | (Bits(c, 5, 5) << 3) | (Bits(c, 6, 6) << 2);
+          if (imm == 0) break;
+          return EncodeI(int(imm), 2, 0b000, rd_, 0b0010011);
+        }
+        case 0b010 : { // C.LW
+          u32 imm = (Bits(c, 5, 5) << 6) | (Bits(c, 12, 10) << 3) | (Bits(c, 6, 6) << 2);
+          return EncodeI(int(imm), rs1_, 0b010, rd_, 0b0000011);
+        }
+        case 0b110 : { // C.SW
+          u32 imm = (Bits(c, 5, 5) << 6) | (Bits(c, 12, 10) << 3) | (Bits(c, 6, 6) << 2);
+          return EncodeS(int(imm), rd_, rs1_, 0b010);
+        }
+      }
+      break;
+    }
+    case 0b01 : {
+      switch (f3) {
+        case 0b000 : return EncodeI(imm6, rd, 0b000, rd, 0b0010011); // C.ADDI(C.NOP)
+        case 0b001 : // C.JAL
+        case 0b101 : { // C.J
+          u32 imm = (Bits(c, 12, 12) << 11) | (Bits(c, 8, 8) << 10) | (Bits(c, 10, 9) << 8) | (Bits(c, 6, 6) << 7)
+                    | (Bits(c, 7, 7) << 6) | (Bits(c, 2, 2) << 5) | (Bits(c, 11, 11) << 4) | (Bits(c, 5, 3) << 1);
+          return EncodeJ(SignExtend(imm, 12), (f3 == 0b001) ? 1 : 0);
+        }
+        case 0b010 : return EncodeI(imm6, 0, 0b000, rd, 0b0010011); // C.LI
+        case 0b011 : {
+          if (rd == 2) { // C.ADDI16SP
+            u32 imm = (Bits(c, 12, 12) << 9) | (Bits(c, 4, 3) << 7) | (Bits(c, 5, 5) << 6) | (Bits(c, 2, 2) << 5)
+                      | (Bits(c, 6, 6) << 4);
+            if (imm == 0) break;
+            return EncodeI(SignExtend(imm, 10), 2, 0b000, 2, 0b0010011);
+          }
+          if (imm6 == 0) break;
+          return (u32(imm6) << 12) | (u32(rd) << 7) | 0b0110111; // C.LUI
+        }
+        case 0b100 : {
+          switch (Bits(c, 11, 10)) {
+            case 0b00 : // C.SRLI
+              if (Bits(c, 12, 12)) break;
+              return EncodeI(rs2, rs1_, 0b101, rs1_, 0b0010011);
+            case 0b01 : // C.SRAI
+              if (Bits(c, 12, 12)) break;
+              return EncodeI(0x400 | rs2, rs1_, 0b101, rs1_, 0b0010011);
+            case 0b10 : return EncodeI(imm6, rs1_, 0b111, rs1_, 0b0010011); // C.ANDI
+            case 0b11 : {
+              if (Bits(c, 12, 12)) break;
+              switch (Bits(c, 6, 5)) {
+                case 0b00 : return EncodeR(0b0100000, rd_, rs1_, 0b000, rs1_, 0b0110011); // C.SUB
+                case 0b01 : return EncodeR(0b0000000, rd_, rs1_, 0b100, rs1_, 0b0110011); // C.XOR
+                case 0b10 : return EncodeR(0b0000000, rd_, rs1_, 0b110, rs1_, 0b0110011); // C.OR
+                case 0b11 : return EncodeR(0b0000000, rd_, rs1_, 0b111, rs1_, 0b0110011); // C.AND
+              }
+            }
+          }
+          break;
+        }
+        case 0b110 : // C.BEQZ
+        case 0b111 : { // C.BNEZ
+          u32 imm = (Bits(c, 12, 12) << 8) | (Bits(c, 6, 5) << 6) | (Bits(c, 2, 2) << 5) | (Bits(c, 11, 10) << 3)
+                    | (Bits(c, 4, 3) << 1);
+          return EncodeB(SignExtend(imm, 9), 0, rs1_, (f3 == 0b110) ? 0b000 : 0b001);
+        }
+      }
+      break;
+    }
+    case 0b10 : {
+      switch (f3) {
+        case 0b000 : { // C.SLLI
+          if (Bits(c, 12, 12)) break;
+          return EncodeI(rs2, rd, 0b001, rd, 0b0010011);
+        }
+        case 0b010 : { // C.LWSP
+          if (rd == 0) break;
+          u32 imm = (Bits(c, 3, 2) << 6) | (Bits(c, 12, 12) << 5) | (Bits(c, 6, 4) << 2);
+          return EncodeI(int(imm), 2, 0b010, rd, 0b0000011);
+        }
+        case 0b100 : {
+          if (Bits(c, 12, 12) == 0) {
+            if (rs2 == 0) { // C.JR
+              if (rd == 0) break;
+              return EncodeI(0, rd, 0b000, 0, 0b1100111);
+            }
+            return EncodeR(0, rs2, 0, 0b000, rd, 0b0110011); // C.MV
+          }
+          if (rs2 == 0) {
+            if (rd == 0) break; // C.EBREAK is not supported
+            return EncodeI(0, rd, 0b000, 1, 0b1100111); // C.JALR
+          }
+          return EncodeR(0, rs2, rd, 0b000, rd, 0b0110011); // C.ADD
+        }
+        case 0b110 : { // C.SWSP
+          u32 imm = (Bits(c, 8, 7) << 6) | (Bits(c, 12, 9) << 2);
+          return EncodeS(int(imm), rs2, 2, 0b010);
+        }
+      }
+      break;
+    }
+  }
+  throw std::exception(); // illegal or unsupported(floating point) instruction
+}
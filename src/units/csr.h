@@ -0,0 +1,65 @@
+
+#ifndef RISCV_SIMULATOR_CSR_H
+#define RISCV_SIMULATOR_CSR_H
+
+#include "../utils/config.h"
+#include "instuction.h"
+
+/*
+ * the CSRs of the simulator are the counters(Zicntr, Zihpm):
+ * cycle, time, instret, hpmcounter3 ~ 31(0xc00 ~ 0xc1f), their high halves(0xc80 ~ 0xc9f), read-only
+ * and the machine counters mcycle, minstret, mhpmcounter3 ~ 31(0xb00 ~ 0xb1f, 0xb80 ~ 0xb9f), writable
+ * time counts cycles(SIM_CLOCK_HZ is the clock)
+ * hpmcounter3 + HpmEvent: simulator events, the counters after them read 0(writes are ignored)
+ * a write sets the offset of the counter(see WriteCounterCsr), cycle, instret and hpmcounters read the machine counters,
+ * the statistics keep counting from 0(the batch interpreter doesn't support writes, a write fails the hart)
+ */
+enum class HpmEvent {
+  BranchMispredict, // flushes after a mispredicted branch/JALR
+  LsbStall, // cycles issue waited for a full ls_rss/lsb
+  DcacheMiss, // LD/ST missing the data cache
+  NUM
+};
+
+// counters[COUNTER_NUM]: cycle, time, instret, hpmcounter3 ...
+constexpr int COUNTER_NUM = 3 + int(HpmEvent::NUM);
+
+// the value of a counter csr, return false if csr is not a counter
+// counters: with the offsets of the writes
+inline bool ReadCounterCsr(int csr, const long long counters[COUNTER_NUM], u32 &value) {
+  int group = csr & ~0x9f, num = csr & 0x1f;
+  if (group != 0xc00 && group != 0xb00) return false;
+  if (group == 0xb00 && num == 1) return false; // no mtime csr
+  long long tmp = (num < COUNTER_NUM) ? counters[num] : 0;
+  value = u32((csr & 0x80) ? tmp >> 32 : tmp);
+  return true;
+}
+
+// the CSR instruction writes its csr: CSRRW(I) always, the others if rs1(uimm) is not 0
+inline bool CsrWrites(OptType opt, int rs1) {
+  return opt == OptType::CSRRW || opt == OptType::CSRRWI || rs1 != 0;
+}
+
+// the value written by a CSR instruction, old: the value read, src: x[rs1] or the uimm of the I forms
+inline u32 CsrWriteValue(OptType opt, u32 old, u32 src) {
+  if (opt == OptType::CSRRW || opt == OptType::CSRRWI) return src;
+  if (opt == OptType::CSRRS || opt == OptType::CSRRSI) return old | src;
+  return old & ~src;
+}
+
+/*
+ * write value to a counter csr, return false if csr is not a machine counter
+ * counters: with the offsets of the writes, offsets: changed so that the counter reads value(the low or high half)
+ * then counts on from it
+ */
+inline bool WriteCounterCsr(int csr, const long long counters[COUNTER_NUM], long long offsets[COUNTER_NUM], u32 value) {
+  int group = csr & ~0x9f, num = csr & 0x1f;
+  if (group != 0xb00 || num == 1) return false; // read-only, no mtime csr
+  if (num >= COUNTER_NUM) return true;
+  u64 now = u64(counters[num]);
+  u64 tmp = (csr & 0x80) ? (now & 0xffffffffULL) | (u64(value) << 32) : (now & ~0xffffffffULL) | value;
+  offsets[num] = (long long)(u64(offsets[num]) + (tmp - now));
+  return true;
+}
+
+#endif //RISCV_SIMULATOR_CSR_H
@@ -0,0 +1,63 @@
+
+#ifndef RISCV_SIMULATOR_FETCH_QUEUE_H
+#define RISCV_SIMULATOR_FETCH_QUEUE_H
+
+#include "../utils/circular_queue.h"
+#include "../utils/config.h"
+#include "instuction.h"
+
+/*
+ * decoded instructions on the predicted path, between fetch and issue
+ * fetch pushes at most FETCH_WIDTH entries per cycle, issue takes one from the front
+ */
+class FetchQueue {
+public:
+  struct FetchEntry {
+    InstructionUnit::Instruction ins;
+    u32 code = 0; // 32-bit form(after expanding a compressed instruction)
+    int pc = 0;
+    int predicted = -1; // next pc given by the prediction(-1: JALR without prediction)
+
+    friend std::ostream &operator<<(std::ostream &os, const FetchQueue::FetchEntry &obj) {
+      os << "pc = " << std::hex << obj.pc << ", code = " << obj.code << std::dec << ", len = " << obj.ins.len;
+      return os;
+    }
+  };
+
+  FetchQueue() = default;
+
+  void flush() {
+    queue_now = queue_next;
+    pushed = 0;
+  }
+
+  bool empty() {return queue_now.empty();}
+
+  // used by fetch(entries of the queue at the start of this cycle and pushed in this cycle, independent of issue)
+  bool NextFull() {return queue_now.length() + pushed >= FETCH_QUEUE_SIZE;}
+
+  int size() const {return queue_now.length();}
+
+  void push(const FetchEntry &entry) {
+    queue_next.push(entry);
+    ++pushed;
+  }
+
+  // the entry pushed last(used by fetch to fuse it with the next instruction)
+  FetchEntry &Back() {return *queue_next.back();}
+
+  // queue_now should not be empty
+  const FetchEntry &Front() {return *queue_now.front();}
+
+  void pop() {queue_next.pop();}
+
+  void Clear() {queue_next.clear();}
+
+  void print() {queue_next.print();}
+
+private:
+  CircularQueue<FetchEntry, FETCH_QUEUE_SIZE + 1> queue_now, queue_next;
+  int pushed = 0; // entries pushed in this cycle
+};
+
+#endif //RISCV_SIMULATOR_FETCH_QUEUE_H
@@ -0,0 +1,202 @@
+
+#ifndef RISCV_SIMULATOR_FU_POOL_H
+#define RISCV_SIMULATOR_FU_POOL_H
+
+#include "../utils/circular_queue.h"
+#include "../utils/config.h"
+#include "../utils/json.h"
+#include "bus.h"
+#include "instuction.h"
+
+// kinds of functional units, the pool has the first three(ALU_NUM, BRANCH_UNIT_NUM and AGU_NUM of them)
+enum class FuKind : u8 {
+  Alu, // integer operations of ari_rss
+  Branch, // B-type, JAL, JALR
+  Agu, // the address of a LD/ST sent from ls_rss to lsb
+  Mul, Div, // MultiplyUnit, DivideUnit
+  None // ECALL, CSR: nothing to execute
+};
+
+struct OpTiming {
+  FuKind kind;
+  int latency; // cycles from the start to the result(it asks for the bus then)
+  bool pipelined; // the unit may start another op the next cycle
+};
+
+/*
+ * the timing of every OptType(in the order of OptType)
+ * Agu: latency 1, the address is computed in the cycle the LD/ST is sent to lsb(lsb adds its own cycles)
+ * Mul, Div: listed for reference, MultiplyUnit and DivideUnit have their own timing(the latency of a division
+ *           is DIV_MIN_LATENCY + quotient bits)
+ */
+constexpr OpTiming OP_TIMING[] = {
+    {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, // LUI, AUIPC
+    {FuKind::Branch, 1, true}, {FuKind::Branch, 1, true}, // JAL, JALR
+    {FuKind::Branch, 1, true}, {FuKind::Branch, 1, true}, {FuKind::Branch, 1, true}, // BEQ, BNE, BLT
+    {FuKind::Branch, 1, true}, {FuKind::Branch, 1, true}, {FuKind::Branch, 1, true}, // BGE, BLTU, BGEU
+    {FuKind::Agu, 1, true}, {FuKind::Agu, 1, true}, {FuKind::Agu, 1, true}, // LB, LH, LW
+    {FuKind::Agu, 1, true}, {FuKind::Agu, 1, true}, // LBU, LHU
+    {FuKind::Agu, 1, true}, {FuKind::Agu, 1, true}, {FuKind::Agu, 1, true}, // SB, SH, SW
+    {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, // ADDI, SLTI, SLTIU
+    {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, // XORI, ORI, ANDI
+    {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, // SLLI, SRLI, SRAI
+    {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, // ADD, SUB, SLL, SLT
+    {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, // SLTU, XOR, SRL
+    {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, {FuKind::Alu, 1, true}, // SRA, OR, AND
+    {FuKind::Mul, MUL_LATENCY, true}, {FuKind::Mul, MUL_LATENCY, true}, // MUL, MULH
+    {FuKind::Mul, MUL_LATENCY, true}, {FuKind::Mul, MUL_LATENCY, true}, // MULHSU, MULHU
+    {FuKind::Div, DIV_MIN_LATENCY, false}, {FuKind::Div, DIV_MIN_LATENCY, false}, // DIV, DIVU
+    {FuKind::Div, DIV_MIN_LATENCY, false}, {FuKind::Div, DIV_MIN_LATENCY, false}, // REM, REMU
+    {FuKind::None, 0, true}, // ECALL
+    {FuKind::None, 0, true}, {FuKind::None, 0, true}, {FuKind::None, 0, true}, // CSRRW, CSRRS, CSRRC
+    {FuKind::None, 0, true}, {FuKind::None, 0, true}, {FuKind::None, 0, true} // CSRRWI, CSRRSI, CSRRCI
+};
+static_assert(sizeof (OP_TIMING) / sizeof (OP_TIMING[0]) == OPT_NUM, "a timing for each OptType");
+
+// the kind of every OptType agrees with where issue sends it, the latencies fit the units
+constexpr bool TimingFits() {
+  for (int i = 0; i < OPT_NUM; ++i) {
+    OptMeta meta = MakeOptMeta(OptType(i));
+    FuKind kind = OP_TIMING[i].kind;
+    int latency = OP_TIMING[i].latency;
+    switch (meta.unit) {
+      case UnitClass::Ari : {
+        if (kind != (meta.control ? FuKind::Branch : FuKind::Alu) || latency < 1 || latency > FU_MAX_LATENCY) return false;
+        break;
+      }
+      case UnitClass::LoadStore : if (kind != FuKind::Agu || latency != 1) return false; break;
+      case UnitClass::Mul : if (kind != FuKind::Mul) return false; break;
+      case UnitClass::Div : if (kind != FuKind::Div) return false; break;
+      case UnitClass::Commit : if (kind != FuKind::None) return false; break;
+    }
+  }
+  return true;
+}
+static_assert(TimingFits(), "OP_TIMING doesn't fit the units");
+
+inline const OpTiming &TimingOf(OptType opt) {return OP_TIMING[int(opt)];}
+
+/*
+ * the functional units of ari_rss and ls_rss: ALUs, branch units, then AGUs(unit i puts its results at UnitPort(i))
+ * an op is started on the first unit of its kind that can take it(Find), so ops are steered to the free units
+ * ALU, branch unit: an op takes the latency of its OptType, the ops leave a unit in order(a finished op waits
+ *                   in the unit while the last result of the unit is waiting for the bus)
+ *                   a pipelined op lets the unit start another op the next cycle, an unpipelined one holds it
+ * AGU: one LD/ST per cycle, its result(a ST or a forwarded LD, see LoadStoreBuffer::Execute) is put on the bus directly
+ */
+class FunctionalUnitPool {
+public:
+  struct Op {
+    long long label = -1;
+    int tag = -1, tag1 = -1; // physical registers written, tag1: by the first instruction of a fused pair
+    int value = 0, first = 0; // first: result of the first instruction of a fused pair
+    int checkpoint = -1; // branch/JALR: its checkpoint, until it is resolved
+    int jump_pc = -1; // branch/JALR: correct next pc if it is mispredicted, else -1
+    int remain = 0; // cycles until the result is ready
+    bool pipelined = true;
+  };
+
+  static FuKind KindOf(int unit) {
+    if (unit < ALU_NUM) return FuKind::Alu;
+    return (unit < ALU_NUM + BRANCH_UNIT_NUM) ? FuKind::Branch : FuKind::Agu;
+  }
+
+  // the first unit of kind that can start an op(pipelined or not) in this cycle, -1 if none
+  // an AGU whose last result is still waiting for the bus can't
+  int Find(FuKind kind, bool pipelined, const CommonDataBus &cdb) const {
+    for (int i = 0; i < FU_NUM; ++i) {
+      if (KindOf(i) != kind || units[i].started) continue;
+      const Unit &unit = units[i];
+      if (kind == FuKind::Agu) {
+        if (!cdb.Waiting(UnitPort(i))) return i;
+        continue;
+      }
+      int length = unit.pipe.length();
+      if (length == 0) return i;
+      if (!pipelined || unit.blocked || length == FU_MAX_LATENCY) continue;
+      return i;
+    }
+    return -1;
+  }
+
+  // start op on unit(an AGU: op is only counted)
+  void Start(int unit, const Op &op) {
+    Unit &tmp = units[unit];
+    tmp.started = true;
+    ++tmp.ops;
+    if (KindOf(unit) == FuKind::Agu) return;
+    tmp.pipe.push(op);
+    if (!op.pipelined) tmp.blocked = true;
+  }
+
+  // once per cycle(in WriteBack): count busy units, every op moves one cycle forward unless the op ahead blocks it
+  void Advance() {
+    for (Unit &unit : units) {
+      if (unit.started || unit.pipe.length() > 0) ++unit.busy;
+      unit.started = false;
+      int ahead = -1;
+      for (CircularQueue<Op, FU_MAX_LATENCY + 1>::iterator iter = unit.pipe.front(); iter != unit.pipe.end(); ++iter) {
+        if (iter->remain - 1 > ahead) --iter->remain;
+        ahead = iter->remain;
+      }
+    }
+  }
+
+  // the finished op at the front of unit, nullptr if none
+  Op *Finished(int unit) {
+    Unit &tmp = units[unit];
+    if (tmp.pipe.empty() || tmp.pipe.front()->remain > 0) return nullptr;
+    return &*tmp.pipe.front();
+  }
+
+  void Pop(int unit) {
+    Unit &tmp = units[unit];
+    tmp.pipe.pop();
+    if (tmp.pipe.empty()) tmp.blocked = false;
+  }
+
+  // remove ops after the instruction of label(a mispredicted branch/JALR), the others stay in their stages
+  void Squash(long long label) {
+    for (Unit &unit : units) {
+      CircularQueue<Op, FU_MAX_LATENCY + 1> tmp = unit.pipe;
+      unit.pipe.clear();
+      unit.blocked = false;
+      for (CircularQueue<Op, FU_MAX_LATENCY + 1>::iterator iter = tmp.front(); iter != tmp.end(); ++iter) {
+        if (iter->label > label) continue;
+        unit.pipe.push(*iter);
+        if (!iter->pipelined) unit.blocked = true;
+      }
+    }
+  }
+
+  // per unit: ops started, busy cycles(an op in the unit) and utilization(busy cycles / cycles)
+  void PrintStats(JsonWriter &json, long long cycles) const {
+    const char *names[] = {"alu", "branch", "agu"};
+    int index[3] = {0, 0, 0};
+    for (int i = 0; i < FU_NUM; ++i) {
+      int kind = int(KindOf(i));
+      std::string name = std::string(names[kind]) + std::to_string(index[kind]++);
+      PrintUnit(json, name.c_str(), units[i].ops, units[i].busy, cycles);
+    }
+  }
+
+  static void PrintUnit(JsonWriter &json, const char *name, long long ops, long long busy, long long cycles) {
+    json.BeginObject(name);
+    json.Value("ops", ops);
+    json.Value("busy_cycles", busy);
+    json.Value("utilization", (cycles == 0) ? 0.0 : double(busy) / double(cycles));
+    json.EndObject();
+  }
+
+private:
+  struct Unit {
+    CircularQueue<Op, FU_MAX_LATENCY + 1> pipe;
+    bool started = false; // an op is started in this cycle
+    bool blocked = false; // an unpipelined op is in the unit
+    long long ops = 0, busy = 0;
+  };
+
+  Unit units[FU_NUM];
+};
+
+#endif //RISCV_SIMULATOR_FU_POOL_H
@@ -26,52 +26,6 @@ int InstructionUnit::SignExtend(u32 src, int len) {
   return int(tmp);
 }
 
-int InstructionUnit::GetImm(u32 instruction, InstructionType type) {
-  u32 ret = 0;
-  if (type == InstructionType::U) {
-    ret = instruction >> 12;
-    ret = ret << 12;
-    return int(ret);
-  }
-  if (type == InstructionType::J) {
-    u32 tmp = instruction >> 12;
-    ret = ret | (tmp & 0x80000);
-    ret = ret | ((tmp & 0x7fe00) >> 9);
-    ret = ret | ((tmp & 0x100) << 2);
-    ret = ret | ((tmp & 0xff) << 11);
-    ret = ret << 1;
-    return SignExtend(ret, 21);
-  }
-  if (type == InstructionType::I) {
-    u8 f3 = GetFunct3(instruction);
-    if (GetOpt(instruction) == 0b0010011 && (f3 == 0b001 || f3 == 0b101)) {
-      ret = (instruction & 0x3f00000) >> 20;
-      return int(ret);
-    }
-    else {
-      ret = instruction >> 20;
-      return SignExtend(ret, 12);
-    }
-  }
-  if (type == InstructionType::S) {
-    u32 tmp = instruction >> 25;
-    tmp = tmp << 5;
-    ret = ret | tmp;
-    tmp = (instruction & 0xf80) >> 7;
-    ret = ret | tmp;
-    return SignExtend(ret, 12);
-  }
-  u32 tmp = (instruction >> 31) << 12;
-  ret = ret | tmp;
-  tmp = (instruction & 0x7e000000) >> 20;
-  ret = ret | tmp;
-  tmp = (instruction & 0xf00) >> 7;
-  ret = ret | tmp;
-  tmp = (instruction & 0x80) << 4;
-  ret = ret | tmp;
-  return SignExtend(ret, 13);
-}
-
 int InstructionUnit::GetRs1(u32 instruction) {
   u32 tmp = (instruction & 0xf8000) >> 15;
   return int(tmp);
@@ -90,224 +44,204 @@ u8 InstructionUnit::GetFunct7(u32 instruction) {
   return u8((instruction & 0xfe000000) >> 25);
 }
 
-InstructionType InstructionUnit::GetInstructionType(u32 instruction) {
-  u8 tmp = GetOpt(instruction);
-  if (tmp == 0b0110011) return InstructionType::R;
-  if (tmp == 0b11 || tmp == 0b10011 || tmp == 0b1100111) return InstructionType::I;
-  if (tmp == 0b0100011) return InstructionType::S;
-  if (tmp == 0b1100011) return InstructionType::B;
-  if (tmp == 0b0110111 || tmp == 0b0010111) return InstructionType::U;
-  if (tmp == 0b1101111) return InstructionType::J;
-  else throw std::exception();
+namespace {
+
+// the immediate extractors, in the order of Immediates
+enum class ImmFormat : u8 {
+  None, // R-type
+  I, S, B, U, J,
+  Shift, // SLLI, SRLI, SRAI: shamt(not sign extended)
+  Csr, // CSR instructions: the csr(not sign extended)
+  NUM
+};
+
+/*
+ * valid: 0 invalid, 1 valid, 2 valid only if the instruction is exactly 0x00000073(ECALL)
+ * rd, rs1, rs2: 0x1f if the format has the field, else 0(the field is masked to x0)
+ */
+struct DecodeEntry {
+  u8 opt; // OptType
+  u8 type; // InstructionType
+  ImmFormat imm;
+  u8 valid;
+  u8 rd, rs1, rs2;
+};
+
+constexpr ImmFormat FormatOf(InstructionType type) {
+  return (type == InstructionType::R) ? ImmFormat::None : ImmFormat(int(ImmFormat::I) + int(type) - int(InstructionType::I));
+}
+
+constexpr DecodeEntry Entry(OptType opt, InstructionType type, ImmFormat imm, u8 valid) {
+  return {u8(opt), u8(type), imm, valid,
+          u8((type == InstructionType::S || type == InstructionType::B) ? 0 : 0x1f),
+          u8((type == InstructionType::U || type == InstructionType::J) ? 0 : 0x1f),
+          u8((type == InstructionType::R || type == InstructionType::S || type == InstructionType::B) ? 0x1f : 0)};
+}
+
+constexpr DecodeEntry Entry(OptType opt, InstructionType type, ImmFormat imm) {
+  return Entry(opt, type, imm, 1);
+}
+
+constexpr DecodeEntry Entry(OptType opt, InstructionType type) {
+  return Entry(opt, type, FormatOf(type), 1);
+}
+
+constexpr DecodeEntry INVALID = Entry(OptType::ADD, InstructionType::R, ImmFormat::None, 0);
+
+constexpr OptType Opt(OptType first, int offset) {
+  return OptType(int(first) + offset);
 }
 
-InstructionUnit::Instruction InstructionUnit::DecodeSet(u32 instruction, InstructionType type) {
-  InstructionUnit::Instruction ret;
-  ret.type = type;
-  u8 op_code = GetOpt(instruction);
-  switch (type) {
-    case InstructionType::U : {
-      ret.rd = GetRd(instruction);
-      ret.imm = GetImm(instruction, type);
-      ret.opt = (op_code == 0b0110111) ? OptType::LUI : OptType::AUIPC;
-      break;
+/*
+ * f7 is reduced to a class for the index: 0(0000000), 1(0100000), 2(0000001, RV32M), 3(others)
+ * the entry for op_code, f3 and the class of f7
+ */
+constexpr DecodeEntry MakeDecodeEntry(int op_code, int f3, int f7) {
+  switch (op_code) {
+    case 0b0110111 : return Entry(OptType::LUI, InstructionType::U);
+    case 0b0010111 : return Entry(OptType::AUIPC, InstructionType::U);
+    case 0b1101111 : return Entry(OptType::JAL, InstructionType::J);
+    case 0b1100111 : return Entry(OptType::JALR, InstructionType::I);
+    case 0b1100011 : {
+      // funct3 in the order of BEQ, BNE, -, -, BLT, BGE, BLTU, BGEU
+      if (f3 == 0b010 || f3 == 0b011) return INVALID;
+      return Entry(Opt(OptType::BEQ, (f3 < 0b100) ? f3 : f3 - 2), InstructionType::B);
     }
-    case InstructionType::J : {
-      ret.rd = GetRd(instruction);
-      ret.imm = GetImm(instruction, type);
-      ret.opt = OptType::JAL;
-      break;
+    case 0b0000011 : {
+      // funct3 in the order of LB, LH, LW, -, LBU, LHU
+      if (f3 == 0b011 || f3 > 0b101) return INVALID;
+      return Entry(Opt(OptType::LB, (f3 < 0b100) ? f3 : f3 - 1), InstructionType::I);
     }
-    case InstructionType::R : {
-      ret.rd = GetRd(instruction);
-      ret.rs1 = GetRs1(instruction);
-      ret.rs2 = GetRs2(instruction);
-      u8 f3 = GetFunct3(instruction);
-      u8 f7 = GetFunct7(instruction);
+    case 0b0100011 : return Entry(Opt(OptType::SB, (f3 < 0b010) ? f3 : 2), InstructionType::S);
+    case 0b0010011 : {
       switch (f3) {
-        case 0b000 : {
-          if (f7 == 0b0000000) {
-            ret.opt = OptType::ADD;
-          }
-          else if (f7 == 0b0100000) {
-            ret.opt = OptType::SUB;
-          }
-          break;
-        }
-        case 0b001 : {
-          ret.opt = OptType::SLL;
-          break;
-        }
-        case 0b010 : {
-          ret.opt = OptType::SLT;
-          break;
-        }
-        case 0b011 : {
-          ret.opt = OptType::SLTU;
-          break;
-        }
-        case 0b100 : {
-          ret.opt = OptType::XOR;
-          break;
-        }
-        case 0b101 : {
-          if (f7 == 0b0000000) {
-            ret.opt = OptType::SRL;
-          }
-          else if (f7 == 0b0100000) {
-            ret.opt = OptType::SRA;
-          }
-          break;
-        }
-        case 0b110 : {
-          ret.opt = OptType::OR;
-          break;
-        }
-        case 0b111 : {
-          ret.opt = OptType::AND;
-          break;
-        }
+        case 0b000 : return Entry(OptType::ADDI, InstructionType::I);
+        case 0b010 : return Entry(OptType::SLTI, InstructionType::I);
+        case 0b011 : return Entry(OptType::SLTIU, InstructionType::I);
+        case 0b100 : return Entry(OptType::XORI, InstructionType::I);
+        case 0b110 : return Entry(OptType::ORI, InstructionType::I);
+        case 0b111 : return Entry(OptType::ANDI, InstructionType::I);
+        case 0b001 : return Entry(OptType::SLLI, InstructionType::I, ImmFormat::Shift);
+        default : return Entry((f7 == 0) ? OptType::SRLI : OptType::SRAI, InstructionType::I, ImmFormat::Shift);
       }
-      break;
     }
-    case InstructionType::I : {
-      ret.rd = GetRd(instruction);
-      ret.rs1 = GetRs1(instruction);
-      ret.imm = GetImm(instruction, type);
-      u8 f3 = GetFunct3(instruction);
-      u8 f7 = GetFunct7(instruction);
-      if (op_code == 0b1100111) {
-        ret.opt = OptType::JALR;
-      }
-      else if (op_code == 0b0000011) {
-        switch (f3) {
-          case 0b000 : {
-            ret.opt = OptType::LB;
-            break;
-          }
-          case 0b001 : {
-            ret.opt = OptType::LH;
-            break;
-          }
-          case 0b010 : {
-            ret.opt = OptType::LW;
-            break;
-          }
-          case 0b100 : {
-            ret.opt = OptType::LBU;
-            break;
-          }
-          case 0b101 : {
-            ret.opt = OptType::LHU;
-            break;
-          }
-        }
-      }
-      else {
-        switch (f3) {
-          case 0b000 : {
-            ret.opt = OptType::ADDI;
-            break;
-          }
-          case 0b010 : {
-            ret.opt = OptType::SLTI;
-            break;
-          }
-          case 0b011 : {
-            ret.opt = OptType::SLTIU;
-            break;
-          }
-          case 0b100 : {
-            ret.opt = OptType::XORI;
-            break;
-          }
-          case 0b110 : {
-            ret.opt = OptType::ORI;
-            break;
-          }
-          case 0b111 : {
-            ret.opt = OptType::ANDI;
-            break;
-          }
-          case 0b001 : {
-            ret.opt = OptType::SLLI;
-            break;
-          }
-          case 0b101 : {
-            if (f7 == 0) ret.opt = OptType::SRLI;
-            else ret.opt = OptType::SRAI;
-            break;
-          }
-        }
-      }
-      break;
-    }
-    case InstructionType::S : {
-      ret.rs1 = GetRs1(instruction);
-      ret.rs2 = GetRs2(instruction);
-      ret.imm = GetImm(instruction, type);
-      u8 f3 = GetFunct3(instruction);
-      if (f3 == 0) {
-        ret.opt = OptType::SB;
-      }
-      else if (f3 == 0b001) {
-        ret.opt = OptType::SH;
-      }
-      else {
-        ret.opt = OptType::SW;
-      }
-      break;
-    }
-    case InstructionType::B : {
-      ret.rs1 = GetRs1(instruction);
-      ret.rs2 = GetRs2(instruction);
-      ret.imm = GetImm(instruction, type);
-      u8 f3 = GetFunct3(instruction);
+    case 0b0110011 : {
+      // funct3 in the order of MUL, MULH, MULHSU, MULHU, DIV, DIVU, REM, REMU
+      if (f7 == 2) return Entry(Opt(OptType::MUL, f3), InstructionType::R, ImmFormat::None);
       switch (f3) {
-        case 0b000 : {
-          ret.opt = OptType::BEQ;
-          break;
-        }
-        case 0b001 : {
-          ret.opt = OptType::BNE;
-          break;
-        }
-        case 0b100 : {
-          ret.opt = OptType::BLT;
-          break;
-        }
-        case 0b101 : {
-          ret.opt = OptType::BGE;
-          break;
-        }
-        case 0b110 : {
-          ret.opt = OptType::BLTU;
-          break;
-        }
-        case 0b111 : {
-          ret.opt = OptType::BGEU;
-          break;
-        }
+        case 0b000 : return (f7 < 2) ? Entry((f7 == 0) ? OptType::ADD : OptType::SUB, InstructionType::R, ImmFormat::None) : INVALID;
+        case 0b001 : return Entry(OptType::SLL, InstructionType::R, ImmFormat::None);
+        case 0b010 : return Entry(OptType::SLT, InstructionType::R, ImmFormat::None);
+        case 0b011 : return Entry(OptType::SLTU, InstructionType::R, ImmFormat::None);
+        case 0b100 : return Entry(OptType::XOR, InstructionType::R, ImmFormat::None);
+        case 0b101 : return (f7 < 2) ? Entry((f7 == 0) ? OptType::SRL : OptType::SRA, InstructionType::R, ImmFormat::None) : INVALID;
+        case 0b110 : return Entry(OptType::OR, InstructionType::R, ImmFormat::None);
+        default : return Entry(OptType::AND, InstructionType::R, ImmFormat::None);
       }
-      break;
     }
+    case 0b1110011 : {
+      // SYSTEM: ECALL and the CSR instructions(funct3 in the order of -, CSRRW, CSRRS, CSRRC, -, CSRRWI, CSRRSI, CSRRCI)
+      if (f3 == 0b000) return Entry(OptType::ECALL, InstructionType::I, ImmFormat::None, 2);
+      if (f3 == 0b100) return INVALID;
+      return Entry(Opt(OptType::CSRRW, (f3 < 0b100) ? f3 - 1 : f3 - 2), InstructionType::I, ImmFormat::Csr);
+    }
+    default : return INVALID;
   }
-  current_ins = ret;
+}
+
+struct DecodeTable {
+  u8 f7_class[128];
+  DecodeEntry entry[1 << 10]; // by op_code[6:2], f3, the class of f7
+};
+
+constexpr DecodeTable MakeDecodeTable() {
+  DecodeTable ret{};
+  for (int i = 0; i < 128; ++i) ret.f7_class[i] = u8((i == 0) ? 0 : (i == 0b0100000) ? 1 : (i == 0b0000001) ? 2 : 3);
+  for (int i = 0; i < (1 << 10); ++i) ret.entry[i] = MakeDecodeEntry(((i >> 5) << 2) | 0b11, (i >> 2) & 0b111, i & 0b11);
+  return ret;
+}
+
+constexpr DecodeTable DECODE_TABLE = MakeDecodeTable();
+
+static_assert(DECODE_TABLE.entry[(0b01100 << 5) | (0b000 << 2) | 1].opt == u8(OptType::SUB), "decode table: SUB");
+static_assert(DECODE_TABLE.entry[(0b01100 << 5) | (0b110 << 2) | 2].opt == u8(OptType::REM), "decode table: REM");
+static_assert(DECODE_TABLE.entry[(0b00100 << 5) | (0b101 << 2) | 1].opt == u8(OptType::SRAI), "decode table: SRAI");
+static_assert(DECODE_TABLE.entry[(0b00000 << 5) | (0b101 << 2)].opt == u8(OptType::LHU), "decode table: LHU");
+static_assert(DECODE_TABLE.entry[(0b11000 << 5) | (0b111 << 2)].opt == u8(OptType::BGEU), "decode table: BGEU");
+static_assert(DECODE_TABLE.entry[(0b11100 << 5) | (0b111 << 2)].opt == u8(OptType::CSRRCI), "decode table: CSRRCI");
+static_assert(DECODE_TABLE.entry[(0b01000 << 5) | (0b111 << 2)].opt == u8(OptType::SW), "decode table: SW");
+static_assert(DECODE_TABLE.entry[(0b11000 << 5) | (0b010 << 2)].valid == 0, "decode table: invalid branch");
+static_assert(FormatOf(InstructionType::J) == ImmFormat::J, "ImmFormat in the order of InstructionType");
+
+const DecodeEntry &Lookup(u32 instruction) {
+  if ((instruction & 0b11) != 0b11) throw std::exception();
+  u32 index = ((instruction >> 2) & 0x1f) << 5 | ((instruction >> 12) & 0b111) << 2 | DECODE_TABLE.f7_class[instruction >> 25];
+  return DECODE_TABLE.entry[index];
+}
+
+// sign extended by an arithmetic shift of the top bit
+u32 Sign(u32 instruction, int shift) {
+  return u32(int(instruction) >> 31) << shift;
+}
+
+// imm of every format(ImmFormat as the index), computed without a branch on the format
+void Immediates(u32 instruction, int imm[int(ImmFormat::NUM)]) {
+  imm[int(ImmFormat::None)] = 0;
+  imm[int(ImmFormat::I)] = int(instruction) >> 20;
+  imm[int(ImmFormat::S)] = int(Sign(instruction, 12) | (instruction >> 20 & 0xfe0) | (instruction >> 7 & 0x1f));
+  imm[int(ImmFormat::B)] = int(Sign(instruction, 12) | (instruction << 4 & 0x800) | (instruction >> 20 & 0x7e0) | (instruction >> 7 & 0x1e));
+  imm[int(ImmFormat::U)] = int(instruction & 0xfffff000);
+  imm[int(ImmFormat::J)] = int(Sign(instruction, 20) | (instruction & 0xff000) | (instruction >> 9 & 0x800) | (instruction >> 20 & 0x7fe));
+  imm[int(ImmFormat::Shift)] = int(instruction >> 20 & 0x3f);
+  imm[int(ImmFormat::Csr)] = int(instruction >> 20);
+}
+
+}
+
+InstructionType InstructionUnit::GetInstructionType(u32 instruction) {
+  const DecodeEntry &entry = Lookup(instruction);
+  if (entry.valid == 0) throw std::exception();
+  return InstructionType(entry.type);
+}
+
+/*
+ * one lookup in DECODE_TABLE(generated at compile time) gives opt, type, the fields and the format of imm
+ * the fields are masked and imm is selected by the format, so a mix of formats doesn't mispredict
+ * an invalid encoding throws
+ */
+const InstructionUnit::Instruction &InstructionUnit::DecodeSet(u32 instruction, int len) {
+  const DecodeEntry &entry = Lookup(instruction);
+  if (entry.valid != 1 && (entry.valid == 0 || instruction != 0x00000073)) throw std::exception();
+  current_ins = Instruction();
+  Instruction &ret = current_ins;
+  ret.type = InstructionType(entry.type);
+  ret.opt = OptType(entry.opt);
+  ret.len = len;
+  ret.rd = GetRd(instruction) & entry.rd;
+  ret.rs1 = GetRs1(instruction) & entry.rs1;
+  ret.rs2 = GetRs2(instruction) & entry.rs2;
+  int imm[int(ImmFormat::NUM)];
+  Immediates(instruction, imm);
+  ret.imm = imm[int(entry.imm)];
   current_code = instruction;
   return ret;
 }
 
 int InstructionUnit::NextPc(Predictor &predictor, int pc) {
   if (current_ins.type != InstructionType::B && current_ins.type != InstructionType::J && current_ins.opt != OptType::JALR) {
-    return pc + 4;
+    return pc + current_ins.len;
   }
   else if (current_ins.type == InstructionType::J) {
-    predictor.AddJalAdd(pc + 4);
+    predictor.AddJalAdd(pc + current_ins.len);
     return pc + current_ins.imm;
   }
   else if (current_ins.type == InstructionType::B) {
-    if (predictor.BJump(current_code)) return pc + current_ins.imm;
-    return pc + 4;
+    if (predictor.BJump(pc)) return pc + current_ins.imm;
+    return pc + current_ins.len;
+  }
+  else if (current_ins.fused == FusedType::AuipcJalr) {
+    predictor.AddJalAdd(pc + current_ins.len);
+    return (pc + current_ins.imm1 + current_ins.imm) & ~1;
   }
   else if (current_ins.opt == OptType::JALR) {
     int tmp = predictor.JALRJump();
@@ -315,4 +249,40 @@ int InstructionUnit::NextPc(Predictor &predictor, int pc) {
     stall = true;
     return -1;
   }
-}
\ No newline at end of file
+}
+
+bool InstructionUnit::Fuse(Instruction &first) {
+  const Instruction &second = current_ins;
+  if (first.fused != FusedType::None || first.rd == 0) return false;
+  Instruction ret = second;
+  ret.opt1 = first.opt;
+  ret.rd1 = first.rd;
+  ret.imm1 = first.imm;
+  ret.len1 = first.len;
+  ret.len = first.len + second.len;
+  if (first.opt == OptType::LUI && second.opt == OptType::ADDI && second.rs1 == first.rd) {
+    ret.fused = FusedType::LuiAddi;
+    ret.rs1 = 0;
+  }
+  else if (first.opt == OptType::AUIPC && second.opt == OptType::JALR && second.rs1 == first.rd) {
+    ret.fused = FusedType::AuipcJalr;
+    ret.rs1 = 0;
+  }
+  else if (first.opt == OptType::SLLI && second.opt == OptType::ADD && (second.rs1 == first.rd) != (second.rs2 == first.rd)) {
+    ret.fused = FusedType::SlliAdd;
+    ret.rs1 = first.rs1;
+    ret.rs2 = (second.rs1 == first.rd) ? second.rs2 : second.rs1;
+  }
+  else if ((first.opt == OptType::SLT || first.opt == OptType::SLTU || first.opt == OptType::SLTI || first.opt == OptType::SLTIU)
+           && (second.opt == OptType::BEQ || second.opt == OptType::BNE)
+           && ((second.rs1 == first.rd && second.rs2 == 0) || (second.rs1 == 0 && second.rs2 == first.rd))) {
+    ret.fused = FusedType::CmpBranch;
+    ret.rs1 = first.rs1;
+    ret.rs2 = (first.type == InstructionType::R) ? first.rs2 : 0;
+    ret.imm = first.len + second.imm; // the offset from the first instruction
+  }
+  else return false;
+  first = ret;
+  current_ins = ret;
+  return true;
+}
@@ -7,7 +7,7 @@
 
 enum class InstructionType {
   R, // 0110011
-  I, // 00x0011
+  I, // 00x0011, 1100111, 1110011(ECALL, CSR)
   S, // 0100011
   B, // 1100011
   U, // 0x10111
@@ -23,11 +23,87 @@ enum class OptType {
   LB, LH, LW, LBU, LHU, // I-type
   SB, SH, SW, // S-type
   ADDI, SLTI, SLTIU, XORI, ORI, ANDI, SLLI, SRLI, SRAI, // I-type
-  ADD, SUB, SLL, SLT, SLTU, XOR, SRL, SRA, OR, AND // R-type
+  ADD, SUB, SLL, SLT, SLTU, XOR, SRL, SRA, OR, AND, // R-type
+  MUL, MULH, MULHSU, MULHU, DIV, DIVU, REM, REMU, // R-type(RV32M)
+  ECALL, // I-type: a system call(see SyscallEmulator), executed when it commits
+  CSRRW, CSRRS, CSRRC, CSRRWI, CSRRSI, CSRRCI // I-type(Zicsr): imm is the csr, rs1 the uimm of the I forms, executed when it commits
+};
+
+constexpr int OPT_NUM = int(OptType::CSRRCI) + 1;
+
+// where an operation is executed
+enum class UnitClass : u8 {
+  Ari, // ari_rss(ALU, branches, jumps)
+  LoadStore, // ls_rss, then lsb
+  Mul, Div, // mul_rss, div_rss
+  Commit // only in rob, done when it commits(ECALL, CSR)
+};
+
+// static properties of an operation, looked up with OptInfo(one indexed load instead of a chain of comparisons)
+struct OptMeta {
+  InstructionType type = InstructionType::I;
+  UnitClass unit = UnitClass::Ari;
+  bool load = false, store = false;
+  bool branch = false; // B-type
+  bool control = false; // B-type, JAL, JALR: pc may not be pc + len
+  bool writes_rd = false; // the format has rd(it may still be x0)
+  u8 size = 0; // LD/ST: bytes accessed
+};
+
+constexpr OptMeta MakeOptMeta(OptType opt) {
+  OptMeta ret;
+  int i = int(opt);
+  if (opt <= OptType::AUIPC) ret.type = InstructionType::U;
+  else if (opt == OptType::JAL) ret.type = InstructionType::J;
+  else if (opt >= OptType::BEQ && opt <= OptType::BGEU) ret.type = InstructionType::B;
+  else if (opt >= OptType::SB && opt <= OptType::SW) ret.type = InstructionType::S;
+  else if (opt >= OptType::ADD && opt <= OptType::REMU) ret.type = InstructionType::R;
+  if (opt >= OptType::LB && opt <= OptType::SW) ret.unit = UnitClass::LoadStore;
+  else if (opt >= OptType::MUL && opt <= OptType::MULHU) ret.unit = UnitClass::Mul;
+  else if (opt >= OptType::DIV && opt <= OptType::REMU) ret.unit = UnitClass::Div;
+  else if (opt >= OptType::ECALL) ret.unit = UnitClass::Commit;
+  ret.load = opt >= OptType::LB && opt <= OptType::LHU;
+  ret.store = opt >= OptType::SB && opt <= OptType::SW;
+  ret.branch = ret.type == InstructionType::B;
+  ret.control = ret.branch || opt == OptType::JAL || opt == OptType::JALR;
+  ret.writes_rd = ret.type != InstructionType::S && ret.type != InstructionType::B;
+  if (ret.load || ret.store) {
+    int width = ret.load ? (i - int(OptType::LB)) % 3 : i - int(OptType::SB); // LBU, LHU: as LB, LH
+    ret.size = u8(1 << width);
+  }
+  return ret;
+}
+
+struct OptTable {
+  OptMeta meta[OPT_NUM];
+};
+
+constexpr OptTable MakeOptTable() {
+  OptTable ret{};
+  for (int i = 0; i < OPT_NUM; ++i) ret.meta[i] = MakeOptMeta(OptType(i));
+  return ret;
+}
+
+inline const OptMeta &OptInfo(OptType opt) {
+  static constexpr OptTable table = MakeOptTable();
+  return table.meta[int(opt)];
+}
+
+/*
+ * adjacent pairs issued as one operation(see InstructionUnit::Fuse)
+ * the fused operation takes the opt of the second instruction and writes the rd of both
+ */
+enum class FusedType {
+  None,
+  LuiAddi, // lui rd, hi; addi rd2, rd, lo: a 32-bit constant
+  AuipcJalr, // auipc rd, hi; jalr rd2, lo(rd): a far call/jump
+  SlliAdd, // slli rd, rs, sh; add rd2, rd, rs2: an address
+  CmpBranch, // slt/sltu/slti/sltiu rd, ...; beq/bne rd, x0: compare and branch
+  NUM
 };
 
 class InstructionUnit {
-  friend class CPU;
+  template <typename Trace> friend class CPU;
 public:
   struct Instruction {
     InstructionType type;
@@ -36,19 +112,47 @@ public:
     int rs2 = 0;
     int rd = 0;
     int imm = 0;
+    int len = 4; // 2 for a compressed(RV32C) instruction
+    // fused pair: the fields above are the second instruction(rs1, rs2 are the sources of the pair, len is the sum)
+    // and the ones below are the first
+    FusedType fused = FusedType::None;
+    OptType opt1 = OptType::ADDI;
+    int rd1 = 0;
+    int imm1 = 0;
+    int len1 = 0;
     Instruction() = default;
   };
 
   /*
-   * decode a 32-bit instruction(int right order)
+   * decode a 32-bit instruction(int right order), throw if it is not a valid one
+   * len: size of the instruction in memory(2 if it is expanded from a compressed one)
+   * return the current instruction(valid until the next DecodeSet or Fuse)
+   */
+  const Instruction &DecodeSet(u32 instruction, int len = 4);
+
+  /*
+   * instruction: 4 bytes read at pc(only the lower 2 bytes are used if it is compressed)
+   * return the 32-bit instruction(a compressed one is expanded), set len to 2 or 4
    */
-  Instruction DecodeSet(u32 instruction, InstructionType type);
+  static u32 Expand(u32 instruction, int &len);
 
   static InstructionType GetInstructionType(u32 instruction);
 
+  /*
+   * try to fuse the instruction just decoded with first(the instruction before it)
+   * if they are a fusible pair, first becomes the fused instruction(and the current one), return true
+   */
+  bool Fuse(Instruction &first);
+
+  // Zicsr: CSRRW, CSRRS, CSRRC and the I forms(see csr.h)
+  static bool IsCsr(OptType opt) {
+    return opt >= OptType::CSRRW && opt <= OptType::CSRRCI;
+  }
+
   /*
    * calculate next pc according to current_instruction, pc and predictor
-   * B-type:jump, J-type:predictor, else pc += 4;
+   * B-type:jump, J-type:predictor, else pc += len of current instruction;
+   * fused auipc + jalr: the target is known
    */
   int NextPc(Predictor &predictor, int pc);
 
@@ -56,16 +160,19 @@ private:
   Instruction current_ins;
   u32 current_code;
   bool stall = false;
+  bool fusion = true; // fuse adjacent pairs in the same fetch group
 
   static u8 GetOpt(u32 instruction);
   static int GetRd(u32 instruction);
-  static int GetImm(u32 instruction, InstructionType type);
   static int GetRs1(u32 instruction);
   static int GetRs2(u32 instruction);
   static u8 GetFunct3(u32 instruction);
   static u8 GetFunct7(u32 instruction);
 
   static int SignExtend(u32 src, int len);
+
+  // RV32C, implemented in compressed.cpp
+  static u32 ExpandCompressed(u32 instruction);
 };
 
 #endif //RISCV_SIMULATOR_INSTUCTION_H
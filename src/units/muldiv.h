@@ -0,0 +1,186 @@
+
+#ifndef RISCV_SIMULATOR_MULDIV_H
+#define RISCV_SIMULATOR_MULDIV_H
+
+#include <climits>
+#include "../utils/circular_queue.h"
+#include "../utils/config.h"
+#include "instuction.h"
+
+/*
+ * functional units of RV32M, fed by their own reservation stations
+ * Issue(): called in ExecuteRss when an entry is dispatched
+ * Advance(): called once per cycle in WriteBack, a finished result waits in the unit until it gets the bus
+ */
+
+// pipelined: accepts one op per cycle, every op takes MUL_LATENCY cycles
+class MultiplyUnit {
+public:
+  /*
+   * the unsigned operands are multiplied in unsigned long long(the product of two u32s overflows long long)
+   * MULHSU(signed a, unsigned b): the high word of the unsigned product, minus b if a is negative
+   *                               (a = u32(a) - 2^32 when a < 0)
+   */
+  static int Compute(OptType opt, int a, int b) {
+    long long sa = a, sb = b;
+    unsigned long long ua = u32(a), ub = u32(b);
+    switch (opt) {
+      case OptType::MUL : return int(u32(ua * ub));
+      case OptType::MULH : return int((sa * sb) >> 32);
+      case OptType::MULHSU : return int(u32((ua * ub) >> 32) - (a < 0 ? u32(b) : 0u));
+      case OptType::MULHU : return int(u32((ua * ub) >> 32));
+      default: throw std::exception();
+    }
+  }
+
+  // the first stage is empty, it is left only when the op ahead does not block it
+  bool Free() {return pipe.empty() || (!pipe.full() && pipe.back()->remain < MUL_LATENCY);}
+
+  // return the result(it is put on bus MUL_LATENCY cycles later)
+  int Issue(long long label, int tag, OptType opt, int a, int b) {
+    int value = Compute(opt, a, b);
+    pipe.push({label, tag, value, MUL_LATENCY});
+    ++ops;
+    return value;
+  }
+
+  // every op moves one stage forward unless the stage ahead is still taken(the front result is waiting for the bus)
+  void Advance() {
+    if (!pipe.empty()) ++busy_cycles;
+    int ahead = -1;
+    for (CircularQueue<Op, MUL_LATENCY + 1>::iterator iter = pipe.front(); iter != pipe.end(); ++iter) {
+      if (iter->remain - 1 > ahead) --iter->remain;
+      ahead = iter->remain;
+    }
+  }
+
+  bool Done() {return !pipe.empty() && pipe.front()->remain == 0;}
+
+  long long Label() {return pipe.front()->label;}
+
+  int Tag() {return pipe.front()->tag;}
+
+  int Value() {return pipe.front()->value;}
+
+  void Pop() {pipe.pop();}
+
+  void Clear() {pipe.clear();}
+
+  // remove ops after the instruction of label(a mispredicted branch/JALR), the others stay in their stages
+  void Squash(long long label) {
+    CircularQueue<Op, MUL_LATENCY + 1> tmp = pipe;
+    pipe.clear();
+    for (CircularQueue<Op, MUL_LATENCY + 1>::iterator iter = tmp.front(); iter != tmp.end(); ++iter) {
+      if (iter->label <= label) pipe.push(*iter);
+    }
+  }
+
+  long long Ops() const {return ops;}
+
+  // cycles with an op in the unit
+  long long BusyCycles() const {return busy_cycles;}
+
+private:
+  struct Op {
+    long long label = -1;
+    int tag = -1; // physical register of the result
+    int value = 0;
+    int remain = 0; // cycles until the result is ready
+  };
+
+  CircularQueue<Op, MUL_LATENCY + 1> pipe;
+  long long ops = 0, busy_cycles = 0;
+};
+
+// iterative and not pipelined: one quotient bit per cycle, early out when the quotient is short
+class DivideUnit {
+public:
+  static int Compute(OptType opt, int a, int b) {
+    switch (opt) {
+      case OptType::DIV : {
+        if (b == 0) return -1;
+        if (a == INT_MIN && b == -1) return INT_MIN;
+        return a / b;
+      }
+      case OptType::DIVU : return (b == 0) ? -1 : int(u32(a) / u32(b));
+      case OptType::REM : {
+        if (b == 0) return a;
+        if (a == INT_MIN && b == -1) return 0;
+        return a % b;
+      }
+      case OptType::REMU : return (b == 0) ? a : int(u32(a) % u32(b));
+      default: throw std::exception();
+    }
+  }
+
+  /*
+   * DIV_MIN_LATENCY + number of quotient bits(bits of |a| - bits of |b| + 1)
+   * division by zero and a < b finish in DIV_MIN_LATENCY cycles
+   */
+  static int Latency(OptType opt, int a, int b) {
+    bool sign = (opt == OptType::DIV || opt == OptType::REM);
+    u32 ua = (sign && a < 0) ? 0u - u32(a) : u32(a);
+    u32 ub = (sign && b < 0) ? 0u - u32(b) : u32(b);
+    int bits = Bits(ua) - Bits(ub) + 1;
+    if (ub == 0 || bits < 0) bits = 0;
+    return DIV_MIN_LATENCY + bits;
+  }
+
+  bool Free() const {return !busy;}
+
+  // return the result(it is put on bus Latency() cycles later)
+  int Issue(long long label, int tag, OptType opt, int a, int b) {
+    busy = true;
+    ++ops;
+    this->label = label;
+    this->tag = tag;
+    value = Compute(opt, a, b);
+    remain = Latency(opt, a, b);
+    return value;
+  }
+
+  void Advance() {
+    if (busy) ++busy_cycles;
+    if (busy && remain > 0) --remain;
+  }
+
+  bool Done() const {return busy && remain == 0;}
+
+  long long Label() const {return label;}
+
+  int Tag() const {return tag;}
+
+  int Value() const {return value;}
+
+  void Pop() {busy = false;}
+
+  void Clear() {busy = false;}
+
+  // remove the op if it is after the instruction of label(a mispredicted branch/JALR)
+  void Squash(long long label) {
+    if (this->label > label) busy = false;
+  }
+
+  long long Ops() const {return ops;}
+
+  long long BusyCycles() const {return busy_cycles;}
+
+private:
+  bool busy = false;
+  long long ops = 0, busy_cycles = 0;
+  long long label = -1;
+  int tag = -1;
+  int value = 0;
+  int remain = 0;
+
+  static int Bits(u32 x) {
+    int ret = 0;
+    while (x) {
+      ++ret;
+      x >>= 1;
+    }
+    return ret;
+  }
+};
+
+#endif //RISCV_SIMULATOR_MULDIV_H
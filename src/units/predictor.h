@@ -16,7 +16,19 @@ public:
     return false;
   }
 
+  // used by commit: the counter is trained in flush, so fetch sees it from the next cycle
   void SetJump(int pc, bool jump) {
+    set_pc = pc;
+    set_jump = jump;
+  }
+
+  void flush() {
+    if (set_pc == -1) return;
+    Train(set_pc, set_jump);
+    set_pc = -1;
+  }
+
+  void Train(int pc, bool jump) {
     int tmp = pc % PREDICT_COUNTER_NUM;
     if (jump) {
       if (counter[tmp].test(1)) {
@@ -60,6 +72,8 @@ public:
 private:
   Stack<int, PREDICT_STACK_SIZE> jal_stack;
   std::bitset<2> counter[PREDICT_COUNTER_NUM] = {0};
+  int set_pc = -1; // of the B-type committed in this cycle
+  bool set_jump = false;
 };
 
 #endif //RISCV_SIMULATOR_PREDICTOR_H
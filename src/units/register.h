@@ -4,66 +4,202 @@
 
 #include "../utils/config.h"
 #include "../units/bus.h"
+#include "../utils/circular_queue.h"
+#include "instuction.h"
 #include <utility>
 
+/*
+ * merged physical register file with renaming, holds every register value(committed or not)
+ * spec_map: x[num] -> physical register of the latest issued instruction writing x[num]
+ * arch_map: x[num] -> physical register of the latest committed instruction writing x[num]
+ * free: physical registers mapped by neither of them(and not waiting to be freed at commit)
+ * checkpoints: spec_map after renaming each unresolved branch/JALR or LD with a predicted value(in program order),
+ *              restored if it is mispredicted
+ * x0 is always physical register 0(ready, value 0)
+ *
+ * a physical register is written once between allocation and free and is only read by instructions issued
+ * after its allocation, so the file is not double buffered
+ */
 class Register {
 public:
-  Register() = default;
+  // result of renaming an instruction: physical registers of rs1, rs2(dependency: -1 if ready) and rd
+  struct Renamed {
+    int src1 = 0, dependency1 = -1;
+    int src2 = 0, dependency2 = -1;
+    int tag = -1; // new physical register of rd, -1 if rd is not written
+    int old_tag = -1; // physical register of rd before, freed when the instruction commits
+    int tag1 = -1, old_tag1 = -1; // rd of the first instruction of a fused pair
+    int checkpoint = -1; // branch/JALR(or LD with a predicted value): checkpoint of spec_map taken after renaming it
+  };
 
-  void FlushSetX0() {
+  Register() {
     for (int i = 0; i < REGNUM; ++i) {
-      reg_now[i] = reg_next[i];
+      spec_map[i] = arch_map[i] = i;
+    }
+    Recover();
+  }
+
+  // not enough free physical registers for the rds written by ins
+  bool full(const InstructionUnit::Instruction &ins) {
+    return free.length() < int(WritesRd(ins)) + int(ins.fused != FusedType::None);
+  }
+
+  // no free checkpoint for a branch/JALR
+  bool CheckpointFull() {return checkpoints.full();}
+
+  /*
+   * read the physical registers of rs1 and rs2, then map rd to a free physical register
+   * fused pair: map the rd of the first instruction first(the rd of both may be the same)
+   * JALR: the link value is known now, so its register is written(and ready) immediately
+   * branch/JALR: take a checkpoint of spec_map(after renaming rd)
+   */
+  Renamed Rename(const InstructionUnit::Instruction &ins, int pc) {
+    Renamed ret;
+    ret.src1 = spec_map[ins.rs1];
+    ret.dependency1 = (prf[ret.src1].ready) ? -1 : ret.src1;
+    ret.src2 = spec_map[ins.rs2];
+    ret.dependency2 = (prf[ret.src2].ready) ? -1 : ret.src2;
+    if (ins.fused != FusedType::None) {
+      ret.tag1 = Allocate(ins.rd1, ret.old_tag1);
+    }
+    if (WritesRd(ins)) {
+      ret.tag = Allocate(ins.rd, ret.old_tag);
+      if (ins.opt == OptType::JALR) Write(ret.tag, pc + ins.len);
     }
-    reg_now[0].data = 0;
-    reg_now[0].dependency = -1;
+    if (ins.type == InstructionType::B || ins.opt == OptType::JALR) {
+      ret.checkpoint = TakeCheckpoint();
+    }
+    return ret;
+  }
+
+  /*
+   * a LD just renamed(rd is physical register tag) gets a predicted value: it is written(and ready) now
+   * return the checkpoint taken for it(there should be a free one), restored if the loaded value differs
+   */
+  int PredictValue(int tag, int value) {
+    Write(tag, value);
+    return TakeCheckpoint();
+  }
+
+  int Read(int tag) const {return prf[tag].data;}
+
+  // committed value of x[num]
+  int ReadArch(int num) const {return Read(arch_map[num]);}
+
+  // change the committed value of x[num], no instruction should be in flight(spec_map is arch_map)
+  void WriteArch(int num, int value) {
+    if (num != 0) Write(arch_map[num], value);
   }
 
-  std::pair<int, int> GetValueDependency(int num) const {
-    return {reg_now[num].data, reg_now[num].dependency};
+  void Write(int tag, int value) {
+    prf[tag].data = value;
+    prf[tag].ready = true;
   }
 
-  void SetDependency(int num, int label) {
-    reg_next[num].dependency = label;
+  // an instruction writing x[num] commits: tag becomes the committed register, old_tag is free
+  void Commit(int num, int tag, int old_tag) {
+    arch_map[num] = tag;
+    free.push(old_tag);
   }
 
-  void ClearDependency() {
+  // a physical register of a squashed instruction is free again
+  void Free(int tag) {free.push(tag);}
+
+  // the branch/JALR(or LD) of checkpoint was predicted correctly, drop the checkpoints resolved from the front
+  void Resolve(int checkpoint) {
+    checkpoints.find(checkpoint)->resolved = true;
+    while (!checkpoints.empty() && checkpoints.front()->resolved) checkpoints.pop();
+  }
+
+  /*
+   * the branch/JALR(or LD) of checkpoint was mispredicted(instructions after it are removed)
+   * spec_map returns to the checkpoint, the checkpoint and all younger ones are dropped
+   * physical registers of the removed instructions are given back by Free
+   */
+  void Restore(int checkpoint) {
+    CircularQueue<Checkpoint, CHECKPOINTNUM + 1>::iterator iter = checkpoints.find(checkpoint);
+    for (int i = 0; i < REGNUM; ++i) spec_map[i] = iter->spec_map[i];
+    while (!(checkpoints.back() == iter)) checkpoints.pop_back();
+    checkpoints.pop_back();
+  }
+
+  /*
+   * all instructions not committed are removed
+   * spec_map returns to arch_map, all other physical registers are free
+   */
+  void Recover() {
+    bool used[PHYREGNUM] = {false};
     for (int i = 0; i < REGNUM; ++i) {
-      reg_next[i].dependency = -1;
+      spec_map[i] = arch_map[i];
+      used[arch_map[i]] = true;
     }
+    free.clear();
+    for (int i = 0; i < PHYREGNUM; ++i) {
+      if (!used[i]) free.push(i);
+    }
+    checkpoints.clear();
   }
 
   u8 GetRet() const {
-    return (u32(reg_now[10].data)) & 255u;
+    return (u32(Read(arch_map[10]))) & 255u;
   }
 
   /*
-   * for all entrys in cdb, write data in x[rd]
-   * if x[rd]'s dependency == label in cdb, clear dependency
+   * for all entrys in cdb with a physical register, write the value and set ready
    */
   void CheckBus(const CommonDataBus &cdb) {
     for (int i = 0; i < CDBSIZE; ++i) {
-      if (cdb.bus[i].busy && cdb.bus[i].rd > 0) {
-        reg_next[cdb.bus[i].rd].data = cdb.bus[i].value;
-        if (reg_next[cdb.bus[i].rd].dependency == cdb.bus[i].label)
-          reg_next[cdb.bus[i].rd].dependency = -1;
+      if (cdb.bus[i].busy && cdb.bus[i].tag > 0) {
+        Write(cdb.bus[i].tag, cdb.bus[i].value);
+      }
+      if (cdb.bus[i].busy && cdb.bus[i].fused_tag > 0) {
+        Write(cdb.bus[i].fused_tag, cdb.bus[i].fused_value);
       }
     }
   }
 
+  // committed values of x1 ~ x31
   void print() const {
     for (int i = 1; i < REGNUM; ++i) {
-      printf("[%02d]:%-8x", i, reg_now[i]);
+      printf("[%02d]:%-8x", i, Read(arch_map[i]));
     }
     std::cout << std::endl;
   }
 
 private:
-  struct RegisterEntry {
+  struct PhysicalRegister {
     int data = 0;
-    int dependency = -1;
+    bool ready = true;
+  };
+  struct Checkpoint {
+    bool resolved = false;
+    int spec_map[REGNUM];
   };
-  RegisterEntry reg_now[REGNUM];
-  RegisterEntry reg_next[REGNUM];
+  PhysicalRegister prf[PHYREGNUM];
+  int spec_map[REGNUM];
+  int arch_map[REGNUM];
+  CircularQueue<int, PHYREGNUM + 1> free;
+  CircularQueue<Checkpoint, CHECKPOINTNUM + 1> checkpoints;
+
+  static bool WritesRd(const InstructionUnit::Instruction &ins) {
+    return ins.rd != 0 && OptInfo(ins.opt).writes_rd;
+  }
+
+  int TakeCheckpoint() {
+    Checkpoint tmp;
+    for (int i = 0; i < REGNUM; ++i) tmp.spec_map[i] = spec_map[i];
+    return checkpoints.push(tmp);
+  }
+
+  // map x[num] to a free physical register(not ready), return it
+  int Allocate(int num, int &old_tag) {
+    int tag = *free.front();
+    free.pop();
+    old_tag = spec_map[num];
+    spec_map[num] = tag;
+    prf[tag].ready = false;
+    return tag;
+  }
 
 };
 
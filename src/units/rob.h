@@ -2,23 +2,33 @@
 #ifndef RISCV_SIMULATOR_ROB_H
 #define RISCV_SIMULATOR_ROB_H
 
-//#define SHOW_PC_REG
-
-#include "../utils/circular_queue.h"
 #include "instuction.h"
 #include "register.h"
 #include "rss.h"
 
+/*
+ * structure of arrays: the ready flags(read by commit every cycle) are packed apart from the other fields of the entries
+ * rob_now and rob_next share the slots(the slot of label is label % ROBSIZE), only their windows are double buffered:
+ * issue writes the slot after rob_now and CheckBus writes after all stages, so rob_now never sees a change of the cycle
+ */
 class ReorderBuffer {
-private:
+public:
+  // written at issue(value and ready_clk when its result is on the bus)
   struct RoBEntry {
     int pc = -1;
-    int label = -1;
+    long long label = -1; // counts every issued instruction, compared to tell the older one
     OptType opt;
-    bool ready = false;
     int rd = -1; // opt == ADDI && rd == -1 represents END
                  // opt ==
     int value = 0;
+    int rs1 = 0; // used by profiler(tell returns from other jumps) and CSR instructions(rs1 or uimm)
+    int len = 4; // size of the instruction(2 if compressed)
+    int tag = -1, old_tag = -1; // physical registers of rd after and before renaming(-1 if rd is not written)
+    FusedType fused = FusedType::None; // fused pair: pc is the first instruction, opt is the second, len is the sum
+    OptType opt1 = OptType::ADDI; // fused pair: the first instruction(used by profiler)
+    int rd1 = 0, tag1 = -1, old_tag1 = -1, len1 = 0;
+    int issue_clk = 0, ready_clk = 0;
+    int csr = 0; // CSR instructions: the csr
 
     friend std::ostream &operator<<(std::ostream &os, const ReorderBuffer::RoBEntry &obj) {
       os << "label = " << std::dec << obj.label << ", pc = " << std::hex << obj.pc << std::dec << ", opt = ";
@@ -60,10 +70,24 @@ private:
         case OptType::SRA : os << "SRA"; break;
         case OptType::OR : os << "OR"; break;
         case OptType::AND : os << "AND"; break;
+        case OptType::MUL : os << "MUL"; break;
+        case OptType::MULH : os << "MULH"; break;
+        case OptType::MULHSU : os << "MULHSU"; break;
+        case OptType::MULHU : os << "MULHU"; break;
+        case OptType::DIV : os << "DIV"; break;
+        case OptType::DIVU : os << "DIVU"; break;
+        case OptType::REM : os << "REM"; break;
+        case OptType::REMU : os << "REMU"; break;
+        case OptType::ECALL : os << "ECALL"; break;
+        case OptType::CSRRW : os << "CSRRW"; break;
+        case OptType::CSRRS : os << "CSRRS"; break;
+        case OptType::CSRRC : os << "CSRRC"; break;
+        case OptType::CSRRWI : os << "CSRRWI"; break;
+        case OptType::CSRRSI : os << "CSRRSI"; break;
+        case OptType::CSRRCI : os << "CSRRCI"; break;
       }
       os << ", rd = " << obj.rd << ", value = " << obj.value;
-      if (obj.ready) os << ", is ready.";
-      else os << ", is not ready.";
+      if (obj.fused != FusedType::None) os << ", fused, rd1 = " << obj.rd1;
       return os;
     }
   };
@@ -73,47 +97,78 @@ public:
 
   void flush() {rob_now = rob_next;}
 
-  bool full() {return rob_now.full();}
+  // ROBSIZE - 1 entries
+  bool full() const {return rob_now.size() == ROBSIZE - 1;}
+
+  bool empty() const {return rob_now.size() == 0;}
+
+  int size() const {return rob_now.size();}
+
+  int NextSize() const {return rob_next.size();}
+
+  bool HeadReady() const {return !empty() && ready[Slot(rob_now.head)];}
+
+  // rob_now should not be empty
+  const RoBEntry &Front() const {return entry[Slot(rob_now.head)];}
+
+  // the entry at front is a LD/ST
+  bool HeadIsMemory() const {
+    return !empty() && OptInfo(Front().opt).unit == UnitClass::LoadStore;
+  }
 
   /*
-   * add an entry in rob, update rd's dependency in register
+   * add an entry in rob, renamed: physical registers given by reg.Rename
    */
-  int issue(const InstructionUnit::Instruction &ins, Register &reg, int pc) {
+  long long issue(const InstructionUnit::Instruction &ins, const Register::Renamed &renamed, int pc, int clk) {
     RoBEntry tmp;
     tmp.pc = pc;
     tmp.opt = ins.opt;
-    if (ins.type != InstructionType::S && ins.type != InstructionType::B) {
+    tmp.rs1 = ins.rs1;
+    tmp.len = ins.len;
+    tmp.issue_clk = clk;
+    tmp.tag = renamed.tag;
+    tmp.old_tag = renamed.old_tag;
+    tmp.fused = ins.fused;
+    tmp.opt1 = ins.opt1;
+    tmp.rd1 = ins.rd1;
+    tmp.tag1 = renamed.tag1;
+    tmp.old_tag1 = renamed.old_tag1;
+    tmp.len1 = ins.len1;
+    const OptMeta &meta = OptInfo(ins.opt);
+    if (meta.writes_rd) {
       tmp.rd = ins.rd;
     }
-    if (ins.opt == OptType::ADDI && ins.rd == 10 && ins.imm == 255 && ins.rs1 == 0) {
+    if (ins.opt == OptType::ADDI && ins.rd == 10 && ins.imm == 255 && ins.rs1 == 0 && ins.fused == FusedType::None) {
       tmp.rd = -1;
     }
-    int index = rob_next.push(tmp);
-    rob_next.back()->label = index;
-    if (ins.type == InstructionType::U || ins.type == InstructionType::J || ins.type == InstructionType::I || ins.type == InstructionType::R) {
-      reg.SetDependency(ins.rd, index);
-    }
+    if (InstructionUnit::IsCsr(ins.opt)) tmp.csr = ins.imm;
+    long long index = rob_next.tail++;
+    tmp.label = index;
+    entry[Slot(index)] = tmp;
+    // ECALL, CSR: nothing to execute, the system call or the csr access is done when it commits
+    ready[Slot(index)] = meta.unit == UnitClass::Commit;
     return index;
   }
 
   /*
-   *  check entry at front, if ready, commit, put on commit bus, pop
+   *  check entry at front, if ready, commit, pop
    *                        else return
    *
-   *  ST: put on bus, lsb will start store, remove entry immediately
-   *  AUIPC and JAL: calculate value with pc
-   *  B-type: check pc prediction
-   *  JALR: put on bus and check pc prediction
-   *  others: just put on bus
+   *  ST: put on commit bus, lsb will start store, remove entry immediately
+   *  rd is written: the value is already in the register file, commit the mapping of rd(free the old register)
+   *  fused pair: commit the mapping of the rd of the first instruction, then the second
+   *  B-type: train the predictor
+   *  (branch/JALR predictions are checked when they are executed, see Squash)
    *
    *  .END: return {1, a0}
-   *  prediction failed: return {2, correct_pc}
    *  else return {0, 0}
    */
-  std::pair<int, int> Commit(CommonDataBus &cdb, const Register &reg, Predictor &predictor) {
-    if (rob_now.empty()) return {0, 0};
-    CircularQueue<RoBEntry, ROBSIZE>::iterator iter = rob_now.front();
-    if (!iter->ready) return {0, false}; // nothing to commit
+  template <typename Trace>
+  std::pair<int, int> Commit(CommonDataBus &cdb, Register &reg, Predictor &predictor, Trace &trace) {
+    if (!HeadReady()) return {0, false}; // nothing to commit
+    const RoBEntry *iter = &Front();
+    trace.Commit(*iter, reg);
+    const OptMeta &meta = OptInfo(iter->opt);
 
     // .END
     if (iter->opt == OptType::ADDI && iter->rd == -1) {
@@ -122,94 +177,85 @@ public:
 
     // ST: put on bus, lsb will receive call and start store
     // can remove the entry immediately
-    if (iter->opt == OptType::SB || iter->opt == OptType::SH || iter->opt == OptType::SW) {
-#ifdef SHOW_PC_REG
-      std::cout << std::hex << "commit: pc = " << iter->pc << std::dec << std::endl;
-      reg.print();
-#endif
-
-      cdb.PutOnBus(iter->label, 0, 0); // only need label
+    if (meta.store) {
+      cdb.Request(BusPort::Commit, iter->label, 0); // only need label
     }
-    // for AUIPC and JAL: value need to be calculated with pc
-    else if (iter->opt == OptType::AUIPC || iter->opt == OptType::JAL) {
-#ifdef SHOW_PC_REG
-      std::cout << std::hex << "commit: pc = " << iter->pc << std::dec << std::endl;
-      reg.print();
-#endif
-
-      cdb.PutOnBus(iter->label, iter->value, iter->rd);
+    if (iter->tag1 >= 0) {
+      reg.Commit(iter->rd1, iter->tag1, iter->old_tag1);
     }
-    // for B-type: need to check pc prediction: if false, clear pipeline; else, do nothing
-    else if (iter->opt == OptType::BEQ || iter->opt == OptType::BNE || iter->opt == OptType::BLT || iter->opt == OptType::BGE || iter->opt == OptType::BLTU || iter->opt == OptType::BGEU) {
-      int ans_pc = iter->pc + iter->value;
-      if (iter->value == 4) predictor.SetJump(iter->pc, false);
-      else predictor.SetJump(iter->pc, true);
-#ifdef SHOW_PC_REG
-      std::cout << std::hex << "commit: pc = " << iter->pc << std::dec << std::endl;
-      reg.print();
-#endif
-
-      ++iter;
-      if (iter == rob_now.end() || iter->pc != ans_pc) {
-        rob_next.pop();
-        return {2, ans_pc};
-      }
-    }
-    // for JALR: put pc + 4 on bus, send to reg. check pc prediction
-    else if (iter->opt == OptType::JALR) {
-#ifdef SHOW_PC_REG
-      std::cout << std::hex << "commit: pc = " << iter->pc << std::dec << std::endl;
-      reg.print();
-#endif
-
-      cdb.PutOnBus(iter->label, iter->pc + 4, iter->rd);
-      int ans_pc = iter->value;
-      ++iter;
-      if (iter == rob_now.end() || iter->pc != ans_pc) {
-        rob_next.pop();
-        return {2, ans_pc};
-      }
+    if (iter->tag >= 0) {
+      reg.Commit(iter->rd, iter->tag, iter->old_tag);
     }
-    else {
-#ifdef SHOW_PC_REG
-      std::cout << std::hex << "commit: pc = " << iter->pc << std::dec << std::endl;
-      reg.print();
-#endif
-
-      cdb.PutOnBus(iter->label, iter->value, iter->rd);
+    // for B-type: train the predictor
+    if (meta.branch) {
+      if (iter->value == iter->len) predictor.SetJump(iter->pc, false);
+      else predictor.SetJump(iter->pc, true);
     }
-    rob_next.pop();
+    ++rob_next.head;
     return {0, 0};
   }
 
   void Clear() {
-    rob_next.clear();
+    rob_next.head = rob_next.tail;
   }
 
-  void CheckBus(const CommonDataBus &cdb) {
-    if (rob_next.empty()) return;
-    CircularQueue<RoBEntry, ROBSIZE>::iterator iter = rob_next.front();
-    while (iter != rob_next.end()) {
-      std::pair<bool, int> tmp = cdb.TryGetValue(iter->label);
-      if (tmp.first) {
-//        CircularQueue<RoBEntry, ROBSIZE>::iterator iter_next = rob_next.find(iter->label);
-        iter->ready = true;
-        iter->value = tmp.second;
-      }
-      ++iter;
+  /*
+   * remove entries after the instruction of label(a mispredicted branch/JALR)
+   * their physical registers are free again
+   * return the number of removed entries
+   */
+  template <typename Trace>
+  int Squash(long long label, Register &reg, Trace &trace) {
+    int ret = 0;
+    while (rob_next.tail - 1 != label) {
+      const RoBEntry &back = entry[Slot(--rob_next.tail)];
+      if (back.tag >= 0) reg.Free(back.tag);
+      if (back.tag1 >= 0) reg.Free(back.tag1);
+      ++ret;
+    }
+    trace.Mispredict(entry[Slot(label)]);
+    return ret;
+  }
+
+  // the entries whose results are on the bus(looked up by label) are ready
+  void CheckBus(const CommonDataBus &cdb, int clk) {
+    long long label[CDBSIZE];
+    int value[CDBSIZE];
+    int n = cdb.Results(label, value);
+    for (int i = 0; i < n; ++i) {
+      if (label[i] < rob_next.head || label[i] >= rob_next.tail) continue;
+      int slot = Slot(label[i]);
+      ready[slot] = true;
+      entry[slot].value = value[i];
+      entry[slot].ready_clk = clk;
     }
   }
 
-  void Print() {
+  void Print() const {
     std::cout << "----------------ROB_NOW--------------------" << std::endl;
-    rob_now.print();
+    Print(rob_now);
     std::cout << "----------------ROB_NEXT--------------------" << std::endl;
-    rob_next.print();
+    Print(rob_next);
   }
 
 private:
-  CircularQueue<RoBEntry, ROBSIZE> rob_now;
-  CircularQueue<RoBEntry, ROBSIZE> rob_next;
+  struct Window {
+    long long head = 0, tail = 0; // labels of the oldest entry and of the next one to issue
+
+    int size() const {return int(tail - head);}
+  };
+
+  RoBEntry entry[ROBSIZE];
+  bool ready[ROBSIZE] = {};
+  Window rob_now, rob_next;
+
+  static int Slot(long long label) {return int(label % ROBSIZE);}
+
+  void Print(const Window &window) const {
+    for (long long i = window.head; i != window.tail; ++i) {
+      std::cout << entry[Slot(i)] << (ready[Slot(i)] ? ", is ready." : ", is not ready.") << std::endl;
+    }
+  }
 };
 
 #endif //RISCV_SIMULATOR_ROB_H
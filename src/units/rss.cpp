@@ -1,38 +1,73 @@
 #include "rss.h"
+#include "../main/trace.h"
 
-void ReservationStation::issue(int rob_index, const InstructionUnit::Instruction &ins, const Register &reg, int pc) {
+void ReservationStation::issue(long long rob_index, const InstructionUnit::Instruction &ins, const Register::Renamed &renamed, int pc, int predicted) {
   RssEntry tmp;
   tmp.label = rob_index;
   tmp.opt = ins.opt;
+  tmp.len = ins.len;
+  tmp.pc = pc;
+  tmp.predicted = predicted;
+  tmp.checkpoint = renamed.checkpoint;
+  tmp.fused = ins.fused;
+  tmp.opt1 = ins.opt1;
+  tmp.imm1 = (ins.fused == FusedType::AuipcJalr) ? ins.imm1 + pc : ins.imm1;
+  tmp.tag1 = renamed.tag1;
+  // the link value of JALR is written at renaming, its result here is the target
+  tmp.tag = (ins.opt == OptType::JALR) ? -1 : renamed.tag;
   if (ins.type != InstructionType::R) {
     if (ins.opt == OptType::AUIPC) {
       tmp.imm = ins.imm + pc;
     }
     else if (ins.opt == OptType::JAL) {
-      tmp.imm = pc + 4;
+      tmp.imm = pc + ins.len;
     }
     else {
       tmp.imm = ins.imm;
     }
   }
-  if (ins.type != InstructionType::U) {
-    std::pair<int, int> rs = reg.GetValueDependency(ins.rs1);
-    tmp.value1 = rs.first;
-    tmp.dependency1 = rs.second;
-  }
-  if (ins.type == InstructionType::R || ins.type == InstructionType::S || ins.type == InstructionType::B) {
-    std::pair<int, int> rs = reg.GetValueDependency(ins.rs2);
-    tmp.value2 = rs.first;
-    tmp.dependency2 = rs.second;
+  // unused rs1, rs2 are x0(physical register 0, always ready)
+  tmp.src1 = renamed.src1;
+  tmp.src2 = renamed.src2;
+  int size = rss_next.size++;
+  rss_next.dependency1[size] = renamed.dependency1;
+  rss_next.dependency2[size] = renamed.dependency2;
+  rss_next.entry[size] = tmp;
+}
+
+template <typename Trace>
+void ReservationStation::AriExecute(const ArithmeticLogicUnit &alu, const Register &reg, const CommonDataBus &cdb, FunctionalUnitPool &pool, Trace &trace) {
+  int picked[ALU_NUM + BRANCH_UNIT_NUM];
+  int n = 0;
+  for (int i = 0; i < rss_now.size && n < ALU_NUM + BRANCH_UNIT_NUM; ++i) {
+    if (!rss_now.Independent(i)) continue;
+    const RssEntry &tmp = rss_now.entry[i];
+    const OpTiming &timing = TimingOf(tmp.opt);
+    int unit = pool.Find(timing.kind, timing.pipelined, cdb);
+    if (unit == -1) continue; // no unit of its kind is free
+    int value1 = reg.Read(tmp.src1), value2 = reg.Read(tmp.src2);
+    FunctionalUnitPool::Op op;
+    op.label = tmp.label;
+    op.tag = tmp.tag;
+    op.tag1 = tmp.tag1;
+    op.value = (tmp.fused == FusedType::None) ? Compute(alu, tmp, value1, value2) : ComputeFused(alu, tmp, value1, value2, op.first);
+    op.remain = timing.latency;
+    op.pipelined = timing.pipelined;
+    trace.Execute(tmp.label, tmp.opt, op.value);
+    if (tmp.checkpoint >= 0) {
+      // branch: value is the offset of next pc, JALR: value is the target
+      int next_pc = (tmp.opt == OptType::JALR) ? op.value : tmp.pc + op.value;
+      op.checkpoint = tmp.checkpoint;
+      if (next_pc != tmp.predicted) op.jump_pc = next_pc;
+    }
+    pool.Start(unit, op);
+    picked[n++] = i;
   }
-  rss_next[size_next++] = tmp;
+  RemoveEntries(picked, n);
 }
 
-void ReservationStation::AriExecute(const ArithmeticLogicUnit &alu, CommonDataBus &cdb, int pc) {
-  int index = FindIndependentEntry();
-  if (index == -1) return; // all entries are not prepared
+inline int ReservationStation::Compute(const ArithmeticLogicUnit &alu, const RssEntry &tmp, int value1, int value2) {
   int value = 0;
-  const RssEntry &tmp = rss_now[index];
   switch (tmp.opt) {
     case OptType::JAL :
     case OptType::AUIPC :
@@ -41,181 +76,269 @@ void ReservationStation::AriExecute(const ArithmeticLogicUnit &alu, CommonDataBu
       break;
     }
     case OptType::JALR : {
-      value = alu.AND(alu.ADD(tmp.imm, tmp.value1), ~1);
+      value = alu.AND(alu.ADD(tmp.imm, value1), ~1);
       break;
     }
     case OptType::BEQ : {
-      value = (alu.IsEqual(tmp.value1, tmp.value2)) ? tmp.imm : 4;
+      value = (alu.IsEqual(value1, value2)) ? tmp.imm : tmp.len;
       break;
     }
     case OptType::BNE : {
-      value = (alu.IsEqual(tmp.value1, tmp.value2)) ? 4 : tmp.imm;
+      value = (alu.IsEqual(value1, value2)) ? tmp.len : tmp.imm;
       break;
     }
     case OptType::BLT : {
-      value = (alu.IsLessThanSigned(tmp.value1, tmp.value2)) ? tmp.imm : 4;
+      value = (alu.IsLessThanSigned(value1, value2)) ? tmp.imm : tmp.len;
       break;
     }
     case OptType::BGE : {
-      value = (alu.IsLessThanSigned(tmp.value1, tmp.value2)) ? 4 : tmp.imm;
+      value = (alu.IsLessThanSigned(value1, value2)) ? tmp.len : tmp.imm;
       break;
     }
     case OptType::BLTU : {
-      value = (alu.IsLessThanUnsigned(tmp.value1, tmp.value2)) ? tmp.imm : 4;
+      value = (alu.IsLessThanUnsigned(value1, value2)) ? tmp.imm : tmp.len;
       break;
     }
     case OptType::BGEU : {
-      value = (alu.IsLessThanUnsigned(tmp.value1, tmp.value2)) ? 4 : tmp.imm;
+      value = (alu.IsLessThanUnsigned(value1, value2)) ? tmp.len : tmp.imm;
       break;
     }
     case OptType::ADDI : {
-      value = alu.ADD(tmp.value1, tmp.imm);
+      value = alu.ADD(value1, tmp.imm);
       break;
     }
     case OptType::SLTI : {
-      value = alu.IsLessThanSigned(tmp.value1, tmp.imm);
+      value = alu.IsLessThanSigned(value1, tmp.imm);
       break;
     }
     case OptType::SLTIU : {
-      value = alu.IsLessThanUnsigned(tmp.value1, tmp.imm);
+      value = alu.IsLessThanUnsigned(value1, tmp.imm);
       break;
     }
     case OptType::XORI : {
-      value = alu.XOR(tmp.value1, tmp.imm);
+      value = alu.XOR(value1, tmp.imm);
       break;
     }
     case OptType::ORI : {
-      value = alu.OR(tmp.value1, tmp.imm);
+      value = alu.OR(value1, tmp.imm);
       break;
     }
     case OptType::ANDI : {
-      value = alu.AND(tmp.value1, tmp.imm);
+      value = alu.AND(value1, tmp.imm);
       break;
     }
     case OptType::SLLI : {
-      value = alu.ShiftLeftLogical(tmp.value1, tmp.imm);
+      value = alu.ShiftLeftLogical(value1, tmp.imm);
       break;
     }
     case OptType::SRLI : {
-      value = alu.ShiftRightLogical(tmp.value1, tmp.imm);
+      value = alu.ShiftRightLogical(value1, tmp.imm);
       break;
     }
     case OptType::SRAI : {
-      value = alu.ShiftRightAri(tmp.value1, tmp.imm);
+      value = alu.ShiftRightAri(value1, tmp.imm);
       break;
     }
     case OptType::ADD : {
-      value = alu.ADD(tmp.value1, tmp.value2);
+      value = alu.ADD(value1, value2);
       break;
     }
     case OptType::SUB : {
-      value = alu.ADD(alu.ADD(tmp.value1, ~tmp.value2), 1);
+      value = alu.ADD(alu.ADD(value1, ~value2), 1);
       break;
     }
     case OptType::SLL : {
-      value = alu.ShiftLeftLogical(tmp.value1, tmp.value2);
+      value = alu.ShiftLeftLogical(value1, value2);
       break;
     }
     case OptType::SLT : {
-      value = alu.IsLessThanSigned(tmp.value1, tmp.value2);
+      value = alu.IsLessThanSigned(value1, value2);
       break;
     }
     case OptType::SLTU : {
-      value = alu.IsLessThanUnsigned(tmp.value1, tmp.value2);
+      value = alu.IsLessThanUnsigned(value1, value2);
       break;
     }
     case OptType::XOR : {
-      value = alu.XOR(tmp.value1, tmp.value2);
+      value = alu.XOR(value1, value2);
       break;
     }
     case OptType::SRL : {
-      value = alu.ShiftRightLogical(tmp.value1, tmp.value2);
+      value = alu.ShiftRightLogical(value1, value2);
       break;
     }
     case OptType::SRA : {
-      value = alu.ShiftRightAri(tmp.value1, tmp.value2);
+      value = alu.ShiftRightAri(value1, value2);
       break;
     }
     case OptType::OR : {
-      value = alu.OR(tmp.value1, tmp.value2);
+      value = alu.OR(value1, value2);
       break;
     }
     case OptType::AND : {
-      value = alu.AND(tmp.value1, tmp.value2);
+      value = alu.AND(value1, value2);
       break;
     }
     default: throw std::exception();
   }
-  cdb.PutOnBus(tmp.label, value);
-  RemoveEntry(index);
+  return value;
+}
+
+// an AVX2 and a generic version, picked when the program is loaded(GCC on x86-64)
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define SIMD_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define SIMD_CLONES
+#endif
+
+template <OptType opt>
+SIMD_CLONES
+void ReservationStation::ComputeLanesOf(const ArithmeticLogicUnit &alu, int imm, int len, const int *value1, const int *value2, int *value, int n) {
+  RssEntry tmp;
+  tmp.opt = opt; // a constant: the switch in Compute is resolved at compile time, the loop is vectorized
+  tmp.imm = imm;
+  tmp.len = len;
+  for (int i = 0; i < n; ++i) value[i] = Compute(alu, tmp, value1[i], value2[i]);
 }
 
-void ReservationStation::LsExecute(const ArithmeticLogicUnit &alu, CommonDataBus &cdb, LoadStoreBuffer &lsb) {
-  if (lsb.NextFull()) return;
-  if (size_now == 0) return;
-  int addr = 0;
-  // ST at top prepared?
-  if (rss_now[0].opt == OptType::SB || rss_now[0].opt == OptType::SH || rss_now[0].opt == OptType::SW) {
-    if (rss_now[0].dependency1 == -1 && rss_now[0].dependency2 == -1) {
-      addr = alu.ADD(rss_now[0].value1, rss_now[0].imm);
-      lsb.Execute(rss_now[0].opt, addr, rss_now[0].value2, rss_now[0].label, cdb);
-      RemoveEntry(0);
-      return;
+void ReservationStation::ComputeLanes(const ArithmeticLogicUnit &alu, OptType opt, int imm, int len, const int *value1, const int *value2, int *value, int n) {
+  using Kernel = void (*)(const ArithmeticLogicUnit &, int, int, const int *, const int *, int *, int);
+  // in the order of OptType, nullptr: not an ALU operation
+  static const Kernel kernels[] = {
+      &ComputeLanesOf<OptType::LUI>, &ComputeLanesOf<OptType::AUIPC>, &ComputeLanesOf<OptType::JAL>, &ComputeLanesOf<OptType::JALR>,
+      &ComputeLanesOf<OptType::BEQ>, &ComputeLanesOf<OptType::BNE>, &ComputeLanesOf<OptType::BLT>, &ComputeLanesOf<OptType::BGE>,
+      &ComputeLanesOf<OptType::BLTU>, &ComputeLanesOf<OptType::BGEU>,
+      nullptr, nullptr, nullptr, nullptr, nullptr, // LB, LH, LW, LBU, LHU
+      nullptr, nullptr, nullptr, // SB, SH, SW
+      &ComputeLanesOf<OptType::ADDI>, &ComputeLanesOf<OptType::SLTI>, &ComputeLanesOf<OptType::SLTIU>, &ComputeLanesOf<OptType::XORI>,
+      &ComputeLanesOf<OptType::ORI>, &ComputeLanesOf<OptType::ANDI>, &ComputeLanesOf<OptType::SLLI>, &ComputeLanesOf<OptType::SRLI>,
+      &ComputeLanesOf<OptType::SRAI>,
+      &ComputeLanesOf<OptType::ADD>, &ComputeLanesOf<OptType::SUB>, &ComputeLanesOf<OptType::SLL>, &ComputeLanesOf<OptType::SLT>,
+      &ComputeLanesOf<OptType::SLTU>, &ComputeLanesOf<OptType::XOR>, &ComputeLanesOf<OptType::SRL>, &ComputeLanesOf<OptType::SRA>,
+      &ComputeLanesOf<OptType::OR>, &ComputeLanesOf<OptType::AND>,
+      nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, // MUL ~ REMU
+      nullptr, // ECALL
+      nullptr, nullptr, nullptr, nullptr, nullptr, nullptr // CSRRW ~ CSRRCI
+  };
+  static_assert(sizeof (kernels) / sizeof (kernels[0]) == OPT_NUM, "a kernel for each OptType");
+  if (kernels[int(opt)] == nullptr) throw std::exception();
+  kernels[int(opt)](alu, imm, len, value1, value2, value, n);
+}
+
+int ReservationStation::ComputeFused(const ArithmeticLogicUnit &alu, const RssEntry &tmp, int value1, int value2, int &first) {
+  switch (tmp.fused) {
+    case FusedType::LuiAddi : {
+      first = tmp.imm1;
+      return alu.ADD(first, tmp.imm);
+    }
+    case FusedType::AuipcJalr : {
+      first = tmp.imm1; // pc is added at issue
+      return alu.AND(alu.ADD(first, tmp.imm), ~1);
+    }
+    case FusedType::SlliAdd : {
+      first = alu.ShiftLeftLogical(value1, tmp.imm1);
+      return alu.ADD(first, value2);
+    }
+    case FusedType::CmpBranch : {
+      if (tmp.opt1 == OptType::SLT) first = alu.IsLessThanSigned(value1, value2);
+      else if (tmp.opt1 == OptType::SLTU) first = alu.IsLessThanUnsigned(value1, value2);
+      else if (tmp.opt1 == OptType::SLTI) first = alu.IsLessThanSigned(value1, tmp.imm1);
+      else first = alu.IsLessThanUnsigned(value1, tmp.imm1);
+      // BNE rd, x0 is taken if rd != 0, BEQ rd, x0 if rd == 0
+      bool jump = (tmp.opt == OptType::BNE) == (first != 0);
+      return (jump) ? tmp.imm : tmp.len;
     }
+    default: throw std::exception();
   }
-  // LD without STs before prepared?
-  for (int i = 0; i< size_now; ++i) {
-    if (rss_now[i].opt == OptType::SB || rss_now[i].opt == OptType::SH || rss_now[i].opt == OptType::SW)
-      return;
-    if (rss_now[i].dependency1 == -1 && rss_now[i].dependency2 == -1) {
-      addr = alu.ADD(rss_now[i].value1, rss_now[i].imm);
-      lsb.Execute(rss_now[i].opt, addr, 0, rss_now[i].label, cdb);
-      RemoveEntry(i);
-      return;
+}
+
+template <typename Trace>
+int ReservationStation::LsExecute(const ArithmeticLogicUnit &alu, const Register &reg, CommonDataBus &cdb, LoadStoreBuffer &lsb,
+                                  FunctionalUnitPool &pool, Trace &trace, LoadStoreBuffer::Loaded loaded[AGU_NUM]) {
+  int picked[AGU_NUM];
+  int n = 0, forwarded = 0;
+  for (int i = 0; i < rss_now.size && n < AGU_NUM; ++i) {
+    const RssEntry &tmp = rss_now.entry[i];
+    bool store = OptInfo(tmp.opt).store;
+    // a ST is sent only when the entries before it are(no LD after it is sent before it)
+    if (store && i > n) break;
+    if (!rss_now.Independent(i)) {
+      if (store) break;
+      continue;
+    }
+    if (lsb.NextFull()) break;
+    int unit = pool.Find(FuKind::Agu, true, cdb);
+    if (unit == -1) break;
+    int addr = alu.ADD(reg.Read(tmp.src1), tmp.imm);
+    if (store) {
+      trace.Execute(tmp.label, tmp.opt, addr);
+      lsb.Execute(tmp.opt, addr, reg.Read(tmp.src2), tmp.label, -1, cdb, UnitPort(unit), tmp.pc, tmp.len);
+      pool.Start(unit, FunctionalUnitPool::Op());
+      picked[n++] = i;
+      break;
     }
+    // a LD of a device waits in lsb until it is the oldest in flight: nothing older may be behind it there
+    if (i > n && lsb.IsDevice(addr)) continue;
+    trace.Execute(tmp.label, tmp.opt, addr);
+    LoadStoreBuffer::Loaded ret = lsb.Execute(tmp.opt, addr, 0, tmp.label, tmp.tag, cdb, UnitPort(unit), tmp.pc, tmp.len,
+                                              tmp.checkpoint, tmp.predicted);
+    if (ret.label != -1) loaded[forwarded++] = ret;
+    pool.Start(unit, FunctionalUnitPool::Op());
+    picked[n++] = i;
   }
+  RemoveEntries(picked, n);
+  return forwarded;
+}
+
+template <typename Unit, typename Trace>
+void ReservationStation::MulDivExecute(Unit &unit, const Register &reg, Trace &trace) {
+  if (!unit.Free()) return;
+  int index = FindIndependentEntry();
+  if (index == -1) return;
+  const RssEntry &tmp = rss_now.entry[index];
+  trace.Execute(tmp.label, tmp.opt, unit.Issue(tmp.label, tmp.tag, tmp.opt, reg.Read(tmp.src1), reg.Read(tmp.src2)));
+  RemoveEntry(index);
 }
 
-void ReservationStation::CheckBus(const CommonDataBus &cdb1, const CommonDataBus &cdb2) {
-  for (int i = 0; i < size_next; ++i) {
-    if (rss_next[i].dependency1 >= 0) {
-      std::pair<bool, int> tmp = cdb1.TryGetValue(rss_next[i].dependency1);
-      if (tmp.first && rss_next[i].opt != OptType::JALR) {
-        rss_next[i].dependency1 = -1;
-        rss_next[i].value1 = tmp.second;
-      }
-      else { // can't find in ready_bus: try commit_bus
-        tmp = cdb2.TryGetValue(rss_next[i].dependency1);
-        if (tmp.first) {
-          rss_next[i].dependency1 = -1;
-          rss_next[i].value1 = tmp.second;
-        }
-      }
-    }
-    if (rss_next[i].dependency2 >= 0) {
-      std::pair<bool, int> tmp = cdb1.TryGetValue(rss_next[i].dependency2);
-      if (tmp.first && rss_next[i].opt != OptType::JALR) {
-        rss_next[i].dependency2 = -1;
-        rss_next[i].value2 = tmp.second;
-      }
-      else { // can't find in ready_bus: try commit_bus
-        tmp = cdb2.TryGetValue(rss_next[i].dependency2);
-        if (tmp.first) {
-          rss_next[i].dependency2 = -1;
-          rss_next[i].value2 = tmp.second;
-        }
-      }
+void ReservationStation::CheckBus(const CommonDataBus &cdb) {
+  int tag[2 * CDBSIZE];
+  int n = cdb.WrittenTags(tag);
+  int size = rss_next.size;
+  int *dependency1 = rss_next.dependency1, *dependency2 = rss_next.dependency2;
+  for (int j = 0; j < n; ++j) {
+    int written = tag[j];
+    for (int i = 0; i < size; ++i) {
+      dependency1[i] = (dependency1[i] == written) ? -1 : dependency1[i];
+      dependency2[i] = (dependency2[i] == written) ? -1 : dependency2[i];
     }
   }
 }
 
+void ReservationStation::Squash(long long label) {
+  int size = 0;
+  for (int i = 0; i < rss_next.size; ++i) {
+    if (rss_next.entry[i].label > label) continue;
+    rss_next.dependency1[size] = rss_next.dependency1[i];
+    rss_next.dependency2[size] = rss_next.dependency2[i];
+    rss_next.entry[size++] = rss_next.entry[i];
+  }
+  rss_next.size = size;
+}
+
 void ReservationStation::print() {
 //  std::cout << "---------------NOW-------------" << std::endl;
-//  for (int i = 0; i < size_now; ++i) {
-//    std::cout << rss_now[i] << std::endl;
+//  for (int i = 0; i < rss_now.size; ++i) {
+//    std::cout << rss_now.entry[i] << std::endl;
 //  }
 //  std::cout << "---------------NEXT-------------" << std::endl;
-  for (int i = 0; i < size_next; ++i) {
-    std::cout << rss_next[i] << std::endl;
+  for (int i = 0; i < rss_next.size; ++i) {
+    std::cout << rss_next.entry[i] << ", dependency1 = " << rss_next.dependency1[i];
+    std::cout << ", dependency2 = " << rss_next.dependency2[i] << std::endl;
   }
-}
\ No newline at end of file
+}
+
+template void ReservationStation::AriExecute<TracePolicy>(const ArithmeticLogicUnit &, const Register &, const CommonDataBus &, FunctionalUnitPool &, TracePolicy &);
+template int ReservationStation::LsExecute<TracePolicy>(const ArithmeticLogicUnit &, const Register &, CommonDataBus &, LoadStoreBuffer &,
+                                                        FunctionalUnitPool &, TracePolicy &, LoadStoreBuffer::Loaded[AGU_NUM]);
+template void ReservationStation::MulDivExecute<MultiplyUnit, TracePolicy>(MultiplyUnit &, const Register &, TracePolicy &);
+template void ReservationStation::MulDivExecute<DivideUnit, TracePolicy>(DivideUnit &, const Register &, TracePolicy &);
@@ -2,21 +2,32 @@
 #ifndef RISCV_SIMULATOR_RSS_H
 #define RISCV_SIMULATOR_RSS_H
 
+#include <algorithm>
 #include "instuction.h"
 #include "../utils/config.h"
 #include "register.h"
 #include "alu.h"
 #include "bus.h"
 #include "../storage/lsb.h"
+#include "muldiv.h"
+#include "fu_pool.h"
 
 class ReservationStation {
 private:
   struct RssEntry {
     OptType opt;
-    int value1 = 0, value2 = 0;
-    int dependency1 = -1, dependency2 = -1;
-    int label = 0; // in RoB
+    int src1 = 0, src2 = 0; // physical registers of rs1, rs2(values are read from the register file at execution)
+    long long label = 0; // in RoB
+    int tag = -1; // physical register of the result, -1 if the result is not written to a register
     int imm = 0;
+    int len = 4; // size of the instruction, the next pc of a branch not taken is pc + len
+    int pc = 0;
+    int predicted = -1; // branch/JALR: next pc given by fetch(-1 if JALR is not predicted), LD: the predicted value
+    int checkpoint = -1; // branch/JALR: checkpoint in register, LD: checkpoint if the value is predicted(-1 if not)
+    FusedType fused = FusedType::None; // fused pair: opt1, imm1 and tag1 are the first instruction
+    OptType opt1 = OptType::ADDI;
+    int imm1 = 0;
+    int tag1 = -1;
 
     friend std::ostream &operator<<(std::ostream &os, const ReservationStation::RssEntry &obj) {
       os << "label = " << obj.label << ", opt = ";
@@ -58,76 +69,145 @@ private:
         case OptType::SRA : os << "SRA"; break;
         case OptType::OR : os << "OR"; break;
         case OptType::AND : os << "AND"; break;
+        case OptType::MUL : os << "MUL"; break;
+        case OptType::MULH : os << "MULH"; break;
+        case OptType::MULHSU : os << "MULHSU"; break;
+        case OptType::MULHU : os << "MULHU"; break;
+        case OptType::DIV : os << "DIV"; break;
+        case OptType::DIVU : os << "DIVU"; break;
+        case OptType::REM : os << "REM"; break;
+        case OptType::REMU : os << "REMU"; break;
+        case OptType::ECALL : os << "ECALL"; break;
+        case OptType::CSRRW : os << "CSRRW"; break;
+        case OptType::CSRRS : os << "CSRRS"; break;
+        case OptType::CSRRC : os << "CSRRC"; break;
+        case OptType::CSRRWI : os << "CSRRWI"; break;
+        case OptType::CSRRSI : os << "CSRRSI"; break;
+        case OptType::CSRRCI : os << "CSRRCI"; break;
       }
-      os << std::hex << ", value1 = " << obj.value1 << std::dec << ", dependency1 = " << obj.dependency1;
-      os << std::hex <<  ", value2 = " << obj.value2 << std::dec << ", dependency2 = " << obj.dependency2;
+      os << ", src1 = " << obj.src1 << ", src2 = " << obj.src2 << ", tag = " << obj.tag;
       os << ", imm = " << obj.imm;
+      if (obj.fused != FusedType::None) os << ", fused, tag1 = " << obj.tag1 << ", imm1 = " << obj.imm1;
       return os;
     }
   };
 public:
   ReservationStation() = default;
 
+  // only the entries in use are copied
   void flush() {
-    for (int i = 0; i < RSSSIZE; ++i) {
-      rss_now[i] = rss_next[i];
-    }
-    size_now = size_next;
+    int size = rss_next.size;
+    std::copy(rss_next.dependency1, rss_next.dependency1 + size, rss_now.dependency1);
+    std::copy(rss_next.dependency2, rss_next.dependency2 + size, rss_now.dependency2);
+    std::copy(rss_next.entry, rss_next.entry + size, rss_now.entry);
+    rss_now.size = size;
   }
 
-  bool full() const {return size_now == RSSSIZE;}
+  bool full() const {return rss_now.size == RSSSIZE;}
+
+  int size() const {return rss_now.size;}
+
+  void Clear() {rss_next.size = 0;}
 
-  void Clear() {size_next = 0;}
+  // remove entries after the instruction of label(a mispredicted branch/JALR)
+  void Squash(long long label);
 
   /*
-   * read values and dependency in reg
-   * add an entry
+   * add an entry with the physical registers from renaming
+   * predicted: next pc given by fetch(branch/JALR) or the predicted value(LD with a checkpoint)
    */
-  void issue(int rob_index, const InstructionUnit::Instruction &ins, const Register &reg, int pc);
+  void issue(long long rob_index, const InstructionUnit::Instruction &ins, const Register::Renamed &renamed, int pc, int predicted = -1);
 
   /*
-   * find an entry without dependency and calculate in ALU and get result
-   * put the information into bus(label, value)
-   * remove entry
+   * entries without dependency(oldest first) are calculated in ALU and started on a free unit of their kind in pool
+   * (an ALU or a branch unit, see OP_TIMING), the others wait
+   * remove entries
+   * branch/JALR: compare the next pc with the prediction, the op keeps the result(see FunctionalUnitPool::Op)
    */
-  void AriExecute(const ArithmeticLogicUnit &alu, CommonDataBus &cdb, int pc);
+  template <typename Trace>
+  void AriExecute(const ArithmeticLogicUnit &alu, const Register &reg, const CommonDataBus &cdb, FunctionalUnitPool &pool, Trace &trace);
 
   /*
-   * find an entry without dependency
-   * if a ST is at top and without dependency,
-   *     calculate the addr and value, pop it into lsb and remove entry
+   * find entries without dependency, each is sent on a free AGU of pool(up to AGU_NUM per cycle)
+   * if a ST is without dependency and all entries before it are sent,
+   *     calculate the addr and value, pop it into lsb and remove entry(nothing after it in this cycle: a LD is
+   *     forwarded only from the STs in lsb before this cycle)
    * if a LD is without dependency and has no STs before it,
    *     calculate its addr, pop it into lsb(and then lsb.execute) and remove entry
+   * the LDs forwarded from a ST in lsb are put in loaded, return the number of them
+   */
+  template <typename Trace>
+  int LsExecute(const ArithmeticLogicUnit &alu, const Register &reg, CommonDataBus &cdb, LoadStoreBuffer &lsb,
+                FunctionalUnitPool &pool, Trace &trace, LoadStoreBuffer::Loaded loaded[AGU_NUM]);
+
+  /*
+   * the ALU operation opt(not LD/ST, mul or div) on n lanes: value[i] is the result AriExecute gets from value1[i], value2[i]
+   * imm is the one issue gives(pc is added for AUIPC, JAL: pc + len), branch: the offset of next pc, JALR: the target
+   * used by the batched interpreter(see BatchInterpreter), vectorized with AVX2 where the host has it
    */
-  void LsExecute(const ArithmeticLogicUnit &alu, CommonDataBus &cdb, LoadStoreBuffer &lsb);
+  static void ComputeLanes(const ArithmeticLogicUnit &alu, OptType opt, int imm, int len, const int *value1, const int *value2, int *value, int n);
 
   /*
-   * monitor bus and clear dependency(check dependency)
+   * if the unit(MultiplyUnit or DivideUnit) can take an op,
+   *     find an entry without dependency, start it in the unit and remove entry
+   * the result is put on bus by the unit when it is finished
    */
-  void CheckBus(const CommonDataBus &cdb1, const CommonDataBus &cdb2);
+  template <typename Unit, typename Trace>
+  void MulDivExecute(Unit &unit, const Register &reg, Trace &trace);
+
+  /*
+   * monitor ready_bus and clear dependency(a physical register is written)
+   * each register written is compared with the packed dependencies of all entries(vectorized by the compiler)
+   */
+  void CheckBus(const CommonDataBus &cdb);
 
   void print();
 
 private:
+  /*
+   * structure of arrays: the dependencies(read by wakeup and select every cycle) are packed apart from the other fields,
+   * which are only read when an entry is executed
+   */
+  struct Entries {
+    int dependency1[RSSSIZE], dependency2[RSSSIZE]; // physical register waited for, -1 if ready
+    RssEntry entry[RSSSIZE];
+    int size = 0;
+
+    bool Independent(int i) const {return dependency1[i] == -1 && dependency2[i] == -1;}
+  };
+
   // 从下标0开始放，到size - 1为止
-  RssEntry rss_now[RSSSIZE];
-  int size_now = 0;
-  RssEntry rss_next[RSSSIZE];
-  int size_next = 0;
+  Entries rss_now;
+  Entries rss_next;
+
+  // result of an entry of ari_rss
+  static int Compute(const ArithmeticLogicUnit &alu, const RssEntry &tmp, int value1, int value2);
+
+  // ComputeLanes of one opt
+  template <OptType opt>
+  static void ComputeLanesOf(const ArithmeticLogicUnit &alu, int imm, int len, const int *value1, const int *value2, int *value, int n);
+
+  // result of a fused entry of ari_rss, first: result of the first instruction
+  static int ComputeFused(const ArithmeticLogicUnit &alu, const RssEntry &tmp, int value1, int value2, int &first);
 
   int FindIndependentEntry() {
-    for (int i = 0; i < size_now; ++i) {
-      if (rss_now[i].dependency1 == -1 && rss_now[i].dependency2 == -1)
+    for (int i = 0; i < rss_now.size; ++i) {
+      if (rss_now.Independent(i))
         return i;
     }
     return -1;
   }
 
   void RemoveEntry(int index) {
-    --size_next;
-    for (int i = index; i < size_next; ++i) {
-      rss_next[i] = rss_next[i + 1];
-    }
+    int size = --rss_next.size;
+    std::copy(rss_next.dependency1 + index + 1, rss_next.dependency1 + size + 1, rss_next.dependency1 + index);
+    std::copy(rss_next.dependency2 + index + 1, rss_next.dependency2 + size + 1, rss_next.dependency2 + index);
+    std::copy(rss_next.entry + index + 1, rss_next.entry + size + 1, rss_next.entry + index);
+  }
+
+  // index: entries of rss_now in ascending order
+  void RemoveEntries(const int *index, int n) {
+    for (int i = n - 1; i >= 0; --i) RemoveEntry(index[i]);
   }
 
 };
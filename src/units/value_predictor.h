@@ -0,0 +1,89 @@
+
+#ifndef RISCV_SIMULATOR_VALUE_PREDICTOR_H
+#define RISCV_SIMULATOR_VALUE_PREDICTOR_H
+
+#include "../utils/config.h"
+
+/*
+ * last value + stride predictor of LD results, indexed by pc
+ * Predict(): called when a LD is issued, the value is used only when the entry is confident
+ * Train(): called when the loaded(or forwarded) value is known, the entry is updated in flush(seen by issue from the
+ *          next cycle)
+ *
+ * inflight: LDs of the pc issued but not trained yet, the prediction skips their values
+ * (a LD in a loop is usually issued again before the last one is finished)
+ * Squash() forgets them, the count may be too small for a while after a flush and the misses lower the confidence
+ */
+class ValuePredictor {
+public:
+  ValuePredictor() = default;
+
+  // return true if the entry of pc is confident, value: the predicted value
+  bool Predict(int pc, int &value) {
+    Entry &entry = table[Index(pc)];
+    if (entry.pc != pc) return false;
+    ++entry.inflight;
+    value = entry.last + entry.stride * entry.inflight;
+    return entry.confidence >= VALUE_PREDICT_CONFIDENCE;
+  }
+
+  // the LD at pc got value, mispredicted: it was predicted with another value
+  void Train(int pc, int value, bool mispredicted) {
+    trained[trained_num++] = {pc, value, mispredicted};
+  }
+
+  void flush() {
+    for (int i = 0; i < trained_num; ++i) Update(trained[i].pc, trained[i].value, trained[i].mispredicted);
+    trained_num = 0;
+  }
+
+  // confidence grows while the values follow the stride, a miss or a mispredicted LD resets it
+  void Update(int pc, int value, bool mispredicted) {
+    Entry &entry = table[Index(pc)];
+    if (entry.pc != pc) {
+      entry = Entry();
+      entry.pc = pc;
+      entry.last = value;
+      return;
+    }
+    if (entry.inflight > 0) --entry.inflight;
+    if (value == entry.last + entry.stride) {
+      if (entry.confidence < VALUE_PREDICT_CONFIDENCE) ++entry.confidence;
+    }
+    else {
+      entry.confidence = 0;
+      entry.stride = value - entry.last;
+    }
+    if (mispredicted) entry.confidence = 0;
+    entry.last = value;
+  }
+
+  // the pipeline is flushed, LDs in flight may be removed
+  void Squash() {
+    for (int i = 0; i < VALUE_PREDICT_NUM; ++i) table[i].inflight = 0;
+  }
+
+private:
+  struct Entry {
+    int pc = -1;
+    int last = 0;
+    int stride = 0;
+    int confidence = 0;
+    int inflight = 0;
+  };
+
+  struct Trained {
+    int pc;
+    int value;
+    bool mispredicted;
+  };
+
+  Entry table[VALUE_PREDICT_NUM];
+  Trained trained[AGU_NUM + 1]; // in this cycle(a loaded LD and the forwarded LDs)
+  int trained_num = 0;
+
+  // pcs are 2-byte aligned(RV32C)
+  static int Index(int pc) {return (u32(pc) >> 1) % VALUE_PREDICT_NUM;}
+};
+
+#endif //RISCV_SIMULATOR_VALUE_PREDICTOR_H
@@ -0,0 +1,41 @@
+
+#ifndef RISCV_SIMULATOR_ALIGNED_H
+#define RISCV_SIMULATOR_ALIGNED_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <utility>
+
+/*
+ * heap objects of over-aligned types(e.g. the alignas(64) indexes of SpscQueue)
+ * new doesn't align them before C++17: the memory is taken from posix_memalign and the object is built in it,
+ * AlignedDelete destroys the object and frees the memory
+ */
+template <typename T>
+struct AlignedDelete {
+  void operator()(T *ptr) const {
+    if (ptr == nullptr) return;
+    ptr->~T();
+    free(ptr);
+  }
+};
+
+template <typename T>
+using AlignedPtr = std::unique_ptr<T, AlignedDelete<T>>;
+
+template <typename T, typename... Args>
+AlignedPtr<T> MakeAligned(Args &&... args) {
+  void *ptr = nullptr;
+  if (posix_memalign(&ptr, std::max(alignof(T), sizeof (void *)), sizeof (T)) != 0) throw std::bad_alloc();
+  try {
+    return AlignedPtr<T>(new (ptr) T(std::forward<Args>(args)...));
+  }
+  catch (...) {
+    free(ptr);
+    throw;
+  }
+}
+
+#endif //RISCV_SIMULATOR_ALIGNED_H
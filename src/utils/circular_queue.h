@@ -67,6 +67,10 @@ public:
     return tail == head;
   }
 
+  int length() const {
+    return (tail - head + size) % size;
+  }
+
   void clear() {
     head = tail;
   }
@@ -83,6 +87,12 @@ public:
     head = (head + 1) % size;
   }
 
+  // pop at back, the index returned by that push is returned by the next push again
+  void pop_back() {
+    tail = (tail - 1 + size) % size;
+    --cnt;
+  }
+
   iterator back() {
     return {(tail - 1 + size) % size, this};
   }
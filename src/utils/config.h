@@ -3,6 +3,7 @@
 #include <cstdint>
 
 using u32 = unsigned;
+using u64 = unsigned long long;
 using i32 = int;
 using u8 = uint8_t;
 
@@ -10,7 +11,39 @@ constexpr int MEMSIZE = 2e6;
 constexpr int ROBSIZE = 32;
 constexpr int RSSSIZE = 32;
 constexpr int REGNUM = 32;
+constexpr int PHYREGNUM = 64; // physical registers(REGNUM of them hold the committed state)
 constexpr int LSBSIZE = 32;
-constexpr int CDBSIZE = 4;
+constexpr int CHECKPOINTNUM = 8; // rename map checkpoints, one for each unresolved branch/JALR
+constexpr int READY_BUS_WIDTH = 4; // results(ALU, LD/ST, mul, div) broadcast per cycle
+constexpr int COMMIT_BUS_WIDTH = 1; // committed STs broadcast per cycle
+constexpr int CDBSIZE = (READY_BUS_WIDTH > COMMIT_BUS_WIDTH) ? READY_BUS_WIDTH : COMMIT_BUS_WIDTH; // slots of a bus
+constexpr int FETCH_WIDTH = 4; // instructions fetched per cycle
+constexpr int FETCH_QUEUE_SIZE = 16;
 constexpr int PREDICT_STACK_SIZE = 12;
 constexpr int PREDICT_COUNTER_NUM = 1024;
+constexpr int VALUE_PREDICT_NUM = 256; // entries of the LD value predictor
+constexpr int VALUE_PREDICT_CONFIDENCE = 7; // a LD value is predicted after this many values following the stride
+constexpr int ALU_NUM = 2; // integer ALUs(see FunctionalUnitPool)
+constexpr int BRANCH_UNIT_NUM = 1; // units of branches and jumps
+constexpr int AGU_NUM = 1; // address generation units: LD/ST sent from ls_rss to lsb per cycle
+constexpr int FU_NUM = ALU_NUM + BRANCH_UNIT_NUM + AGU_NUM;
+constexpr int FU_MAX_LATENCY = 4; // no latency in OP_TIMING is longer
+constexpr int MUL_LATENCY = 3; // pipeline stages of the multiplier
+constexpr int DIV_MIN_LATENCY = 2; // divider latency without quotient bits(1 more cycle per quotient bit)
+constexpr int LSB_LATENCY = 3; // cycles of a LD/ST in lsb(hitting the data cache)
+constexpr int MMIO_LATENCY = 2; // cycles of a LD/ST in lsb accessing a device(uncached)
+constexpr int UART_BASE = 0x10000000; // devices(see IoBus), outside memory
+constexpr int TIMER_BASE = 0x10001000;
+constexpr int DMA_BASE = 0x10002000;
+constexpr int DCACHE_LINE = 32; // bytes per line of the data cache
+constexpr int DCACHE_SETS = 32;
+constexpr int DCACHE_WAYS = 2;
+constexpr int DCACHE_MISS_PENALTY = 20; // more cycles of a LD/ST missing the data cache
+constexpr int PREFETCH_QUEUE_SIZE = 16; // prefetches in flight
+constexpr int PREFETCH_STRIDE_NUM = 64; // entries of the stride prefetcher
+constexpr int PREFETCH_STREAM_NUM = 8; // streams tracked by the stream prefetcher
+constexpr int PREFETCH_EPOCH = 64; // prefetches between two throttling decisions
+constexpr double PREFETCH_LOW_ACCURACY = 0.4;
+constexpr double PREFETCH_HIGH_ACCURACY = 0.75;
+constexpr int OUTPUT_BUFFER_SIZE = 1 << 16; // bytes of guest stdout/stderr written to the host at once
+constexpr long long SIM_CLOCK_HZ = 1000000000; // simulated clock(clock_gettime of the program)
@@ -0,0 +1,51 @@
+
+#ifndef RISCV_SIMULATOR_GUEST_OUTPUT_H
+#define RISCV_SIMULATOR_GUEST_OUTPUT_H
+
+#include <cerrno>
+#include <string>
+#include <unistd.h>
+#include "config.h"
+
+/*
+ * the host stdout and stderr of a program(written by system calls and by the uart, see SyscallEmulator and Uart)
+ * one buffer in the order the program wrote: a write to the other fd flushes the buffer first
+ * written to the host in blocks of OUTPUT_BUFFER_SIZE(flushed when full, at exit and when destroyed)
+ */
+class GuestOutput {
+public:
+  GuestOutput() = default;
+
+  GuestOutput(const GuestOutput &) = delete;
+
+  GuestOutput &operator=(const GuestOutput &) = delete;
+
+  ~GuestOutput() {Flush();}
+
+  // fd: 1 or 2
+  void Write(int fd, char c) {
+    if (fd != this->fd) {
+      Flush();
+      this->fd = fd;
+    }
+    out.push_back(c);
+    if (int(out.size()) >= OUTPUT_BUFFER_SIZE) Flush();
+  }
+
+  void Flush() {
+    size_t done = 0;
+    while (done < out.size()) {
+      ssize_t len = write(fd, out.data() + done, out.size() - done);
+      if (len < 0 && errno == EINTR) continue;
+      if (len <= 0) break;
+      done += size_t(len);
+    }
+    out.clear();
+  }
+
+private:
+  std::string out;
+  int fd = 1; // of the bytes in out
+};
+
+#endif //RISCV_SIMULATOR_GUEST_OUTPUT_H
@@ -0,0 +1,101 @@
+
+#ifndef RISCV_SIMULATOR_JSON_H
+#define RISCV_SIMULATOR_JSON_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * minimal streaming json writer used by statistics output
+ * objects are printed one member per line, arrays in one line
+ * keys are ignored inside arrays
+ */
+class JsonWriter {
+public:
+  explicit JsonWriter(std::ostream &os) : os(os) {}
+
+  void BeginObject(const char *key = nullptr) {
+    Prefix(key);
+    os << "{";
+    scopes.push_back({false, 0});
+  }
+
+  void EndObject() {
+    bool empty = scopes.back().count == 0;
+    scopes.pop_back();
+    if (!empty) {
+      os << "\n";
+      Indent();
+    }
+    os << "}";
+    if (scopes.empty()) os << "\n";
+  }
+
+  void BeginArray(const char *key = nullptr) {
+    Prefix(key);
+    os << "[";
+    scopes.push_back({true, 0});
+  }
+
+  void EndArray() {
+    scopes.pop_back();
+    os << "]";
+  }
+
+  template <typename T>
+  void Value(const char *key, const T &value) {
+    Prefix(key);
+    Print(value);
+  }
+
+  template <typename T>
+  void Element(const T &value) {
+    Prefix(nullptr);
+    Print(value);
+  }
+
+private:
+  struct Scope {
+    bool array;
+    int count;
+  };
+
+  std::ostream &os;
+  std::vector<Scope> scopes;
+
+  void Indent() {
+    for (int i = 0; i < int(scopes.size()); ++i) os << "  ";
+  }
+
+  void Prefix(const char *key) {
+    if (scopes.empty()) return;
+    Scope &scope = scopes.back();
+    if (scope.array) {
+      if (scope.count++ > 0) os << ", ";
+      return;
+    }
+    if (scope.count++ > 0) os << ",";
+    os << "\n";
+    Indent();
+    os << "\"" << (key == nullptr ? "" : key) << "\": ";
+  }
+
+  template <typename T>
+  void Print(const T &value) {os << value;}
+
+  void Print(bool value) {os << (value ? "true" : "false");}
+
+  void Print(const char *value) {
+    os << "\"";
+    for (const char *ch = value; *ch; ++ch) {
+      if (*ch == '"' || *ch == '\\') os << '\\';
+      os << *ch;
+    }
+    os << "\"";
+  }
+
+  void Print(const std::string &value) {Print(value.c_str());}
+};
+
+#endif //RISCV_SIMULATOR_JSON_H
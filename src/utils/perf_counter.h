@@ -0,0 +1,282 @@
+
+#ifndef RISCV_SIMULATOR_PERF_COUNTER_H
+#define RISCV_SIMULATOR_PERF_COUNTER_H
+
+#include <iostream>
+#include "config.h"
+#include "json.h"
+#include "../units/instuction.h"
+
+/*
+ * why the issue slot of a cycle was not used
+ * None: an instruction was issued
+ */
+enum class IssueStall {
+  None, RobFull, LsRssFull, AriRssFull, MulDivRssFull, PrfFull, CheckpointFull, LsbFull, JalrStall, FetchQueueEmpty, End,
+  Serialize, // an ECALL or CSR instruction in flight: the instructions after it wait until it commits
+  Recovery, // fetch_queue is empty after a flush, until the first instruction of the correct path is issued
+  NUM
+};
+
+/*
+ * why the commit slot of a cycle was not used
+ * None: an instruction was committed
+ */
+enum class CommitStall {
+  None, Empty, HeadNotReady, Mispredict, CdbFull,
+  SyscallDrain, // an ECALL at the head waits for the STs before it to be written
+  NUM
+};
+
+class PerfCounter {
+public:
+  // summed over cycles in Totals::occupancy
+  enum Occupancy {FetchQueueSize, RobSize, LsRssSize, AriRssSize, MulRssSize, DivRssSize, LsbSize, OCCUPANCY_NUM};
+
+  // cumulative counters(see IntervalSampler)
+  struct Totals {
+    long long cycles = 0;
+    long long retired = 0;
+    long long branches = 0; // committed branches/JALRs
+    long long flushes = 0;
+    long long loads = 0, load_latency = 0; // committed LDs, their cycles from issue to ready
+    long long issue_slots[int(IssueStall::NUM)] = {0};
+    long long commit_slots[int(CommitStall::NUM)] = {0};
+    long long occupancy[OCCUPANCY_NUM] = {0};
+  };
+
+  PerfCounter() = default;
+
+  /*
+   * called once at the end of every cycle (before flush), all sizes are the sizes of the current state
+   * rob_head_mem: the entry at the front of rob is a LD/ST
+   */
+  void Sample(IssueStall issue, CommitStall commit, bool rob_head_mem, int fetch_queue_size,
+              int rob_size, int ls_rss_size, int ari_rss_size, int mul_rss_size, int div_rss_size, int lsb_size) {
+    ++cycles;
+    ++issue_slots[int(issue)];
+    ++commit_slots[int(commit)];
+    switch (issue) {
+      case IssueStall::None : break;
+      case IssueStall::JalrStall :
+      case IssueStall::FetchQueueEmpty : ++frontend; break;
+      case IssueStall::LsRssFull :
+      case IssueStall::LsbFull : ++backend_mem; break;
+      case IssueStall::RobFull :
+      case IssueStall::PrfFull :
+      case IssueStall::CheckpointFull : (rob_head_mem) ? ++backend_mem : ++backend_core; break;
+      case IssueStall::AriRssFull :
+      case IssueStall::MulDivRssFull :
+      case IssueStall::Serialize : ++backend_core; break;
+      default: break;
+    }
+    ++fetch_queue_hist[fetch_queue_size];
+    ++rob_hist[rob_size];
+    ++ls_rss_hist[ls_rss_size];
+    ++ari_rss_hist[ari_rss_size];
+    ++mul_rss_hist[mul_rss_size];
+    ++div_rss_hist[div_rss_size];
+    ++lsb_hist[lsb_size];
+    int sizes[OCCUPANCY_NUM] = {fetch_queue_size, rob_size, ls_rss_size, ari_rss_size, mul_rss_size, div_rss_size, lsb_size};
+    for (int i = 0; i < OCCUPANCY_NUM; ++i) occupancy[i] += sizes[i];
+  }
+
+  // called for every committed instruction, len: size in memory(2 for a compressed instruction)
+  void Retire(int len) {
+    ++retired;
+    if (len == 2) ++compressed;
+    code_bytes += len;
+  }
+
+  // called for every committed LD after Retire, latency: cycles from issue to ready
+  void RetireLoad(int latency) {
+    ++committed_loads;
+    load_latency += latency;
+  }
+
+  // called for every committed branch/JALR after Retire
+  void RetireBranch() {++branches;}
+
+  // called for every committed fused pair(instead of Retire), len1, len2: size of the two instructions
+  void RetireFused(FusedType type, int len1, int len2) {
+    Retire(len1);
+    Retire(len2);
+    ++fused[int(type)];
+  }
+
+  // called every cycle after the buses are arbitrated, number of requests that didn't get a slot
+  void BusConflict(int ready_waiting, int commit_waiting) {
+    if (ready_waiting > 0) ++ready_conflict_cycles;
+    ready_conflicts += ready_waiting;
+    commit_conflicts += commit_waiting;
+  }
+
+  // called for every LD that got its value(loaded or forwarded), predicted: it was issued with a predicted value
+  void LoadValue(bool predicted, bool correct) {
+    ++loads;
+    if (predicted) ++value_predicted;
+    if (correct) ++value_correct;
+  }
+
+  // called by ClearPipeline, squashed: number of entries removed from rob
+  void Squash(int squashed) {
+    ++flushes;
+    this->squashed += squashed;
+  }
+
+  long long Cycles() const {return cycles;}
+
+  long long Retired() const {return retired;}
+
+  void GetTotals(Totals &totals) const {
+    totals.cycles = cycles;
+    totals.retired = retired;
+    totals.branches = branches;
+    totals.flushes = flushes;
+    totals.loads = committed_loads;
+    totals.load_latency = load_latency;
+    for (int i = 0; i < int(IssueStall::NUM); ++i) totals.issue_slots[i] = issue_slots[i];
+    for (int i = 0; i < int(CommitStall::NUM); ++i) totals.commit_slots[i] = commit_slots[i];
+    for (int i = 0; i < OCCUPANCY_NUM; ++i) totals.occupancy[i] = occupancy[i];
+  }
+
+  // committed operations(a fused pair is one)
+  long long Committed() const {return commit_slots[int(CommitStall::None)];}
+
+  /*
+   * top-down breakdown of issue slots(1 slot per cycle, the slots after .END is fetched are not counted):
+   *   retiring: committed operations(a fused pair is one)
+   *   bad speculation: issued but squashed instructions, and the slots of recovery after a flush
+   *   frontend bound: no instruction can be supplied(JALR without prediction, fetch_queue empty)
+   *   backend memory/core: stalled by a full structure, memory if the structure belongs to LD/ST
+   */
+  void PrintJson(JsonWriter &json) const {
+    long long committed = Committed();
+    long long issued = issue_slots[int(IssueStall::None)];
+    long long bad_spec = issued - committed + issue_slots[int(IssueStall::Recovery)];
+    long long slots = cycles - issue_slots[int(IssueStall::End)];
+    json.Value("instructions", retired);
+    json.Value("ipc", Ratio(retired, cycles));
+    json.Value("flushes", flushes);
+    json.Value("squashed", squashed);
+    json.BeginObject("compressed");
+    json.Value("instructions", compressed);
+    json.Value("fraction", Ratio(compressed, retired));
+    // bytes of the committed code(wrong-path fetches are not counted), saved: against all instructions 4 bytes
+    json.Value("retired_code_bytes", code_bytes);
+    json.Value("code_bytes_saved", 4 * retired - code_bytes);
+    json.Value("code_saving", Ratio(4 * retired - code_bytes, 4 * retired));
+    json.EndObject();
+    json.BeginObject("fusion");
+    long long pairs = 0;
+    for (int i = 1; i < int(FusedType::NUM); ++i) {
+      json.Value(FusedName(i), fused[i]);
+      pairs += fused[i];
+    }
+    json.Value("fraction", Ratio(2 * pairs, retired));
+    json.EndObject();
+    json.BeginObject("value_prediction");
+    json.Value("loads", loads);
+    json.Value("predicted", value_predicted);
+    json.Value("correct", value_correct);
+    json.Value("coverage", Ratio(value_predicted, loads));
+    json.Value("accuracy", Ratio(value_correct, value_predicted));
+    json.Value("recoveries", value_predicted - value_correct);
+    json.EndObject();
+    json.BeginObject("bus");
+    json.Value("ready_width", READY_BUS_WIDTH);
+    json.Value("commit_width", COMMIT_BUS_WIDTH);
+    json.Value("ready_conflicts", ready_conflicts);
+    json.Value("ready_conflict_cycles", ready_conflict_cycles);
+    json.Value("commit_conflicts", commit_conflicts);
+    json.EndObject();
+    json.BeginObject("issue");
+    for (int i = 0; i < int(IssueStall::NUM); ++i) json.Value(IssueName(i), issue_slots[i]);
+    json.EndObject();
+    json.BeginObject("commit");
+    for (int i = 0; i < int(CommitStall::NUM); ++i) json.Value(CommitName(i), commit_slots[i]);
+    json.EndObject();
+    json.BeginObject("top_down");
+    json.Value("retiring", Ratio(committed, slots));
+    json.Value("bad_speculation", Ratio(bad_spec, slots));
+    json.Value("frontend_bound", Ratio(frontend, slots));
+    json.Value("backend_memory", Ratio(backend_mem, slots));
+    json.Value("backend_core", Ratio(backend_core, slots));
+    json.EndObject();
+    json.BeginObject("occupancy");
+    PrintHist(json, "fetch_queue", fetch_queue_hist, FETCH_QUEUE_SIZE);
+    PrintHist(json, "rob", rob_hist, ROBSIZE);
+    PrintHist(json, "ls_rss", ls_rss_hist, RSSSIZE);
+    PrintHist(json, "ari_rss", ari_rss_hist, RSSSIZE);
+    PrintHist(json, "mul_rss", mul_rss_hist, RSSSIZE);
+    PrintHist(json, "div_rss", div_rss_hist, RSSSIZE);
+    PrintHist(json, "lsb", lsb_hist, LSBSIZE);
+    json.EndObject();
+  }
+
+private:
+  long long cycles = 0;
+  long long issue_slots[int(IssueStall::NUM)] = {0};
+  long long commit_slots[int(CommitStall::NUM)] = {0};
+  long long frontend = 0, backend_mem = 0, backend_core = 0;
+  long long flushes = 0, squashed = 0;
+  long long retired = 0; // committed instructions(a fused pair is two)
+  long long compressed = 0, code_bytes = 0; // committed instructions only
+  long long fused[int(FusedType::NUM)] = {0}; // committed fused pairs
+  long long loads = 0, value_predicted = 0, value_correct = 0; // executed LDs(squashed ones included)
+  long long ready_conflicts = 0, ready_conflict_cycles = 0, commit_conflicts = 0; // ready_conflicts: waiting requests summed over cycles
+  // index: number of valid entries
+  long long fetch_queue_hist[FETCH_QUEUE_SIZE + 1] = {0};
+  long long rob_hist[ROBSIZE + 1] = {0};
+  long long ls_rss_hist[RSSSIZE + 1] = {0};
+  long long ari_rss_hist[RSSSIZE + 1] = {0};
+  long long mul_rss_hist[RSSSIZE + 1] = {0};
+  long long div_rss_hist[RSSSIZE + 1] = {0};
+  long long lsb_hist[LSBSIZE + 1] = {0};
+  long long occupancy[OCCUPANCY_NUM] = {0};
+  long long branches = 0, committed_loads = 0, load_latency = 0;
+
+public:
+  // names of the slots and the occupied structures(in stats and samples)
+  static const char *IssueName(int i) {
+    static const char *const name[] = {
+        "issued", "rob_full", "ls_rss_full", "ari_rss_full", "muldiv_rss_full", "prf_full", "checkpoint_full", "lsb_full", "jalr_stall", "fetch_queue_empty", "end", "serialize",
+        "recovery"
+    };
+    return name[i];
+  }
+
+  static const char *OccupancyName(int i) {
+    static const char *const name[] = {
+        "fetch_queue", "rob", "ls_rss", "ari_rss", "mul_rss", "div_rss", "lsb"
+    };
+    return name[i];
+  }
+
+  static const char *CommitName(int i) {
+    static const char *const name[] = {
+        "committed", "empty", "head_not_ready", "mispredict_flush", "cdb_full", "syscall_drain"
+    };
+    return name[i];
+  }
+
+private:
+  static const char *FusedName(int i) {
+    static const char *const name[] = {
+        "none", "lui_addi", "auipc_jalr", "slli_add", "cmp_branch"
+    };
+    return name[i];
+  }
+
+  static double Ratio(long long a, long long b) {
+    return b == 0 ? 0 : double(a) / double(b);
+  }
+
+  static void PrintHist(JsonWriter &json, const char *name, const long long *hist, int size) {
+    json.BeginArray(name);
+    for (int i = 0; i <= size; ++i) json.Element(hist[i]);
+    json.EndArray();
+  }
+};
+
+#endif //RISCV_SIMULATOR_PERF_COUNTER_H
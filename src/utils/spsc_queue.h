@@ -0,0 +1,51 @@
+
+#ifndef RISCV_SIMULATOR_SPSC_QUEUE_H
+#define RISCV_SIMULATOR_SPSC_QUEUE_H
+
+#include <atomic>
+#include <thread>
+
+/*
+ * bounded lock-free queue between one producer thread and one consumer thread
+ * size must be a power of 2
+ * each side keeps a private copy of the other side's index and only reloads it
+ * when the queue looks full(producer) or empty(consumer), so the shared cache lines are rarely touched
+ */
+template <typename T, int size>
+class SpscQueue {
+  static_assert((size & (size - 1)) == 0, "size of SpscQueue must be a power of 2");
+public:
+  SpscQueue() = default;
+
+  // producer: wait(yield) while the queue is full
+  void push(const T &obj) {
+    unsigned t = tail.load(std::memory_order_relaxed);
+    while (t - head_cache == size) {
+      head_cache = head.load(std::memory_order_acquire);
+      if (t - head_cache == size) std::this_thread::yield();
+    }
+    data[t & (size - 1)] = obj;
+    tail.store(t + 1, std::memory_order_release);
+  }
+
+  // consumer: return false if the queue is empty
+  bool pop(T &obj) {
+    unsigned h = head.load(std::memory_order_relaxed);
+    if (h == tail_cache) {
+      tail_cache = tail.load(std::memory_order_acquire);
+      if (h == tail_cache) return false;
+    }
+    obj = data[h & (size - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  T data[size];
+  alignas(64) std::atomic<unsigned> head{0};
+  unsigned tail_cache = 0; // consumer's copy of tail
+  alignas(64) std::atomic<unsigned> tail{0};
+  unsigned head_cache = 0; // producer's copy of head
+};
+
+#endif //RISCV_SIMULATOR_SPSC_QUEUE_H
@@ -0,0 +1,88 @@
+
+#ifndef RISCV_SIMULATOR_SYMBOL_TABLE_H
+#define RISCV_SIMULATOR_SYMBOL_TABLE_H
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "config.h"
+
+/*
+ * function symbols read from the .symtab of an ELF32 file
+ * only used to give names to pcs, the program itself is still read from stdin
+ */
+class SymbolTable {
+public:
+  struct Symbol {
+    u32 addr = 0;
+    u32 size = 0;
+    std::string name;
+  };
+
+  SymbolTable() = default;
+
+  /*
+   * read all STT_FUNC symbols in the file
+   * return false if the file is not a little-endian ELF32 file or has no symbol table
+   */
+  bool LoadElf(const char *path) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is) return false;
+    std::vector<char> buf((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    if (buf.size() < 52 || memcmp(buf.data(), "\x7f" "ELF", 4) != 0) return false;
+    if (buf[4] != 1 || buf[5] != 1) return false; // ELFCLASS32, ELFDATA2LSB
+    // offsets are summed in 64 bits(a sum of u32 fields from the file may wrap around)
+    u64 shoff = Read32(buf, 32);
+    u64 shentsize = Read16(buf, 46);
+    u64 shnum = Read16(buf, 48);
+    for (u64 i = 0; i < shnum; ++i) {
+      u64 sh = shoff + i * shentsize;
+      if (sh + 40 > buf.size() || Read32(buf, sh + 4) != 2) continue; // SHT_SYMTAB
+      u64 sym_off = Read32(buf, sh + 16);
+      u64 sym_size = Read32(buf, sh + 20);
+      u64 str_sh = shoff + Read32(buf, sh + 24) * shentsize;
+      if (str_sh + 40 > buf.size()) return false;
+      u64 str_off = Read32(buf, str_sh + 16);
+      for (u64 s = sym_off; s + 16 <= sym_off + sym_size && s + 16 <= buf.size(); s += 16) {
+        if ((u8(buf[s + 12]) & 0xf) != 2) continue; // STT_FUNC
+        u64 name = str_off + Read32(buf, s);
+        if (name >= buf.size()) continue;
+        // a name without its terminating NUL is cut at the end of the file
+        symbols.push_back({Read32(buf, s + 4), Read32(buf, s + 8),
+                           std::string(&buf[name], strnlen(&buf[name], buf.size() - name))});
+      }
+    }
+    std::sort(symbols.begin(), symbols.end(), [](const Symbol &a, const Symbol &b) {return a.addr < b.addr;});
+    return !symbols.empty();
+  }
+
+  bool empty() const {return symbols.empty();}
+
+  /*
+   * find the function containing addr, nullptr if not found
+   * a symbol with size 0 covers everything up to the next symbol
+   */
+  const Symbol *Find(u32 addr) const {
+    auto iter = std::upper_bound(symbols.begin(), symbols.end(), addr,
+                                 [](u32 a, const Symbol &sym) {return a < sym.addr;});
+    if (iter == symbols.begin()) return nullptr;
+    --iter;
+    if (iter->size != 0 && addr >= iter->addr + iter->size) return nullptr;
+    return &*iter;
+  }
+
+private:
+  std::vector<Symbol> symbols;
+
+  static u32 Read16(const std::vector<char> &buf, u64 pos) {
+    return u32(u8(buf[pos])) | (u32(u8(buf[pos + 1])) << 8);
+  }
+
+  static u32 Read32(const std::vector<char> &buf, u64 pos) {
+    return Read16(buf, pos) | (Read16(buf, pos + 2) << 16);
+  }
+};
+
+#endif //RISCV_SIMULATOR_SYMBOL_TABLE_H